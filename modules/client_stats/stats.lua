@@ -121,6 +121,10 @@ function sendStats()
       fps = g_app.getFps(),
       maxFps = g_app.getMaxFps(),
       atlas = g_atlas.getStats(),
+      text = g_text.getStats(),
+      send = Connection.getSendStats(),
+      draws = g_stats.getDrawInfo(false),
+      sprites = g_sprites.getCacheStats(),
       classic = tostring(g_settings.getBoolean("classicView")),
       fullscreen = tostring(g_window.isFullscreen()),
       vsync = tostring(g_settings.getBoolean("vsync")),
@@ -183,12 +187,12 @@ function update()
   
   iter = (iter + 1) % 9 -- some functions are slow (~5ms), it will avoid lags
   if iter == 0 then
-    statsWindow.debugPanel.sleepTime:setText("GFPS: " .. g_app.getGraphicsFps() .. " PFPS: " .. g_app.getProcessingFps() .. " Packets: " .. g_game.getRecivedPacketsCount() .. " , " .. (g_game.getRecivedPacketsSize() / 1024) .. " KB")
+    statsWindow.debugPanel.sleepTime:setText("GFPS: " .. g_app.getGraphicsFps() .. " PFPS: " .. g_app.getProcessingFps() .. " Packets: " .. g_game.getRecivedPacketsCount() .. " , " .. (g_game.getRecivedPacketsSize() / 1024) .. " KB (" .. math.round(g_game.getPacketsPerRead(), 2) .. " per read)")
     statsWindow.debugPanel.luaRamUsage:setText("Ram usage by lua: " .. gcinfo() .. " kb")
   elseif iter == 1 then
     local adaptive = "Adaptive: " .. g_adaptiveRenderer.getLevel() .. " | " .. g_adaptiveRenderer.getDebugInfo()
     adaptiveRender:setText(adaptive)
-    atlas:setText("Atlas: " .. g_atlas.getStats())
+    atlas:setText("Atlas: " .. g_atlas.getStats() .. "\n" .. g_stats.getDrawInfo(true) .. "\n" .. g_sprites.getCacheStats() .. "\nText: " .. g_text.getStats())
   elseif iter == 2 then
     render:setText(g_stats.get(2, 10, true))  
     mainStats:setText(g_stats.get(1, 5, true))
@@ -28,6 +28,9 @@
 #include <framework/util/extras.h>
 #include <framework/stdext/fastrand.h>
 
+// written only by dispatcher thread before floor tasks are dispatched and after they finished
+std::atomic_bool Animator::s_parallelAccess = { false };
+
 Animator::Animator()
 {
     m_animationPhases = 0;
@@ -97,6 +100,9 @@ void Animator::setPhase(int phase)
 
 int Animator::getPhase()
 {
+    std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+    if (s_parallelAccess.load(std::memory_order_relaxed))
+        lock.lock();
     ticks_t ticks = g_clock.millis();
     if(ticks != m_lastPhaseTicks && !m_isComplete) {
         int elapsedTicks = (int)(ticks - m_lastPhaseTicks);
@@ -127,7 +133,7 @@ int Animator::getPhase()
 
 int Animator::getPhaseAt(Timer& timer, int lastPhase)
 {
-    static int rand_val = 6;
+    thread_local int rand_val = 6;
     ticks_t time = timer.ticksElapsed();
     for (int i = lastPhase; i < m_animationPhases; ++i) {
         int phaseDuration = m_phaseDurations[i].second == 0 ? 
@@ -27,6 +27,8 @@
 
 #include <framework/core/declarations.h>
 #include <framework/core/timer.h>
+#include <atomic>
+#include <mutex>
 
 enum AnimationPhase : int16
 {
@@ -62,6 +64,9 @@ public:
 
     void resetAnimation();
 
+    // set while map floors are drawn in parallel, only then getPhase locks
+    static void setParallelAccess(bool value) { s_parallelAccess = value; }
+
 private:
     int getPingPongPhase();
     int getLoopPhase();
@@ -82,6 +87,9 @@ private:
     bool m_isComplete;
 
     int m_phase;
+
+    std::mutex m_mutex; // getPhase can be called by many threads while map floors are drawn in parallel
+    static std::atomic_bool s_parallelAccess;
 };
 
 #endif
@@ -189,6 +189,7 @@ public:
     std::list<UIWidgetPtr> getBottomWidgets();
     std::list<UIWidgetPtr> getDirectionalWdigets();
     void clearWidgets();
+    bool hasWidgets() { return !m_topWidgets.empty() || !m_bottomWidgets.empty() || !m_directionalWidgets.empty(); }
     void clearTopWidgets();
     void clearBottomWidgets();
     void clearDirectionalWidgets();
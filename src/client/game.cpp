@@ -580,7 +580,7 @@ void Game::loginWorld(const std::string& account, const std::string& password, c
     m_worldName = worldName;
 }
 
-void Game::playRecord(const std::string& file)
+void Game::playRecord(const std::string& file, const std::string& recordTo)
 {
     if (m_protocolGame || isOnline())
         stdext::throw_exception("Unable to login into a world while already online or logging.");
@@ -599,11 +599,86 @@ void Game::playRecord(const std::string& file)
     m_localPlayer->setName("Player");
 
     m_protocolGame = ProtocolGamePtr(new ProtocolGame);
+    if (!recordTo.empty())
+        m_protocolGame->setRecorder(PacketRecorderPtr(new PacketRecorder(recordTo)));
     m_protocolGame->playRecord(packetPlayer);
     m_characterName = "Player";
     m_worldName = "Record";
 }
 
+bool Game::seekRecord(ticks_t time)
+{
+    PacketPlayerPtr packetPlayer = m_protocolGame ? m_protocolGame->getPacketPlayer() : nullptr;
+    return packetPlayer && packetPlayer->seek(time);
+}
+
+ticks_t Game::getRecordTime()
+{
+    PacketPlayerPtr packetPlayer = m_protocolGame ? m_protocolGame->getPacketPlayer() : nullptr;
+    return packetPlayer ? packetPlayer->getPacketTime() : 0;
+}
+
+ticks_t Game::getRecordDuration()
+{
+    PacketPlayerPtr packetPlayer = m_protocolGame ? m_protocolGame->getPacketPlayer() : nullptr;
+    return packetPlayer ? packetPlayer->getDuration() : 0;
+}
+
+bool Game::isBinaryRecord()
+{
+    PacketPlayerPtr packetPlayer = m_protocolGame ? m_protocolGame->getPacketPlayer() : nullptr;
+    return packetPlayer && packetPlayer->isBinary();
+}
+
+std::map<std::string, int64_t> Game::benchmarkRecord(const std::string& file, const std::string& recordTo)
+{
+    playRecord(file, recordTo);
+    PacketPlayerPtr packetPlayer = m_protocolGame->getPacketPlayer();
+    packetPlayer->stop(); // packets are passed here instead of in scheduled playback
+
+    g_stats.clear(STATS_PACKETS);
+    int createdThings = g_stats.getCreatedThings(), destroyedThings = g_stats.getDestroyedThings();
+    int createdCreatures = g_stats.getCreatedCreatures(), destroyedCreatures = g_stats.getDestroyedCreatures();
+
+    int64_t packets = 0, bytes = 0;
+    ticks_t time = 0;
+    ticks_t start = g_clock.millis();
+    ticks_t clockAdvance = 0;
+    std::shared_ptr<std::vector<uint8_t>> packet;
+    g_stats.startAllocationCounting();
+    stdext::timer timer;
+    while (m_protocolGame && packetPlayer->nextPacket(time, packet)) {
+        // virtual clock, game sees the same time between packets as during recording
+        ticks_t delay = start + time - g_clock.millis();
+        if (delay > 0) {
+            clockAdvance += delay;
+            g_clock.advance(delay * 1000);
+        }
+        m_protocolGame->replayPacket(packet);
+        packets += 1;
+        bytes += packet->size();
+    }
+    ticks_t elapsed = std::max<ticks_t>(1, timer.elapsed_micros());
+    uint64_t allocations, allocatedBytes;
+    bool allocationsCounted = g_stats.stopAllocationCounting(allocations, allocatedBytes);
+
+    std::map<std::string, int64_t> result;
+    result["packets"] = packets;
+    result["bytes"] = bytes;
+    result["realTime"] = elapsed; // us
+    result["recordTime"] = time; // ms
+    result["packetsPerSecond"] = packets * 1000000 / elapsed;
+    result["speedup"] = time * 1000 / elapsed;
+    result["allocations"] = allocationsCounted ? (int64_t)allocations : -1; // -1 without ALLOCATION_COUNTER
+    result["allocatedBytes"] = allocationsCounted ? (int64_t)allocatedBytes : -1;
+    result["clockAdvance"] = clockAdvance; // ms, g_clock stays ahead of real time by it
+    result["createdThings"] = g_stats.getCreatedThings() - createdThings;
+    result["destroyedThings"] = g_stats.getDestroyedThings() - destroyedThings;
+    result["createdCreatures"] = g_stats.getCreatedCreatures() - createdCreatures;
+    result["destroyedCreatures"] = g_stats.getDestroyedCreatures() - destroyedCreatures;
+    return result;
+}
+
 void Game::cancelLogin()
 {
     // send logout even if the game has not started yet, to make sure that the player doesn't stay logged there
@@ -170,7 +170,19 @@ protected:
 public:
     // login related
     void loginWorld(const std::string& account, const std::string& password, const std::string& worldName, const std::string& worldHost, int worldPort, const std::string& characterName, const std::string& authenticatorToken, const std::string& sessionKey, const std::string& recordTo = "");
-    void playRecord(const std::string& file);
+    // received packets can be recorded again to recordTo, it converts old text records to binary ones
+    void playRecord(const std::string& file, const std::string& recordTo = "");
+    // plays whole record at once with virtual clock and returns parsing speed and allocations of main thread,
+    // time of every opcode is in STATS_PACKETS, game stays online,
+    // g_clock isn't moved back after it, so it stays ahead of real time by returned clockAdvance
+    std::map<std::string, int64_t> benchmarkRecord(const std::string& file, const std::string& recordTo = "");
+    // forward only, time in ms since record start, all packets before it are parsed at once
+    bool seekRecord(ticks_t time);
+    // record time of last parsed packet
+    ticks_t getRecordTime();
+    // binary records only
+    ticks_t getRecordDuration();
+    bool isBinaryRecord();
     void cancelLogin();
     void forceLogout();
     void safeLogout();
@@ -440,6 +452,11 @@ public:
         return m_protocolGame ? m_protocolGame->getRecivedPacketsSize() : 0;
     }
 
+    double getPacketsPerRead()
+    {
+        return m_protocolGame ? m_protocolGame->getPacketsPerRead() : 0;
+    }
+
 protected:
     void enableBotCall() { m_denyBotCall = false; }
     void disableBotCall() { m_denyBotCall = true; }
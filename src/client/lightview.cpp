@@ -23,9 +23,23 @@
 #include "lightview.h"
 #include "spritemanager.h"
 #include <framework/graphics/painter.h>
+#include <framework/graphics/framebuffermanager.h>
+#include <framework/graphics/graphics.h>
+#include <framework/core/asyncdispatcher.h>
+#include <random>
+#include <sstream>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LIGHTVIEW_SIMD
+#include <emmintrin.h>
+#endif
 
 void LightView::addLight(const Point& pos, uint8_t color, uint8_t intensity)
 {
+    if (m_recording) {
+        m_recorded.push_back(RecordedLight{ pos, 0, color, intensity, false });
+        return;
+    }
     if (!m_lights.empty()) {
         Light& prevLight = m_lights.back();
         if (prevLight.pos == pos && prevLight.color == color) {
@@ -38,19 +52,275 @@ void LightView::addLight(const Point& pos, uint8_t color, uint8_t intensity)
 
 void LightView::setFieldBrightness(const Point& pos, size_t start, uint8_t color)
 {
+    if (m_recording) {
+        m_recorded.push_back(RecordedLight{ pos, start, color, 0, true });
+        return;
+    }
     size_t index = (pos.y / g_sprites.spriteSize()) * m_mapSize.width() + (pos.x / g_sprites.spriteSize());
     if (index >= m_tiles.size()) return;
     m_tiles[index].start = start;
     m_tiles[index].color = color;
 }
 
+void LightView::replay(LightView* lightView)
+{
+    // recorded field brightness can only start at beginning of recording (floor), so it's relative to it
+    size_t start = lightView->size();
+    for (auto& light : m_recorded) {
+        if (light.field)
+            lightView->setFieldBrightness(light.pos, start + light.start, light.color);
+        else
+            lightView->addLight(light.pos, light.color, light.intensity);
+    }
+    m_recorded.clear();
+}
+
+namespace {
+    std::atomic<uint64_t> cpuDraws(0), cpuTime(0), gpuDraws(0), gpuTime(0);
+}
+
 void LightView::draw() // render thread
 {
-    // TODO: optimize in the future for big areas
-    static std::vector<uint8_t> buffer;
-    if (buffer.size() < 4u * m_mapSize.area())
-        buffer.resize(m_mapSize.area() * 4);
+    stdext::timer timer;
+    bool gpu = m_gpu && g_graphics.canUseFBO() && g_graphics.canUseBlendMax();
+    TexturePtr lightMap;
+    if (gpu) {
+        lightMap = drawLightMap();
+    } else {
+        static std::vector<uint8_t> buffer;
+        if (buffer.size() < 4u * m_mapSize.area())
+            buffer.resize(m_mapSize.area() * 4);
+
+        computeLightMap(buffer.data());
+
+        m_lightTexture->update();
+        glBindTexture(GL_TEXTURE_2D, m_lightTexture->getId());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_mapSize.width(), m_mapSize.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
+        lightMap = m_lightTexture;
+    }
+
+    Point offset = m_src.topLeft();
+    Size size = m_src.size();
+    CoordsBuffer coords;
+    coords.addRect(RectF(m_dest.left(), m_dest.top(), m_dest.width(), m_dest.height()),
+                   RectF((float)offset.x / g_sprites.spriteSize(), (float)offset.y / g_sprites.spriteSize(),
+                         (float)size.width() / g_sprites.spriteSize(), (float)size.height() / g_sprites.spriteSize()));
+
+    g_painter->resetColor();
+    g_painter->setCompositionMode(Painter::CompositionMode_Multiply);
+    g_painter->drawTextureCoords(coords, lightMap);
+    g_painter->resetCompositionMode();
+
+    (gpu ? gpuDraws : cpuDraws) += 1;
+    (gpu ? gpuTime : cpuTime) += timer.elapsed_micros();
+}
+
+TexturePtr LightView::drawLightMap() // render thread
+{
+    const FrameBufferPtr& framebuffer = g_framebuffers.getLightFrameBuffer();
+    framebuffer->resize(m_mapSize);
+
+    // tiles covered by higher floor ignore lights added before their start,
+    // they're reset to global light when drawing gets to their start
+    std::vector<std::pair<size_t, int>> resets;
+    for (size_t i = 0; i < m_tiles.size(); ++i) {
+        if (m_tiles[i].start > 0)
+            resets.emplace_back(m_tiles[i].start, (int)i);
+    }
+    std::sort(resets.begin(), resets.end());
+
+    const float spriteSize = g_sprites.spriteSize();
+    framebuffer->bind();
+    g_painter->clear(Color(m_globalLight.rF(), m_globalLight.gF(), m_globalLight.bF(), 1.0f));
+
+    CoordsBuffer coords;
+    std::vector<size_t> segment; // lights drawn between two resets
+    std::vector<std::pair<int, Color>> colors; // end of lights with given color, one draw call for each of them
+    size_t light = 0, reset = 0;
+    while (light < m_lights.size() || reset < resets.size()) {
+        size_t end = reset < resets.size() ? std::min<size_t>(resets[reset].first, m_lights.size()) : m_lights.size();
+        segment.clear();
+        for (; light < end; ++light) {
+            if (m_lights[light].intensity != 0)
+                segment.push_back(light);
+        }
+        // max blending doesn't depend on order, so lights with same color and intensity can share draw call
+        std::sort(segment.begin(), segment.end(), [&](size_t a, size_t b) {
+            return std::make_pair(m_lights[a].color, m_lights[a].intensity) < std::make_pair(m_lights[b].color, m_lights[b].intensity);
+        });
+
+        coords.clear();
+        colors.clear();
+        for (size_t i = 0; i < segment.size(); ++i) {
+            const Light& lightSource = m_lights[segment[i]];
+            float radius = lightSource.intensity;
+            PointF center(lightSource.pos.x / spriteSize, lightSource.pos.y / spriteSize);
+            coords.addRect(RectF(center.x - radius, center.y - radius, 2 * radius, 2 * radius), RectF(-radius, -radius, 2 * radius, 2 * radius));
+            const Light* previous = i > 0 ? &m_lights[segment[i - 1]] : nullptr;
+            if (previous && previous->color == lightSource.color && previous->intensity == lightSource.intensity) {
+                colors.back().first = (int)i + 1;
+                continue;
+            }
+            Color color = Color::from8bit(lightSource.color);
+            colors.emplace_back((int)i + 1, Color(color.rF(), color.gF(), color.bF(), lightSource.intensity / 255.0f));
+        }
+
+        if (!colors.empty()) {
+            // brightest light wins like in cpu light map, light texture isn't sampled, it only enables texture coords
+            g_painter->setBlendEquation(Painter::BlendEquation_Max);
+            g_painter->setDrawLightProgram();
+            // texture coords are offsets from light center in tiles and must reach shader unchanged,
+            // setTexture would replace texture matrix with the texture's normalizing one, so texture is set
+            // first and matrix reset after it, then drawTextureCoords sees the same texture and keeps the matrix
+            g_painter->setTexture(m_lightTexture);
+            g_painter->setTextureMatrix(Matrix3());
+            g_painter->drawTextureCoords(coords, m_lightTexture, &colors);
+        }
+
+        if (reset < resets.size() && (resets[reset].first <= light || light == m_lights.size())) {
+            coords.clear();
+            for (; reset < resets.size() && (resets[reset].first <= light || light == m_lights.size()); ++reset) {
+                int index = resets[reset].second;
+                coords.addRect(Rect(index % m_mapSize.width(), index / m_mapSize.width(), 1, 1));
+            }
+            g_painter->resetShaderProgram();
+            g_painter->resetBlendEquation();
+            g_painter->setCompositionMode(Painter::CompositionMode_Replace);
+            g_painter->setColor(Color(m_globalLight.rF(), m_globalLight.gF(), m_globalLight.bF(), 1.0f));
+            g_painter->drawFillCoords(coords);
+            g_painter->resetCompositionMode();
+        }
+    }
+
+    framebuffer->release();
+    return framebuffer->getTexture();
+}
+
+void LightView::computeLightMap(uint8_t* buffer)
+{
+    int rows = m_mapSize.height();
+    int threads = m_threaded ? std::min<int>(g_asyncDispatcher.getThreadsCount(), rows / MIN_THREADED_ROWS - 1) : 0;
+    if (threads <= 0) {
+        computeLightRows(buffer, 0, rows);
+        return;
+    }
+
+    // rows don't overlap, so threads write to different parts of buffer
+    int bandRows = (rows + threads) / (threads + 1);
+    std::vector<std::shared_future<bool>> bands;
+    for (int firstRow = bandRows; firstRow < rows; firstRow += bandRows) {
+        int lastRow = std::min<int>(rows, firstRow + bandRows);
+        bands.push_back(g_asyncDispatcher.schedule([this, buffer, firstRow, lastRow] {
+            computeLightRows(buffer, firstRow, lastRow);
+            return true;
+        }));
+    }
+    computeLightRows(buffer, 0, bandRows);
+    for (auto& band : bands)
+        band.wait();
+}
+
+void LightView::computeLightRows(uint8_t* buffer, int firstRow, int lastRow)
+{
+    const int width = m_mapSize.width();
+    const int spriteSize = g_sprites.spriteSize();
+
+    for (int i = firstRow * width * 4, end = lastRow * width * 4; i < end; i += 4) {
+        buffer[i] = m_globalLight.r();
+        buffer[i + 1] = m_globalLight.g();
+        buffer[i + 2] = m_globalLight.b();
+        buffer[i + 3] = 255; // alpha channel
+    }
 
+    // every light changes only tiles closer than its intensity, result is max of lights so their order doesn't matter
+    for (size_t i = 0; i < m_lights.size(); ++i) {
+        const Light& light = m_lights[i];
+        if (light.intensity == 0)
+            continue;
+        double centerX = (light.pos.x - spriteSize / 2) / (double)spriteSize;
+        double centerY = (light.pos.y - spriteSize / 2) / (double)spriteSize;
+        int left = std::max<int>(0, (int)std::floor(centerX - light.intensity));
+        int right = std::min<int>(width - 1, (int)std::ceil(centerX + light.intensity));
+        int top = std::max<int>(firstRow, (int)std::floor(centerY - light.intensity));
+        int bottom = std::min<int>(lastRow - 1, (int)std::ceil(centerY + light.intensity));
+        if (left > right || top > bottom)
+            continue;
+
+        Color color = Color::from8bit(light.color);
+        for (int y = top; y <= bottom; ++y)
+            computeLightRow(buffer, i, color, y, left, right);
+    }
+}
+
+void LightView::computeLightRow(uint8_t* buffer, size_t lightIndex, const Color& color, int y, int left, int right)
+{
+    // must give exactly the same values as computeLightMapReference
+    const Light& light = m_lights[lightIndex];
+    const int spriteSize = g_sprites.spriteSize();
+    const int width = m_mapSize.width();
+    const int dy = y * spriteSize + spriteSize / 2 - light.pos.y;
+    int x = left;
+
+#ifdef LIGHTVIEW_SIMD
+    // 4 tiles at once, distance is computed in double like std::sqrt of int in reference
+    const __m128d dy2 = _mm_set1_pd((double)(dy * dy));
+    const __m128 size = _mm_set1_ps((float)spriteSize);
+    const __m128 lightIntensity = _mm_set1_ps((float)light.intensity);
+    const __m128 minIntensity = _mm_set1_ps(0.01f);
+    const __m128 scale = _mm_set1_ps(0.2f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 max = _mm_set1_ps(255.0f);
+    const __m128 red = _mm_set1_ps(color.rF());
+    const __m128 green = _mm_set1_ps(color.gF());
+    const __m128 blue = _mm_set1_ps(color.bF());
+    alignas(16) int32_t r[4], g[4], b[4];
+    for (; x + 3 <= right; x += 4) {
+        int dx = x * spriteSize + spriteSize / 2 - light.pos.x;
+        __m128d dxLow = _mm_set_pd((double)(dx + spriteSize), (double)dx);
+        __m128d dxHigh = _mm_set_pd((double)(dx + 3 * spriteSize), (double)(dx + 2 * spriteSize));
+        __m128 distanceLow = _mm_cvtpd_ps(_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dxLow, dxLow), dy2)));
+        __m128 distanceHigh = _mm_cvtpd_ps(_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dxHigh, dxHigh), dy2)));
+        __m128 distance = _mm_div_ps(_mm_movelh_ps(distanceLow, distanceHigh), size);
+        __m128 intensity = _mm_mul_ps(_mm_sub_ps(lightIntensity, distance), scale);
+        int lit = _mm_movemask_ps(_mm_cmpge_ps(intensity, minIntensity));
+        if (lit == 0)
+            continue;
+        intensity = _mm_min_ps(intensity, one);
+        _mm_store_si128((__m128i*)r, _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(red, intensity), max)));
+        _mm_store_si128((__m128i*)g, _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(green, intensity), max)));
+        _mm_store_si128((__m128i*)b, _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(blue, intensity), max)));
+        for (int lane = 0; lane < 4; ++lane) {
+            int index = y * width + x + lane;
+            if (!(lit & (1 << lane)) || m_tiles[index].start > lightIndex)
+                continue;
+            uint8_t* pixel = buffer + index * 4;
+            pixel[0] = std::max<int>(pixel[0], r[lane]);
+            pixel[1] = std::max<int>(pixel[1], g[lane]);
+            pixel[2] = std::max<int>(pixel[2], b[lane]);
+        }
+    }
+#endif
+
+    for (; x <= right; ++x) {
+        int index = y * width + x;
+        if (m_tiles[index].start > lightIndex)
+            continue;
+        int dx = x * spriteSize + spriteSize / 2 - light.pos.x;
+        float distance = std::sqrt(dx * dx + dy * dy);
+        distance /= spriteSize;
+        float intensity = (-distance + light.intensity) * 0.2f;
+        if (intensity < 0.01f) continue;
+        if (intensity > 1.0f) intensity = 1.0f;
+        Color lightColor = color * intensity;
+        uint8_t* pixel = buffer + index * 4;
+        pixel[0] = std::max<int>(pixel[0], lightColor.r());
+        pixel[1] = std::max<int>(pixel[1], lightColor.g());
+        pixel[2] = std::max<int>(pixel[2], lightColor.b());
+    }
+}
+
+void LightView::computeLightMapReference(uint8_t* buffer)
+{
     for (int x = 0; x < m_mapSize.width(); ++x) {
         for (int y = 0; y < m_mapSize.height(); ++y) {
             Point pos(x * g_sprites.spriteSize() + g_sprites.spriteSize() / 2, y * g_sprites.spriteSize() + g_sprites.spriteSize() / 2);
@@ -75,20 +345,67 @@ void LightView::draw() // render thread
             }
         }
     }
+}
 
-    m_lightTexture->update();
-    glBindTexture(GL_TEXTURE_2D, m_lightTexture->getId());
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_mapSize.width(), m_mapSize.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
+std::string LightView::benchmark(const Size& mapSize, int lights, int iterations)
+{
+    if (mapSize.area() <= 0 || iterations <= 0)
+        return "invalid arguments";
 
-    Point offset = m_src.topLeft();
-    Size size = m_src.size();
-    CoordsBuffer coords;
-    coords.addRect(RectF(m_dest.left(), m_dest.top(), m_dest.width(), m_dest.height()),
-                   RectF((float)offset.x / g_sprites.spriteSize(), (float)offset.y / g_sprites.spriteSize(),
-                         (float)size.width() / g_sprites.spriteSize(), (float)size.height() / g_sprites.spriteSize()));
+    TexturePtr texture;
+    LightView lightView(texture, mapSize, Rect(), Rect(), 215, 40);
+    int spriteSize = g_sprites.spriteSize();
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> x(-spriteSize, mapSize.width() * spriteSize + spriteSize);
+    std::uniform_int_distribution<int> y(-spriteSize, mapSize.height() * spriteSize + spriteSize);
+    std::uniform_int_distribution<int> tileX(0, mapSize.width() - 1);
+    std::uniform_int_distribution<int> tileY(0, mapSize.height() - 1);
+    std::uniform_int_distribution<int> color(0, 215);
+    std::uniform_int_distribution<int> intensity(1, 10);
+    for (int i = 0; i < lights; ++i) {
+        // like floors drawn by MapView, tiles covered by upper floor ignore lights of floors below
+        if (i > 0 && i % std::max<int>(1, lights / 4) == 0) {
+            for (int j = 0; j < mapSize.area() / 8; ++j)
+                lightView.setFieldBrightness(Point(tileX(gen) * spriteSize, tileY(gen) * spriteSize), lightView.size(), 0);
+        }
+        lightView.addLight(Point(x(gen), y(gen)), color(gen), intensity(gen));
+    }
 
-    g_painter->resetColor();
-    g_painter->setCompositionMode(Painter::CompositionMode_Multiply);
-    g_painter->drawTextureCoords(coords, m_lightTexture);
-    g_painter->resetCompositionMode();
+    std::vector<uint8_t> reference(mapSize.area() * 4), bounded(mapSize.area() * 4), threaded(mapSize.area() * 4);
+    ticks_t time[3] = { 0, 0, 0 };
+    for (int i = 0; i < iterations; ++i) {
+        stdext::timer timer;
+        lightView.computeLightMapReference(reference.data());
+        time[0] += timer.elapsed_micros();
+
+        timer.restart();
+        lightView.m_threaded = false;
+        lightView.computeLightMap(bounded.data());
+        time[1] += timer.elapsed_micros();
+
+        timer.restart();
+        lightView.m_threaded = true;
+        lightView.computeLightMap(threaded.data());
+        time[2] += timer.elapsed_micros();
+    }
+
+    bool identical = reference == bounded && reference == threaded;
+    std::stringstream ss;
+    ss << mapSize.width() << "x" << mapSize.height() << ", " << lightView.size() << " lights: reference " << time[0] / iterations
+       << " us, bounded " << time[1] / iterations << " us, threaded " << time[2] / iterations << " us, "
+       << (identical ? "identical" : "different") << " output";
+    return ss.str();
+}
+
+int LightView::getLightMapCount(bool gpu)
+{
+    return (int)(gpu ? gpuDraws : cpuDraws);
+}
+
+std::string LightView::getStats()
+{
+    std::stringstream ss;
+    ss << "cpu: " << cpuDraws << " light maps, " << cpuTime / std::max<uint64_t>(1, cpuDraws) << " us avg"
+       << ", gpu: " << gpuDraws << " light maps, " << gpuTime / std::max<uint64_t>(1, gpuDraws) << " us avg";
+    return ss.str();
 }
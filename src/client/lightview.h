@@ -42,6 +42,8 @@ public:
         m_globalLight = Color::from8bit(color) * ((float)intensity / 255.f);
         m_tiles.resize(m_mapSize.area(), TileLight{ 0, 0 });
     }
+    // only records lights and field brightness, they're added to real light view by replay
+    LightView() : DrawQueueItem(nullptr), m_recording(true) {}
 
     inline void addLight(const Point& pos, const Light& light)
     {
@@ -49,17 +51,52 @@ public:
     }
     void addLight(const Point& pos, uint8_t color, uint8_t intensity);
     void setFieldBrightness(const Point& pos, size_t start, uint8_t color);
-    size_t size() { return m_lights.size(); }
+    size_t size() { return m_recording ? m_recorded.size() : m_lights.size(); }
+    void replay(LightView* lightView);
+    // light map rows are split between render thread and async dispatcher threads
+    void setThreaded(bool threaded) { m_threaded = threaded; }
+    // lights are drawn to framebuffer by shader, cpu is used when framebuffers or max blending can't be used
+    void setGpu(bool gpu) { m_gpu = gpu; }
 
     void draw() override;
 
+    // compares light map with reference implementation on random lights, returns time of both
+    static std::string benchmark(const Size& mapSize, int lights, int iterations);
+    // draws and time spent by render thread in cpu and gpu light maps
+    static std::string getStats();
+    static int getLightMapCount(bool gpu);
+
 private:
+    enum {
+        MIN_THREADED_ROWS = 16 // rows computed by single thread
+    };
+
+    TexturePtr drawLightMap();
+    // writes RGBA light map to buffer, rows are split between threads when threaded
+    void computeLightMap(uint8_t* buffer);
+    void computeLightRows(uint8_t* buffer, int firstRow, int lastRow);
+    void computeLightRow(uint8_t* buffer, size_t light, const Color& color, int y, int left, int right);
+    // every light for every tile, result must be the same as computeLightMap
+    void computeLightMapReference(uint8_t* buffer);
+
+    struct RecordedLight {
+        Point pos;
+        size_t start;
+        uint8_t color;
+        uint8_t intensity;
+        bool field;
+    };
+
     TexturePtr m_lightTexture;
     Size m_mapSize;
     Rect m_dest, m_src;
     Color m_globalLight;
     std::vector<Light> m_lights;
     std::vector<TileLight> m_tiles;
+    std::vector<RecordedLight> m_recorded;
+    bool m_recording = false;
+    bool m_threaded = false;
+    bool m_gpu = false;
 };
 
 #endif
@@ -79,6 +79,8 @@ void Client::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_things", "findItemTypeByCategory", &ThingTypeManager::findItemTypeByCategory, &g_things);
     g_lua.bindSingletonFunction("g_things", "findThingTypeByAttr", &ThingTypeManager::findThingTypeByAttr, &g_things);
     g_lua.bindSingletonFunction("g_things", "getMarketCategories", &ThingTypeManager::getMarketCategories, &g_things);
+    g_lua.bindSingletonFunction("g_things", "setAsyncTextureLoading", &ThingTypeManager::setAsyncTextureLoading, &g_things);
+    g_lua.bindSingletonFunction("g_things", "isAsyncTextureLoading", &ThingTypeManager::isAsyncTextureLoading, &g_things);
     
     g_lua.registerSingletonClass("g_houses");
     g_lua.bindSingletonFunction("g_houses", "clear",          &HouseManager::clear,          &g_houses);
@@ -112,6 +114,10 @@ void Client::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_sprites", "isLoaded", &SpriteManager::isLoaded, &g_sprites);
     g_lua.bindSingletonFunction("g_sprites", "getSprSignature", &SpriteManager::getSignature, &g_sprites);
     g_lua.bindSingletonFunction("g_sprites", "getSpritesCount", &SpriteManager::getSpritesCount, &g_sprites);
+    g_lua.bindSingletonFunction("g_sprites", "setCacheBudget", &SpriteManager::setCacheBudget, &g_sprites);
+    g_lua.bindSingletonFunction("g_sprites", "getCacheBudget", &SpriteManager::getCacheBudget, &g_sprites);
+    g_lua.bindSingletonFunction("g_sprites", "getCacheStats", &SpriteManager::getCacheStats, &g_sprites);
+    g_lua.bindSingletonFunction("g_sprites", "benchmarkKernels", &SpriteManager::benchmarkKernels, &g_sprites);
 
     g_lua.registerSingletonClass("g_map");
     g_lua.bindSingletonFunction("g_map", "isLookPossible", &Map::isLookPossible, &g_map);
@@ -136,6 +142,7 @@ void Client::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_map", "getSpectators", &Map::getSpectators, &g_map);
     g_lua.bindSingletonFunction("g_map", "getSpectatorsInRange", &Map::getSpectatorsInRange, &g_map);
     g_lua.bindSingletonFunction("g_map", "getSpectatorsInRangeEx", &Map::getSpectatorsInRangeEx, &g_map);
+    g_lua.bindSingletonFunction("g_map", "getSpectatorsInRangeByDistance", &Map::getSpectatorsInRangeByDistance, &g_map);
     g_lua.bindSingletonFunction("g_map", "getSpectatorsByPattern", &Map::getSpectatorsByPattern, &g_map);
     g_lua.bindSingletonFunction("g_map", "findPath", &Map::findPath, &g_map);
     g_lua.bindSingletonFunction("g_map", "loadOtbm", &Map::loadOtbm, &g_map);
@@ -173,6 +180,9 @@ void Client::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_map", "isWalkable", &Map::isWalkable, &g_map);
     g_lua.bindSingletonFunction("g_map", "checkSightLine", &Map::checkSightLine, &g_map);
     g_lua.bindSingletonFunction("g_map", "isSightClear", &Map::isSightClear, &g_map);
+    g_lua.bindSingletonFunction("g_map", "benchmarkTileLookups", &Map::benchmarkTileLookups, &g_map);
+    g_lua.bindSingletonFunction("g_map", "benchmarkPathFinding", &Map::benchmarkPathFinding, &g_map);
+    g_lua.bindSingletonFunction("g_map", "benchmarkLightView", &Map::benchmarkLightView, &g_map);
 
     g_lua.registerSingletonClass("g_minimap");
     g_lua.bindSingletonFunction("g_minimap", "clean", &Minimap::clean, &g_minimap);
@@ -203,6 +213,11 @@ void Client::registerLuaFunctions()
     g_lua.registerSingletonClass("g_game");
     g_lua.bindSingletonFunction("g_game", "loginWorld", &Game::loginWorld, &g_game);
     g_lua.bindSingletonFunction("g_game", "playRecord", &Game::playRecord, &g_game);
+    g_lua.bindSingletonFunction("g_game", "benchmarkRecord", &Game::benchmarkRecord, &g_game);
+    g_lua.bindSingletonFunction("g_game", "seekRecord", &Game::seekRecord, &g_game);
+    g_lua.bindSingletonFunction("g_game", "getRecordTime", &Game::getRecordTime, &g_game);
+    g_lua.bindSingletonFunction("g_game", "getRecordDuration", &Game::getRecordDuration, &g_game);
+    g_lua.bindSingletonFunction("g_game", "isBinaryRecord", &Game::isBinaryRecord, &g_game);
     g_lua.bindSingletonFunction("g_game", "cancelLogin", &Game::cancelLogin, &g_game);
     g_lua.bindSingletonFunction("g_game", "forceLogout", &Game::forceLogout, &g_game);
     g_lua.bindSingletonFunction("g_game", "safeLogout", &Game::safeLogout, &g_game);
@@ -353,6 +368,7 @@ void Client::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_game", "isTileThingLuaCallbackEnabled", &Game::isTileThingLuaCallbackEnabled, &g_game);
     g_lua.bindSingletonFunction("g_game", "getRecivedPacketsCount", &Game::getRecivedPacketsCount, &g_game);
     g_lua.bindSingletonFunction("g_game", "getRecivedPacketsSize", &Game::getRecivedPacketsSize, &g_game);
+    g_lua.bindSingletonFunction("g_game", "getPacketsPerRead", &Game::getPacketsPerRead, &g_game);
 
     g_lua.registerSingletonClass("g_healthBars");
     g_lua.bindSingletonFunction("g_healthBars", "addHealthBackground", &HealthBars::addHealthBackground, &g_healthBars);
@@ -918,6 +934,18 @@ void Client::registerLuaFunctions()
     g_lua.bindClassMemberFunction<UIMap>("setMinimumAmbientLight", &UIMap::setMinimumAmbientLight);
     g_lua.bindClassMemberFunction<UIMap>("setLimitVisibleRange", &UIMap::setLimitVisibleRange);
     g_lua.bindClassMemberFunction<UIMap>("setFloorFading", &UIMap::setFloorFading);
+    g_lua.bindClassMemberFunction<UIMap>("setIncrementalTilesCache", &UIMap::setIncrementalTilesCache);
+    g_lua.bindClassMemberFunction<UIMap>("isIncrementalTilesCache", &UIMap::isIncrementalTilesCache);
+    g_lua.bindClassMemberFunction<UIMap>("setParallelFloors", &UIMap::setParallelFloors);
+    g_lua.bindClassMemberFunction<UIMap>("compareParallelFloors", &UIMap::compareParallelFloors);
+    g_lua.bindClassMemberFunction<UIMap>("isParallelFloors", &UIMap::isParallelFloors);
+    g_lua.bindClassMemberFunction<UIMap>("setThreadedLights", &UIMap::setThreadedLights);
+    g_lua.bindClassMemberFunction<UIMap>("isThreadedLights", &UIMap::isThreadedLights);
+    g_lua.bindClassMemberFunction<UIMap>("setGpuLights", &UIMap::setGpuLights);
+    g_lua.bindClassMemberFunction<UIMap>("isGpuLights", &UIMap::isGpuLights);
+    g_lua.bindClassMemberFunction<UIMap>("getLightStats", &UIMap::getLightStats);
+    g_lua.bindClassMemberFunction<UIMap>("getLightMapCount", &UIMap::getLightMapCount);
+    g_lua.bindClassMemberFunction<UIMap>("getTilesCacheStats", &UIMap::getTilesCacheStats);
     g_lua.bindClassMemberFunction<UIMap>("setCrosshair", &UIMap::setCrosshair);
     g_lua.bindClassMemberFunction<UIMap>("setShader", &UIMap::setShader);
     g_lua.bindClassMemberFunction<UIMap>("isMultifloor", &UIMap::isMultifloor);
@@ -29,14 +29,172 @@
 #include "statictext.h"
 #include "mapview.h"
 #include "minimap.h"
+#include "pathfinder.h"
+#include "lightview.h"
 
 #include <framework/core/asyncdispatcher.h>
 #include <framework/core/eventdispatcher.h>
 #include <framework/core/application.h>
 #include <framework/util/extras.h>
 #include <set>
+#include <queue>
+#include <sstream>
+#include <limits>
 
 Map g_map;
+
+TileBlock& TileBlockMap::get(uint index)
+{
+    if ((m_size + 1) * 2 > m_entries.size()) // load factor up to 0.5
+        rehash(std::max<size_t>(16, m_entries.size() * 2));
+
+    size_t i = slot(index);
+    for (; m_entries[i].second; i = (i + 1) & m_mask) {
+        if (m_entries[i].first == index)
+            return *m_entries[i].second;
+    }
+    m_entries[i].first = index;
+    m_entries[i].second.reset(new TileBlock);
+    m_size += 1;
+    return *m_entries[i].second;
+}
+
+void TileBlockMap::erase(uint index)
+{
+    if (m_size == 0)
+        return;
+
+    size_t i = slot(index);
+    for (; m_entries[i].first != index || !m_entries[i].second; i = (i + 1) & m_mask) {
+        if (!m_entries[i].second)
+            return;
+    }
+    m_entries[i].second.reset();
+    m_size -= 1;
+
+    // backward shift deletion, entries after removed one are moved back if their probe sequence allows it
+    for (size_t j = (i + 1) & m_mask; m_entries[j].second; j = (j + 1) & m_mask) {
+        size_t home = slot(m_entries[j].first);
+        bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (between)
+            continue;
+        m_entries[i] = std::move(m_entries[j]);
+        i = j;
+    }
+}
+
+void TileBlockMap::clear()
+{
+    m_entries.clear();
+    m_size = 0;
+    m_mask = 0;
+    m_shift = 32;
+}
+
+std::vector<const TileBlock*> TileBlockMap::getSortedBlocks() const
+{
+    std::vector<const Entry*> entries;
+    entries.reserve(m_size);
+    for (const Entry& entry : *this)
+        entries.push_back(&entry);
+    std::sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) { return a->first < b->first; });
+
+    std::vector<const TileBlock*> blocks;
+    blocks.reserve(entries.size());
+    for (const Entry* entry : entries)
+        blocks.push_back(entry->second.get());
+    return blocks;
+}
+
+void TileBlockMap::rehash(size_t capacity)
+{
+    std::vector<Entry> entries(capacity);
+    entries.swap(m_entries);
+    m_mask = capacity - 1;
+    m_shift = 32;
+    while ((size_t(1) << (32 - m_shift)) < capacity)
+        m_shift -= 1;
+
+    for (Entry& entry : entries) {
+        if (!entry.second)
+            continue;
+        size_t i = slot(entry.first);
+        while (m_entries[i].second)
+            i = (i + 1) & m_mask;
+        m_entries[i] = std::move(entry);
+    }
+}
+
+void CreatureIndex::add(const Position& pos)
+{
+    std::vector<Entry>& bucket = m_buckets[getBucketIndex(pos.x, pos.y)];
+    for (Entry& entry : bucket) {
+        if (entry.x == pos.x && entry.y == pos.y) {
+            entry.creatures += 1;
+            return;
+        }
+    }
+    bucket.push_back(Entry{ (uint16)pos.x, (uint16)pos.y, 1 });
+}
+
+void CreatureIndex::remove(const Position& pos)
+{
+    auto it = m_buckets.find(getBucketIndex(pos.x, pos.y));
+    if (it == m_buckets.end())
+        return;
+    std::vector<Entry>& bucket = it->second;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].x != pos.x || bucket[i].y != pos.y)
+            continue;
+        if (--bucket[i].creatures == 0) {
+            bucket[i] = bucket.back();
+            bucket.pop_back();
+            if (bucket.empty())
+                m_buckets.erase(it);
+        }
+        return;
+    }
+}
+
+void CreatureIndex::erase(const Position& pos)
+{
+    auto it = m_buckets.find(getBucketIndex(pos.x, pos.y));
+    if (it == m_buckets.end())
+        return;
+    std::vector<Entry>& bucket = it->second;
+    for (size_t i = 0; i < bucket.size(); ++i) {
+        if (bucket[i].x != pos.x || bucket[i].y != pos.y)
+            continue;
+        bucket[i] = bucket.back();
+        bucket.pop_back();
+        if (bucket.empty())
+            m_buckets.erase(it);
+        return;
+    }
+}
+
+void CreatureIndex::find(int left, int top, int right, int bottom, int z, std::vector<Position>& positions) const
+{
+    left = std::max<int>(left, 0);
+    top = std::max<int>(top, 0);
+    right = std::min<int>(right, 65535);
+    bottom = std::min<int>(bottom, 65535);
+    if (m_buckets.empty() || left > right || top > bottom)
+        return;
+
+    for (int y = top - top % BUCKET_SIZE; y <= bottom; y += BUCKET_SIZE) {
+        for (int x = left - left % BUCKET_SIZE; x <= right; x += BUCKET_SIZE) {
+            auto it = m_buckets.find(getBucketIndex(x, y));
+            if (it == m_buckets.end())
+                continue;
+            for (const Entry& entry : it->second) {
+                if (entry.x >= left && entry.x <= right && entry.y >= top && entry.y <= bottom)
+                    positions.push_back(Position(entry.x, entry.y, z));
+            }
+        }
+    }
+}
+
 TilePtr Map::m_nulltile = nullptr;
 
 void Map::init()
@@ -70,6 +228,8 @@ void Map::notificateTileUpdate(const Position& pos, bool updateMinimap)
     for(const MapViewPtr& mapView : m_mapViews)
         mapView->onTileUpdate(pos);
 
+    invalidatePathSnapshot(pos);
+
     if (!updateMinimap)
         return;
 
@@ -79,16 +239,25 @@ void Map::notificateTileUpdate(const Position& pos, bool updateMinimap)
 }
 
 void Map::requestVisibleTilesCacheUpdate() {
+    // used when prewalking changes camera position
     for (const MapViewPtr& mapView : m_mapViews)
-        mapView->requestVisibleTilesCacheUpdate();
+        mapView->requestVisibleTilesCachePatch();
 }
 
 void Map::clean()
 {
     cleanDynamicThings();
 
-    for(int i=0;i<=Otc::MAX_Z;++i)
+    for(int i=0;i<=Otc::MAX_Z;++i) {
         m_tileBlocks[i].clear();
+        m_creatureIndex[i].clear();
+        m_pathSnapshots[i] = nullptr;
+        m_pathDirtyChunks[i].clear();
+    }
+
+    // tiles were removed without notifications
+    for(const MapViewPtr& mapView : m_mapViews)
+        mapView->requestVisibleTilesCacheUpdate();
 
     m_waypoints.clear();
 
@@ -198,6 +367,7 @@ void Map::setTileSpeed(const Position& pos, uint16_t speed, uint8_t blocking) {
     const TilePtr& tile = getOrCreateTile(pos);
     if (tile)
         tile->setSpeed(speed, blocking);
+    invalidatePathSnapshot(pos);
 }
 
 ThingPtr Map::getThing(const Position& pos, int stackPos)
@@ -307,7 +477,7 @@ const TilePtr& Map::createTile(const Position& pos)
         m_tilesRect.setRight(pos.x);
     if(pos.y > m_tilesRect.bottom())
         m_tilesRect.setBottom(pos.y);
-    TileBlock& block = m_tileBlocks[pos.z][getBlockIndex(pos)];
+    TileBlock& block = m_tileBlocks[pos.z].get(getBlockIndex(pos));
     return block.create(pos);
 }
 
@@ -336,7 +506,7 @@ const TilePtr& Map::getOrCreateTile(const Position& pos)
         m_tilesRect.setRight(pos.x);
     if(pos.y > m_tilesRect.bottom())
         m_tilesRect.setBottom(pos.y);
-    TileBlock& block = m_tileBlocks[pos.z][getBlockIndex(pos)];
+    TileBlock& block = m_tileBlocks[pos.z].get(getBlockIndex(pos));
     return block.getOrCreate(pos);
 }
 
@@ -344,9 +514,8 @@ const TilePtr& Map::getTile(const Position& pos)
 {
     if(!pos.isMapPosition())
         return m_nulltile;
-    auto it = m_tileBlocks[pos.z].find(getBlockIndex(pos));
-    if(it != m_tileBlocks[pos.z].end())
-        return it->second.get(pos);
+    if(TileBlock* block = m_tileBlocks[pos.z].find(getBlockIndex(pos)))
+        return block->get(pos);
     return m_nulltile;
 }
 
@@ -360,7 +529,7 @@ const TileList Map::getTiles(int floor/* = -1*/)
         // Search all floors
         for(uint8_t z = 0; z <= Otc::MAX_Z; ++z) {
             for(const auto& pair : m_tileBlocks[z]) {
-                const TileBlock& block = pair.second;
+                const TileBlock& block = *pair.second;
                 for(const TilePtr& tile : block.getTiles()) {
                     if(tile != nullptr)
                         tiles.push_back(tile);
@@ -370,7 +539,7 @@ const TileList Map::getTiles(int floor/* = -1*/)
     }
     else {
         for(const auto& pair : m_tileBlocks[floor]) {
-            const TileBlock& block = pair.second;
+            const TileBlock& block = *pair.second;
             for(const TilePtr& tile : block.getTiles()) {
                 if(tile != nullptr)
                     tiles.push_back(tile);
@@ -384,13 +553,11 @@ void Map::cleanTile(const Position& pos)
 {
     if(!pos.isMapPosition())
         return;
-    auto it = m_tileBlocks[pos.z].find(getBlockIndex(pos));
-    if(it != m_tileBlocks[pos.z].end()) {
-        TileBlock& block = it->second;
-        if(const TilePtr& tile = block.get(pos)) {
+    if(TileBlock* block = m_tileBlocks[pos.z].find(getBlockIndex(pos))) {
+        if(const TilePtr& tile = block->get(pos)) {
             tile->clean();
             if(tile->canErase())
-                block.remove(pos);
+                block->remove(pos);
 
             notificateTileUpdate(pos, false);
         }
@@ -405,6 +572,7 @@ void Map::cleanTile(const Position& pos)
 
     if (!g_game.getFeature(Otc::GameMinimapLimitedToSingleFloor) || (m_centralPosition.z == pos.z)) {
         g_minimap.updateTile(pos, getTile(pos));
+        invalidatePathSnapshot(pos);
     }
 }
 
@@ -472,7 +640,7 @@ std::map<Position, ItemPtr> Map::findItemsById(uint16 clientId, uint32 max)
     uint32 count = 0;
     for(uint8_t z = 0; z <= Otc::MAX_Z; ++z) {
         for(const auto& pair : m_tileBlocks[z]) {
-            const TileBlock& block = pair.second;
+            const TileBlock& block = *pair.second;
             for(const TilePtr& tile : block.getTiles()) {
                 if(unlikely(!tile || tile->isEmpty()))
                     continue;
@@ -513,6 +681,171 @@ void Map::removeCreatureById(uint32 id)
         m_knownCreatures.erase(it);
 }
 
+std::bitset<Otc::MAX_Z + 1> Map::getCreatureWidgetFloors()
+{
+    std::bitset<Otc::MAX_Z + 1> floors;
+    for (auto& it : m_knownCreatures) {
+        const CreaturePtr& creature = it.second;
+        const Position& pos = creature->getPosition();
+        if (creature->hasWidgets() && pos.isValid())
+            floors.set(pos.z);
+    }
+    return floors;
+}
+
+std::string Map::benchmarkTileLookups(int iterations)
+{
+    // positions in the order ProtocolGame::setMapDescription visits them, offset by floor like in setFloorDescription
+    std::vector<Position> positions;
+    auto describe = [&](const Position& center, int x, int y, int width, int height) {
+        int startz = center.z > Otc::SEA_FLOOR ? center.z - Otc::AWARE_UNDEGROUND_FLOOR_RANGE : Otc::SEA_FLOOR;
+        int endz = center.z > Otc::SEA_FLOOR ? std::min<int>(center.z + Otc::AWARE_UNDEGROUND_FLOOR_RANGE, Otc::MAX_Z) : 0;
+        int zstep = center.z > Otc::SEA_FLOOR ? 1 : -1;
+        for(int nz = startz; nz != endz + zstep; nz += zstep) {
+            int offset = center.z - nz;
+            for(int nx = 0; nx < width; ++nx)
+                for(int ny = 0; ny < height; ++ny)
+                    positions.push_back(Position(x + nx + offset, y + ny + offset, nz));
+        }
+    };
+
+    // full map description, then map moves walking a square around central position like parseMapMove*
+    Position pos = m_centralPosition;
+    describe(pos, pos.x - m_awareRange.left, pos.y - m_awareRange.top, m_awareRange.horizontal(), m_awareRange.vertical());
+    const int steps = 8;
+    for(int direction = 0; direction < 4; ++direction) {
+        for(int i = 0; i < steps; ++i) {
+            if(direction == 0) {
+                pos.y--;
+                describe(pos, pos.x - m_awareRange.left, pos.y - m_awareRange.top, m_awareRange.horizontal(), 1);
+            } else if(direction == 1) {
+                pos.x++;
+                describe(pos, pos.x + m_awareRange.right, pos.y - m_awareRange.top, 1, m_awareRange.vertical());
+            } else if(direction == 2) {
+                pos.y++;
+                describe(pos, pos.x - m_awareRange.left, pos.y + m_awareRange.bottom, m_awareRange.horizontal(), 1);
+            } else {
+                pos.x--;
+                describe(pos, pos.x - m_awareRange.left, pos.y - m_awareRange.top, 1, m_awareRange.vertical());
+            }
+        }
+    }
+
+    // baseline, blocks in std::map like before TileBlockMap
+    std::map<uint, TileBlock*> baseline[Otc::MAX_Z + 1];
+    size_t blocks = 0;
+    for(int z = 0; z <= Otc::MAX_Z; ++z) {
+        for(const auto& it : m_tileBlocks[z])
+            baseline[z][it.first] = it.second.get();
+        blocks += m_tileBlocks[z].size();
+    }
+
+    uint64_t tiles[2] = { 0, 0 };
+    stdext::timer timer;
+    for(int i = 0; i < iterations; ++i) {
+        for(const Position& tilePos : positions) {
+            if(!tilePos.isMapPosition())
+                continue;
+            if(TileBlock* block = m_tileBlocks[tilePos.z].find(getBlockIndex(tilePos)))
+                if(block->get(tilePos))
+                    tiles[0] += 1;
+        }
+    }
+    ticks_t hashTime = std::max<ticks_t>(1, timer.elapsed_micros());
+
+    timer.restart();
+    for(int i = 0; i < iterations; ++i) {
+        for(const Position& tilePos : positions) {
+            if(!tilePos.isMapPosition())
+                continue;
+            auto it = baseline[tilePos.z].find(getBlockIndex(tilePos));
+            if(it != baseline[tilePos.z].end())
+                if(it->second->get(tilePos))
+                    tiles[1] += 1;
+        }
+    }
+    ticks_t mapTime = std::max<ticks_t>(1, timer.elapsed_micros());
+
+    uint64_t lookups = (uint64_t)positions.size() * iterations;
+    return stdext::format("Tile lookups: %d (%d blocks), TileBlockMap: %d tiles in %d us, %d lookups/s, std::map: %d tiles in %d us, %d lookups/s, speedup %.2fx%s",
+                          (int)lookups, (int)blocks, (int)tiles[0], (int)hashTime, (int)(lookups * 1000000 / hashTime),
+                          (int)tiles[1], (int)mapTime, (int)(lookups * 1000000 / mapTime), (double)mapTime / hashTime,
+                          tiles[0] != tiles[1] ? ", INVALID" : "");
+}
+
+std::string Map::benchmarkPathFinding(const Position& start, int iterations)
+{
+    // goals on square around start, most of them in aware range so both visible tiles and minimap are used
+    std::vector<Position> goals;
+    for(int d = -m_awareRange.left; d <= m_awareRange.right; d += 2) {
+        goals.push_back(start.translated(d, -m_awareRange.top));
+        goals.push_back(start.translated(d, m_awareRange.bottom));
+        goals.push_back(start.translated(-m_awareRange.left, d));
+        goals.push_back(start.translated(m_awareRange.right, d));
+    }
+
+    // full rebuild of snapshot, it's normally rebuilt only partially after map changes
+    stdext::timer snapshotTimer;
+    if(start.z >= 0 && start.z <= Otc::MAX_Z)
+        m_pathSnapshots[start.z] = nullptr;
+    PathSnapshotPtr snapshot = getPathSnapshot(start.z);
+    ticks_t snapshotTime = snapshotTimer.elapsed_micros();
+
+    PathFinder& finder = PathFinder::getInstance();
+    uint64_t nodes[3] = { 0, 0, 0 };
+    ticks_t time[3] = { 0, 0, 0 };
+    int found[3] = { 0, 0, 0 };
+    ticks_t referenceTime = 0;
+    int referenceFound = 0;
+    int differentLength = 0;
+    std::map<std::string, std::string> params;
+    for(int i = 0; i < iterations; ++i) {
+        for(const Position& goal : goals) {
+            stdext::timer timer;
+            auto reference = findPathReference(start, goal, 10000, 0);
+            if(std::get<1>(reference) == Otc::PathFindResultOk)
+                referenceFound += 1;
+            referenceTime += timer.elapsed_micros();
+
+            timer.restart();
+            auto path = findPath(start, goal, 10000, 0);
+            if(std::get<1>(path) == Otc::PathFindResultOk)
+                found[0] += 1;
+            time[0] += timer.elapsed_micros();
+            nodes[0] += finder.getNodesCount();
+            if(std::get<1>(path) != std::get<1>(reference) || std::get<0>(path).size() != std::get<0>(reference).size())
+                differentLength += 1;
+
+            timer.restart();
+            if(newFindPath(start, goal, snapshot)->status == Otc::PathFindResultOk)
+                found[1] += 1;
+            time[1] += timer.elapsed_micros();
+            nodes[1] += finder.getNodesCount();
+        }
+        stdext::timer timer;
+        found[2] += (int)findEveryPath(start, 50, params).size();
+        time[2] += timer.elapsed_micros();
+        nodes[2] += finder.getNodesCount();
+    }
+
+    const char* names[3] = { "findPath", "newFindPath", "findEveryPath" };
+    std::stringstream ss;
+    ss << "pathSnapshot: " << (snapshot ? snapshot->getChunksCount() : 0) << " chunks in " << snapshotTime << " us\n";
+    ss << "findPathReference: " << referenceTime / 1000 << " ms, " << referenceFound << " paths, findPath speedup "
+       << stdext::format("%.2f", (double)referenceTime / std::max<ticks_t>(1, time[0])) << "x, "
+       << differentLength << " results with different status or length\n";
+    for(int i = 0; i < 3; ++i) {
+        ss << names[i] << ": " << nodes[i] << " nodes in " << time[i] / 1000 << " ms, "
+           << (nodes[i] * 1000000 / std::max<ticks_t>(1, time[i])) << " nodes/s, " << found[i] << (i < 2 ? " paths" : " positions") << "\n";
+    }
+    return ss.str();
+}
+
+std::string Map::benchmarkLightView(int width, int height, int lights, int iterations)
+{
+    return LightView::benchmark(Size(width, height), lights, iterations);
+}
+
 void Map::removeUnawareThings()
 {
     // remove creatures from tiles that we are not aware of anymore
@@ -536,8 +869,9 @@ void Map::removeUnawareThings()
         // remove tiles that we are not aware anymore
         for(int z = 0; z <= Otc::MAX_Z; ++z) {
             auto& tileBlocks = m_tileBlocks[z];
-            for(auto it = tileBlocks.begin(); it != tileBlocks.end();) {
-                TileBlock& block = (*it).second;
+            std::vector<uint> emptyBlocks;
+            for(const auto& pair : tileBlocks) {
+                TileBlock& block = *pair.second;
                 bool blockEmpty = true;
                 for(const TilePtr& tile : block.getTiles()) {
                     if(!tile)
@@ -545,17 +879,19 @@ void Map::removeUnawareThings()
 
                     const Position& pos = tile->getPosition();
 
-                    if(!isAwareOfPositionForClean(pos, extended))
+                    if(!isAwareOfPositionForClean(pos, extended)) {
+                        invalidatePathSnapshot(pos);
+                        m_creatureIndex[z].erase(pos);
                         block.remove(pos);
-                    else
+                    } else
                         blockEmpty = false;
                 }
 
                 if(blockEmpty)
-                    it = tileBlocks.erase(it);
-                else
-                    ++it;
+                    emptyBlocks.push_back(pair.first);
             }
+            for(uint index : emptyBlocks)
+                tileBlocks.erase(index);
         }
     }
 }
@@ -611,33 +947,79 @@ std::vector<CreaturePtr> Map::getSpectatorsInRange(const Position& centerPos, bo
 }
 
 std::vector<CreaturePtr> Map::getSpectatorsInRangeEx(const Position& centerPos, bool multiFloor, int minXRange, int maxXRange, int minYRange, int maxYRange)
+{
+    std::vector<CreaturePtr> creatures;
+    forEachSpectatorInRange(centerPos, multiFloor, minXRange, maxXRange, minYRange, maxYRange, false, [&](const CreaturePtr& creature) {
+        creatures.push_back(creature);
+    });
+    return creatures;
+}
+
+std::vector<CreaturePtr> Map::getSpectatorsInRangeByDistance(const Position& centerPos, bool multiFloor, int minXRange, int maxXRange, int minYRange, int maxYRange)
+{
+    std::vector<CreaturePtr> creatures;
+    forEachSpectatorInRange(centerPos, multiFloor, minXRange, maxXRange, minYRange, maxYRange, true, [&](const CreaturePtr& creature) {
+        creatures.push_back(creature);
+    });
+    return creatures;
+}
+
+void Map::forEachSpectatorInRange(const Position& centerPos, bool multiFloor, int minXRange, int maxXRange, int minYRange, int maxYRange, bool sortByDistance,
+                                  const std::function<void(const CreaturePtr&)>& visitor)
 {
     int minZRange = 0;
     int maxZRange = 0;
-    std::vector<CreaturePtr> creatures;
 
     if(multiFloor) {
         minZRange = centerPos.z - getFirstAwareFloor();
         maxZRange = getLastAwareFloor() - centerPos.z;
     }
 
-    //TODO: optimize
-    //TODO: delivery creatures in distance order
+    // buffer is taken by the call, so visitor may look for spectators too
+    static thread_local std::vector<Position> t_positions;
+    std::vector<Position> positions;
+    positions.swap(t_positions);
+    positions.clear();
 
     for(int iz=-minZRange; iz<=maxZRange; ++iz) {
-        for(int iy=-minYRange; iy<=maxYRange; ++iy) {
-            for(int ix=-minXRange; ix<=maxXRange; ++ix) {
-                TilePtr tile = getTile(centerPos.translated(ix,iy,iz));
-                if(!tile)
-                    continue;
+        int z = centerPos.z + iz;
+        if(z < 0 || z > Otc::MAX_Z)
+            continue;
+        m_creatureIndex[z].find(centerPos.x - minXRange, centerPos.y - minYRange, centerPos.x + maxXRange, centerPos.y + maxYRange, z, positions);
+    }
 
-                auto tileCreatures = tile->getCreatures();
-                creatures.insert(creatures.end(), tileCreatures.rbegin(), tileCreatures.rend());
-            }
+    // tiles are visited floor by floor, row by row, like the whole range was scanned
+    auto scanOrder = [](const Position& a, const Position& b) {
+        if(a.z != b.z)
+            return a.z < b.z;
+        if(a.y != b.y)
+            return a.y < b.y;
+        return a.x < b.x;
+    };
+    if(sortByDistance) {
+        std::sort(positions.begin(), positions.end(), [&](const Position& a, const Position& b) {
+            int distanceA = std::max<int>(std::abs(a.x - centerPos.x), std::abs(a.y - centerPos.y)) + std::abs(a.z - centerPos.z);
+            int distanceB = std::max<int>(std::abs(b.x - centerPos.x), std::abs(b.y - centerPos.y)) + std::abs(b.z - centerPos.z);
+            if(distanceA != distanceB)
+                return distanceA < distanceB;
+            return scanOrder(a, b);
+        });
+    } else {
+        std::sort(positions.begin(), positions.end(), scanOrder);
+    }
+
+    for(const Position& pos : positions) {
+        const TilePtr& tile = getTile(pos);
+        if(!tile)
+            continue;
+        const std::vector<ThingPtr>& things = tile->peekThings();
+        for(auto it = things.rbegin(); it != things.rend(); ++it) {
+            if((*it)->isCreature())
+                visitor((*it)->static_self_cast<Creature>());
         }
     }
 
-    return creatures;
+    positions.swap(t_positions);
 }
 
 std::vector<CreaturePtr> Map::getSpectatorsByPattern(const Position& centerPos, const std::string& pattern, Otc::Direction direction)
@@ -840,9 +1222,165 @@ int Map::getLastAwareFloor()
 
 std::tuple<std::vector<Otc::Direction>, Otc::PathFindResult> Map::findPath(const Position& startPos, const Position& goalPos, int maxComplexity, int flags)
 {
-    // pathfinding using A* search algorithm (otclientv8 note: it's dijkstra algorithm)
+    // pathfinding using A* search algorithm
     // as described in http://en.wikipedia.org/wiki/A*_search_algorithm
 
+    std::tuple<std::vector<Otc::Direction>, Otc::PathFindResult> ret;
+    std::vector<Otc::Direction>& dirs = std::get<0>(ret);
+    Otc::PathFindResult& result = std::get<1>(ret);
+
+    result = Otc::PathFindResultNoWay;
+
+    if(startPos == goalPos) {
+        result = Otc::PathFindResultSamePosition;
+        return ret;
+    }
+
+    if(startPos.z != goalPos.z) {
+        result = Otc::PathFindResultImpossible;
+        return ret;
+    }
+
+    // check the goal pos is walkable
+    if(g_map.isAwareOfPosition(goalPos)) {
+        const TilePtr goalTile = getTile(goalPos);
+        if(!goalTile || (!goalTile->isWalkable(flags & Otc::PathFindIgnoreCreatures))) {
+            return ret;
+        }
+    }
+    else {
+        const MinimapTile& goalTile = g_minimap.getTile(goalPos);
+        if(goalTile.hasFlag(MinimapTileNotWalkable)) {
+            return ret;
+        }
+    }
+
+    // step costs speed / 100 (3 times more for diagonal) and ground speed is never lower than 100,
+    // so manhattan distance never overestimates, two straight steps are always cheaper than diagonal one
+    auto heuristic = [&](const Position& pos) { return (float)pos.manhattanDistance(goalPos); };
+
+    // checks tile only once per search, speed of walkable tile is kept in node
+    auto checkTile = [&](const Position& pos, PathFinder::Node& node) {
+        bool wasSeen = false;
+        bool hasCreature = false;
+        bool isNotWalkable = true;
+        bool isNotPathable = true;
+        int speed = 100;
+
+        if(g_map.isAwareOfPosition(pos)) {
+            wasSeen = true;
+            if(const TilePtr& tile = getTile(pos)) {
+                hasCreature = tile->hasCreature() && (!(flags & Otc::PathFindIgnoreCreatures));
+                isNotWalkable = !tile->isWalkable(flags & Otc::PathFindIgnoreCreatures);
+                isNotPathable = !tile->isPathable();
+                speed = tile->getGroundSpeed();
+            }
+        } else {
+            const MinimapTile& mtile = g_minimap.getTile(pos);
+            wasSeen = mtile.hasFlag(MinimapTileWasSeen);
+            isNotWalkable = mtile.hasFlag(MinimapTileNotWalkable);
+            isNotPathable = mtile.hasFlag(MinimapTileNotPathable);
+            if(isNotWalkable || isNotPathable)
+                wasSeen = true;
+            speed = mtile.getSpeed();
+        }
+
+        node.state = PathFinder::NodeBlocked;
+        node.speed = speed;
+        if(!(flags & Otc::PathFindAllowNotSeenTiles) && !wasSeen)
+            return;
+        if(wasSeen) {
+            if(pos != goalPos) {
+                if(!(flags & Otc::PathFindAllowCreatures) && hasCreature)
+                    return;
+                if(!(flags & Otc::PathFindAllowNonPathable) && isNotPathable)
+                    return;
+            }
+            if(!(flags & Otc::PathFindAllowNonWalkable) && isNotWalkable)
+                return;
+        }
+        node.state = PathFinder::NodeWalkable;
+    };
+
+    PathFinder& finder = PathFinder::getInstance();
+    finder.reset(startPos.z);
+
+    uint32 startIndex = finder.getNodeIndex(startPos);
+    PathFinder::Node& startNode = finder.getNode(startIndex);
+    startNode.state = PathFinder::NodeWalkable;
+    startNode.totalCost = heuristic(startPos);
+    finder.push(startIndex, startNode.totalCost);
+
+    int complexity = 1;
+    uint32 foundIndex = PathFinder::NO_NODE;
+    uint32 index;
+    float key;
+    while(finder.pop(index, key)) {
+        PathFinder::Node& node = finder.getNode(index);
+        if(key > node.totalCost)
+            continue; // node was reached by cheaper path later
+
+        Position pos = finder.getPosition(index);
+        // path found, heuristic is consistent so there's no cheaper one
+        if(pos == goalPos) {
+            foundIndex = index;
+            break;
+        }
+
+        if(complexity > maxComplexity) {
+            result = Otc::PathFindResultTooFar;
+            break;
+        }
+
+        for(int i=-1;i<=1;++i) {
+            for(int j=-1;j<=1;++j) {
+                if(i == 0 && j == 0)
+                    continue;
+
+                Position neighborPos = pos.translated(i, j);
+                if (neighborPos.x < 0 || neighborPos.y < 0) continue;
+
+                uint32 neighborIndex = finder.getNodeIndex(neighborPos);
+                PathFinder::Node& neighborNode = finder.getNode(neighborIndex);
+                if(neighborNode.state == PathFinder::NodeUnknown) {
+                    checkTile(neighborPos, neighborNode);
+                    if(neighborNode.state == PathFinder::NodeWalkable) {
+                        neighborNode.cost = std::numeric_limits<float>::max();
+                        complexity += 1;
+                    }
+                }
+                if(neighborNode.state != PathFinder::NodeWalkable)
+                    continue;
+
+                Otc::Direction walkDir = pos.getDirectionFromPosition(neighborPos);
+                float walkFactor = walkDir >= Otc::NorthEast ? 3.0f : 1.0f;
+                float cost = node.cost + (neighborNode.speed * walkFactor) / 100.0f;
+                if(neighborNode.cost <= cost)
+                    continue;
+
+                neighborNode.prev = index;
+                neighborNode.cost = cost;
+                neighborNode.totalCost = cost + heuristic(neighborPos);
+                neighborNode.dir = walkDir;
+                finder.push(neighborIndex, neighborNode.totalCost);
+            }
+        }
+    }
+
+    if(foundIndex != PathFinder::NO_NODE) {
+        for(index = foundIndex; index != startIndex; index = finder.getNode(index).prev)
+            dirs.push_back(finder.getNode(index).dir);
+        std::reverse(dirs.begin(), dirs.end());
+        result = Otc::PathFindResultOk;
+    }
+
+    return ret;
+}
+
+std::tuple<std::vector<Otc::Direction>, Otc::PathFindResult> Map::findPathReference(const Position& startPos, const Position& goalPos, int maxComplexity, int flags)
+{
+    // previous implementation of findPath, node per position allocated on heap and kept in unordered_map
+
     struct SNode {
         SNode(const Position& pos) : cost(0), totalCost(0), pos(pos), prev(nullptr), dir(Otc::InvalidDirection) { }
         float cost;
@@ -1095,7 +1633,7 @@ bool Map::checkSightLine(const Position& fromPos, const Position& toPos)
     return checkSightLine(fromPos, toPos) || checkSightLine(toPos, fromPos);
 }
 
-PathFindResult_ptr Map::newFindPath(const Position& start, const Position& goal, std::shared_ptr<std::list<Node*>> visibleNodes)
+PathFindResult_ptr Map::newFindPath(const Position& start, const Position& goal, const PathSnapshotPtr& snapshot)
 {
     auto ret = std::make_shared<PathFindResult>();
     ret->start = start;
@@ -1105,138 +1643,213 @@ PathFindResult_ptr Map::newFindPath(const Position& start, const Position& goal,
         ret->status = Otc::PathFindResultSamePosition;
         return ret;
     }
-    if (goal.z != start.z) {
+    if (goal.z != start.z || !snapshot) {
         return ret;
     }
 
-    struct LessNode {
-        bool operator()(Node* a, Node* b) const
-        {
-            return b->totalCost < a->totalCost;
-        }
-    };
-
-    std::unordered_map<Position, Node*, PositionHasher> nodes;
-    std::priority_queue<Node*, std::vector<Node*>, LessNode> searchList;
+    // same costs and heuristic as findPath, speed / 100 per step (3 times more for diagonal)
+    // and speed is never lower than 100, so manhattan distance never overestimates
+    auto heuristic = [&](const Position& pos) { return (float)pos.manhattanDistance(goal); };
 
-    if (visibleNodes) {
-        for (auto& node : *visibleNodes)
-            nodes.emplace(node->pos, node);
-    }
+    PathFinder& finder = PathFinder::getInstance();
+    finder.reset(start.z);
 
-    Node* initNode = new Node{ 1, 0, start, nullptr, 0, 0 };
-    nodes[start] = initNode;
-    searchList.push(initNode);
+    uint32 startIndex = finder.getNodeIndex(start);
+    PathFinder::Node& startNode = finder.getNode(startIndex);
+    startNode.state = PathFinder::NodeWalkable;
+    startNode.speed = 1;
+    startNode.cost = 0;
+    startNode.totalCost = heuristic(start);
+    finder.push(startIndex, startNode.totalCost);
 
     int limit = 50000;
     float distance = start.distance(goal);
 
-    Node* dstNode = nullptr;
-    while (!searchList.empty() && --limit) {
-        Node* node = searchList.top();
-        searchList.pop();
-        if (node->pos == goal) {
-            dstNode = node;
+    uint32 dstIndex = PathFinder::NO_NODE;
+    uint32 index;
+    float key;
+    while (finder.pop(index, key) && --limit) {
+        PathFinder::Node& node = finder.getNode(index);
+        if (key > node.totalCost)
+            continue;
+        Position pos = finder.getPosition(index);
+        if (pos == goal) {
+            dstIndex = index;
             break;
         }
-        if (node->pos.distance(goal) > distance + 10000)
+        if (pos.distance(goal) > distance + 10000)
             continue;
         for (int i = -1; i <= 1; ++i) {
             for (int j = -1; j <= 1; ++j) {
                 if (i == 0 && j == 0)
                     continue;
-                Position neighbor = node->pos.translated(i, j);
+                Position neighbor = pos.translated(i, j);
                 if (neighbor.x < 0 || neighbor.y < 0) continue;
-                auto it = nodes.find(neighbor);
-                if (it == nodes.end()) {
-                    auto blockAndTile = g_minimap.threadGetTile(neighbor);
-                    bool wasSeen = blockAndTile.second.hasFlag(MinimapTileWasSeen);
-                    bool isNotWalkable = blockAndTile.second.hasFlag(MinimapTileNotWalkable);
-                    bool isNotPathable = blockAndTile.second.hasFlag(MinimapTileNotPathable);
-                    bool isEmpty = blockAndTile.second.hasFlag(MinimapTileEmpty);
-                    float speed = blockAndTile.second.getSpeed();
-                    if ((isNotWalkable || isNotPathable || isEmpty) && neighbor != goal) {
-                        it = nodes.emplace(neighbor, nullptr).first;
+                uint32 neighborIndex = finder.getNodeIndex(neighbor);
+                PathFinder::Node& neighborNode = finder.getNode(neighborIndex);
+                if (neighborNode.state == PathFinder::NodeUnknown) {
+                    // visible tiles come from map, other ones from minimap
+                    const PathSnapshot::Cell& cell = snapshot->getCell(neighbor);
+                    bool isVisible = cell.flags & PathSnapshot::CellVisible;
+                    bool wasSeen = isVisible || (cell.flags & PathSnapshot::CellSeen);
+                    bool isBlocked = isVisible ? (cell.flags & (PathSnapshot::CellBlocked | PathSnapshot::CellCreature)) : (cell.flags & PathSnapshot::CellNotPathable);
+                    if (isBlocked && neighbor != goal) {
+                        neighborNode.state = PathFinder::NodeBlocked;
                     } else {
-                        if (!wasSeen)
-                            speed = 2000;
-                        it = nodes.emplace(neighbor, new Node{ speed, 10000000.0f, neighbor, node, node->distance + 1, wasSeen ? 0 : 1 }).first;
+                        neighborNode.state = PathFinder::NodeWalkable;
+                        neighborNode.speed = wasSeen ? std::max<int>(cell.speed, 100) : 2000;
+                        neighborNode.cost = std::numeric_limits<float>::max();
+                        neighborNode.prev = index;
+                        neighborNode.distance = node.distance + 1;
+                        neighborNode.unseen = wasSeen ? 0 : 1;
                     }
                 }
-                if (!it->second) // no way
+                if (neighborNode.state != PathFinder::NodeWalkable) // no way
                     continue;
-                if (it->second->unseen > 50)
+                if (neighborNode.unseen > 50)
                     continue;
 
                 float diagonal = ((i == 0 || j == 0) ? 1.0f : 3.0f);
-                float cost = it->second->cost * diagonal;
-                cost += diagonal * (50.0f * std::max<float>(5.0f, it->second->pos.distance(goal))); // heuristic
-                if (node->totalCost + cost + 50 < it->second->totalCost) {
-                    it->second->totalCost = node->totalCost + cost;
-                    it->second->prev = node;
-                    if (it->second->unseen)
-                        it->second->unseen = node->unseen + 1;
-                    it->second->distance = node->distance + 1;
-                    searchList.push(it->second);
+                float cost = node.cost + (neighborNode.speed * diagonal) / 100.0f;
+                if (cost < neighborNode.cost) {
+                    neighborNode.cost = cost;
+                    neighborNode.totalCost = cost + heuristic(neighbor);
+                    neighborNode.prev = index;
+                    if (neighborNode.unseen)
+                        neighborNode.unseen = node.unseen + 1;
+                    neighborNode.distance = node.distance + 1;
+                    finder.push(neighborIndex, neighborNode.totalCost);
                 }
             }
         }
     }
 
-    if (dstNode) {
-        while (dstNode && dstNode->prev) {
-            if (dstNode->unseen) {
+    if (dstIndex != PathFinder::NO_NODE) {
+        for (index = dstIndex; index != startIndex && finder.getNode(index).prev != PathFinder::NO_NODE; index = finder.getNode(index).prev) {
+            const PathFinder::Node& node = finder.getNode(index);
+            if (node.unseen) {
                 ret->path.clear();
             } else {
-                ret->path.push_back(dstNode->prev->pos.getDirectionFromPosition(dstNode->pos));
+                ret->path.push_back(finder.getPosition(node.prev).getDirectionFromPosition(finder.getPosition(index)));
             }
-            dstNode = dstNode->prev;
         }
         std::reverse(ret->path.begin(), ret->path.end());
         ret->status = Otc::PathFindResultOk;
     }
     ret->complexity = 50000 - limit;
 
-    for (auto& node : nodes) {
-        if (node.second)
-            delete node.second;
-    }
-
     return ret;
 }
 
 void Map::findPathAsync(const Position& start, const Position& goal, std::function<void(PathFindResult_ptr)> callback)
 {
-    auto visibleNodes = std::make_shared<std::list<Node*>>();
-    for (auto& tile : getTiles(start.z)) {
-        if (tile->getPosition() == start)
+    // snapshot is immutable, search doesn't touch tiles and minimap changed by this thread
+    PathSnapshotPtr snapshot = getPathSnapshot(start.z);
+    g_asyncDispatcher.post([=] {
+        return g_map.newFindPath(start, goal, snapshot);
+    }, callback);
+}
+
+PathSnapshotPtr Map::getPathSnapshot(int z)
+{
+    if(z < 0 || z > Otc::MAX_Z)
+        return nullptr;
+
+    // minimap was cleaned or loaded, chunks can't be reused
+    if(m_pathMinimapVersion != g_minimap.getVersion()) {
+        m_pathMinimapVersion = g_minimap.getVersion();
+        for(int i = 0; i <= Otc::MAX_Z; ++i) {
+            m_pathSnapshots[i] = nullptr;
+            m_pathDirtyChunks[i].clear();
+        }
+    }
+
+    Position center(m_centralPosition.x, m_centralPosition.y, z);
+    uint centerChunk = PathSnapshot::getChunkIndex(center);
+    PathSnapshotPtr previous = m_pathSnapshots[z];
+    std::unordered_set<uint>& dirtyChunks = m_pathDirtyChunks[z];
+    if(previous && previous->getCenterChunk() == centerChunk && dirtyChunks.empty())
+        return previous;
+
+    auto snapshot = std::make_shared<PathSnapshot>(z, ++m_pathSnapshotVersion, centerChunk);
+    int size = PathSnapshot::CHUNK_SIZE;
+    int left = center.x - center.x % size - PathSnapshot::RANGE * size;
+    int top = center.y - center.y % size - PathSnapshot::RANGE * size;
+    for(int y = top; y <= top + 2 * PathSnapshot::RANGE * size; y += size) {
+        for(int x = left; x <= left + 2 * PathSnapshot::RANGE * size; x += size) {
+            if(x < 0 || y < 0 || x >= 65536 || y >= 65536)
+                continue;
+            Position origin(x, y, z);
+            uint index = PathSnapshot::getChunkIndex(origin);
+            PathSnapshot::ChunkPtr chunk;
+            if(previous && dirtyChunks.find(index) == dirtyChunks.end())
+                chunk = previous->getChunk(index);
+            if(chunk)
+                snapshot->setChunk(index, chunk);
+            else
+                createPathChunk(*snapshot, origin);
+        }
+    }
+
+    dirtyChunks.clear();
+    m_pathSnapshots[z] = snapshot;
+    return snapshot;
+}
+
+void Map::invalidatePathSnapshot(const Position& pos)
+{
+    // changes are tracked only for published snapshot, next one reuses the other chunks
+    if(pos.isMapPosition() && m_pathSnapshots[pos.z])
+        m_pathDirtyChunks[pos.z].insert(PathSnapshot::getChunkIndex(pos));
+}
+
+void Map::createPathChunk(PathSnapshot& snapshot, const Position& origin)
+{
+    static_assert((int)PathSnapshot::CHUNK_SIZE == (int)MMBLOCK_SIZE, "path chunk must match minimap block");
+    static_assert((int)PathSnapshot::CHUNK_SIZE % (int)BLOCK_SIZE == 0, "path chunk must contain whole tile blocks");
+
+    auto chunk = std::make_shared<PathSnapshot::Chunk>();
+    MinimapBlock* minimapBlock = g_minimap.findBlock(origin);
+    for(uint i = 0; i < PathSnapshot::CHUNK_CELLS; ++i) {
+        PathSnapshot::Cell& cell = (*chunk)[i];
+        cell.speed = 100;
+        cell.flags = 0;
+        if(!minimapBlock)
             continue;
-        bool isNotWalkable = !tile->isWalkable(false);
-        bool isNotPathable = !tile->isPathable();
-        float speed = tile->getGroundSpeed();
-        if ((isNotWalkable || isNotPathable) && tile->getPosition() != goal) {
-            visibleNodes->push_back(new Node{ speed, 0, tile->getPosition(), nullptr, 0, 0 });
-        } else {
-            visibleNodes->push_back(new Node{ speed, 10000000.0f, tile->getPosition(), nullptr, 0, 0 });
+        // minimap block uses the same tile order
+        const MinimapTile& minimapTile = minimapBlock->getTiles()[i];
+        cell.speed = minimapTile.getSpeed();
+        if(minimapTile.hasFlag(MinimapTileWasSeen))
+            cell.flags |= PathSnapshot::CellSeen;
+        if(minimapTile.flags & (MinimapTileNotWalkable | MinimapTileNotPathable | MinimapTileEmpty))
+            cell.flags |= PathSnapshot::CellNotPathable;
+    }
+
+    for(int y = 0; y < PathSnapshot::CHUNK_SIZE; y += BLOCK_SIZE) {
+        for(int x = 0; x < PathSnapshot::CHUNK_SIZE; x += BLOCK_SIZE) {
+            TileBlock* block = m_tileBlocks[origin.z].find(getBlockIndex(origin.translated(x, y)));
+            if(!block)
+                continue;
+            for(const TilePtr& tile : block->getTiles()) {
+                if(!tile)
+                    continue;
+                PathSnapshot::Cell& cell = (*chunk)[PathSnapshot::getCellIndex(tile->getPosition())];
+                cell.speed = std::min<int>(tile->getGroundSpeed(), 65535);
+                cell.flags |= PathSnapshot::CellVisible;
+                if(!tile->isWalkable(true) || !tile->isPathable())
+                    cell.flags |= PathSnapshot::CellBlocked;
+                else if(!tile->isWalkable(false))
+                    cell.flags |= PathSnapshot::CellCreature;
+            }
         }
     }
 
-    g_asyncDispatcher.dispatch([=] {
-        auto ret = g_map.newFindPath(start, goal, visibleNodes);
-        g_dispatcher.addEvent(std::bind(callback, ret));
-    });
+    snapshot.setChunk(PathSnapshot::getChunkIndex(origin), chunk);
 }
 
 std::map<std::string, std::tuple<int, int, int, std::string>> Map::findEveryPath(const Position& start, int maxDistance, const std::map<std::string, std::string>& params)
 {
     // using Dijkstra's algorithm
-    struct LessNode {
-        bool operator()(Node* a, Node* b) const
-        {
-            return b->totalCost < a->totalCost;
-        }
-    };
-
     if (g_extras.debugPathfinding) {
         g_logger.info(stdext::format("findEveryPath: %i %i %i - %i", start.x, start.y, start.z, maxDistance));
         for (auto& param : params) {
@@ -1288,36 +1901,45 @@ std::map<std::string, std::tuple<int, int, int, std::string>> Map::findEveryPath
     }
 
     std::map<std::string, std::tuple<int, int, int, std::string>> ret;
-    std::unordered_map<Position, Node*, PositionHasher> nodes;
-    std::priority_queue<Node*, std::vector<Node*>, LessNode> searchList;
-
-    Node* initNode = new Node{ 1, 0, start, nullptr, 0, 0 };
-    nodes[start] = initNode;
-    searchList.push(initNode);
-
-    while (!searchList.empty()) {
-        Node* node = searchList.top();
-        searchList.pop();
-        ret[node->pos.toString()] = std::make_tuple(node->totalCost, node->distance,
-                                                    node->prev ? node->prev->pos.getDirectionFromPosition(node->pos) : -1,
-                                                    node->prev ? node->prev->pos.toString() : "");
-        if (node->pos == destPos) {
+    PathFinder& finder = PathFinder::getInstance();
+    finder.reset(start.z);
+
+    uint32 startIndex = finder.getNodeIndex(start);
+    PathFinder::Node& startNode = finder.getNode(startIndex);
+    startNode.state = PathFinder::NodeWalkable;
+    startNode.speed = 1;
+    startNode.totalCost = 0;
+    finder.push(startIndex, 0);
+
+    uint32 index;
+    float key;
+    while (finder.pop(index, key)) {
+        PathFinder::Node& node = finder.getNode(index);
+        if (key > node.totalCost)
+            continue;
+        Position pos = finder.getPosition(index);
+        Position prevPos = node.prev != PathFinder::NO_NODE ? finder.getPosition(node.prev) : Position();
+        ret[pos.toString()] = std::make_tuple(node.totalCost, node.distance,
+                                              node.prev != PathFinder::NO_NODE ? prevPos.getDirectionFromPosition(pos) : -1,
+                                              node.prev != PathFinder::NO_NODE ? prevPos.toString() : "");
+        if (pos == destPos) {
             if (hasMargin) {
-                maxDistance = std::min<int>(node->distance + 4, maxDistance);
+                maxDistance = std::min<int>(node.distance + 4, maxDistance);
             } else {
                 break;
             }
         }
-        if (node->distance >= maxDistance)
+        if (node.distance >= maxDistance)
             continue;
         for (int i = -1; i <= 1; ++i) {
             for (int j = -1; j <= 1; ++j) {
                 if (i == 0 && j == 0)
                     continue;
-                Position neighbor = node->pos.translated(i, j);
+                Position neighbor = pos.translated(i, j);
                 if (neighbor.x < 0 || neighbor.y < 0) continue;
-                auto it = nodes.find(neighbor);
-                if (it == nodes.end()) {
+                uint32 neighborIndex = finder.getNodeIndex(neighbor);
+                PathFinder::Node& neighborNode = finder.getNode(neighborIndex);
+                if (neighborNode.state == PathFinder::NodeUnknown) {
                     bool wasSeen = false;
                     bool hasCreature = false;
                     bool isNotWalkable = true;
@@ -1345,46 +1967,46 @@ std::map<std::string, std::tuple<int, int, int, std::string>> Map::findEveryPath
                     }
                     bool hasStairs = isNotPathable && mapColor >= 210 && mapColor <= 213;
                     bool hasReachedMaxDistance = maxDistanceFrom && maxDistanceFromPos.isValid() && maxDistanceFromPos.distance(neighbor) > maxDistanceFrom;
+                    neighborNode.state = PathFinder::NodeBlocked;
                     if ((!wasSeen && !allowUnseen) || (hasStairs && !ignoreStairs && neighbor != destPos) || 
                         (isNotPathable && !ignoreNonPathable && neighbor != destPos) || (isNotWalkable && !ignoreNonWalkable) ||
                         hasReachedMaxDistance) {
-                        it = nodes.emplace(neighbor, nullptr).first;
+                        continue;
                     } else if ((hasCreature && !ignoreCreatures)) {
-                        it = nodes.emplace(neighbor, nullptr).first;
                         if (ignoreLastCreature) {
-                            ret[neighbor.toString()] = std::make_tuple(node->totalCost + 100, node->distance + 1,
-                                                                       node->pos.getDirectionFromPosition(neighbor),
-                                                                       node->pos.toString());
+                            ret[neighbor.toString()] = std::make_tuple(node.totalCost + 100, node.distance + 1,
+                                                                       pos.getDirectionFromPosition(neighbor),
+                                                                       pos.toString());
                         }
-                    } else {
-                        it = nodes.emplace(neighbor, new Node{ (float)speed, 10000000.0f, neighbor, node, node->distance + 1, wasSeen ? 0 : 1 }).first;
+                        continue;
                     }
+                    neighborNode.state = PathFinder::NodeWalkable;
+                    neighborNode.speed = speed;
+                    neighborNode.totalCost = 10000000.0f;
+                    neighborNode.prev = index;
+                    neighborNode.distance = node.distance + 1;
+                    neighborNode.unseen = wasSeen ? 0 : 1;
                 }
 
-                if (!it->second) {
+                if (neighborNode.state != PathFinder::NodeWalkable) {
                     continue;
                 }
 
                 float diagonal = ((i == 0 || j == 0) ? 1.0f : 3.0f);
-                float cost = it->second->cost * diagonal;
+                float cost = neighborNode.speed * diagonal;
                 if (ignoreCost)
                     cost = 1;
-                if (node->totalCost + cost < it->second->totalCost) {
-                    it->second->totalCost = node->totalCost + cost;
-                    it->second->prev = node;
-                    if (it->second->unseen)
-                        it->second->unseen = node->unseen + 1;
-                    it->second->distance = node->distance + 1;
-                    searchList.push(it->second);
+                if (node.totalCost + cost < neighborNode.totalCost) {
+                    neighborNode.totalCost = node.totalCost + cost;
+                    neighborNode.prev = index;
+                    if (neighborNode.unseen)
+                        neighborNode.unseen = node.unseen + 1;
+                    neighborNode.distance = node.distance + 1;
+                    finder.push(neighborIndex, neighborNode.totalCost);
                 }
             }
         }
     }
 
-    for (auto& node : nodes) {
-        if (node.second)
-            delete node.second;
-    }
-
     return ret;
 }
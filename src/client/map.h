@@ -32,6 +32,8 @@
 #include "tile.h"
 
 #include <framework/core/clock.h>
+#include <bitset>
+#include <unordered_set>
 
 enum OTBM_ItemAttr
 {
@@ -124,6 +126,88 @@ private:
     std::array<TilePtr, BLOCK_SIZE*BLOCK_SIZE> m_tiles;
 };
 
+// tile blocks of single floor, open addressing hash table with linear probing,
+// blocks are allocated separately so references to them stay valid when the table grows
+class TileBlockMap {
+public:
+    using Entry = std::pair<uint, std::unique_ptr<TileBlock>>;
+
+    class Iterator {
+    public:
+        Iterator(const Entry* entry, const Entry* end) : m_entry(entry), m_end(end) { skipEmpty(); }
+        const Entry& operator*() const { return *m_entry; }
+        const Entry* operator->() const { return m_entry; }
+        Iterator& operator++() { ++m_entry; skipEmpty(); return *this; }
+        bool operator!=(const Iterator& other) const { return m_entry != other.m_entry; }
+
+    private:
+        void skipEmpty() { while (m_entry != m_end && !m_entry->second) ++m_entry; }
+        const Entry* m_entry;
+        const Entry* m_end;
+    };
+
+    TileBlock* find(uint index) const {
+        if (m_size == 0)
+            return nullptr;
+        for (size_t i = slot(index);; i = (i + 1) & m_mask) {
+            const Entry& entry = m_entries[i];
+            if (!entry.second)
+                return nullptr;
+            if (entry.first == index)
+                return entry.second.get();
+        }
+    }
+    TileBlock& get(uint index); // creates block if it doesn't exist
+    void erase(uint index);
+    void clear();
+    size_t size() const { return m_size; }
+
+    // iteration order is unspecified, table can't be modified while iterating
+    Iterator begin() const { return Iterator(m_entries.data(), m_entries.data() + m_entries.size()); }
+    Iterator end() const { return Iterator(m_entries.data() + m_entries.size(), m_entries.data() + m_entries.size()); }
+    // blocks ordered by index, from top left corner of map
+    std::vector<const TileBlock*> getSortedBlocks() const;
+
+private:
+    size_t slot(uint index) const { return (uint32)(index * 2654435769u) >> m_shift; } // fibonacci hashing
+    void rehash(size_t capacity);
+
+    std::vector<Entry> m_entries;
+    size_t m_size = 0;
+    size_t m_mask = 0;
+    int m_shift = 32;
+};
+
+// positions of tiles with creatures of single floor, grouped in buckets of BUCKET_SIZE x BUCKET_SIZE tiles,
+// range queries visit only buckets and tiles which have creatures
+class CreatureIndex {
+public:
+    enum {
+        BUCKET_SIZE = 8
+    };
+
+    // called for every creature added to or removed from tile
+    void add(const Position& pos);
+    void remove(const Position& pos);
+    // removes position no matter how many creatures it has, used when tile is removed
+    void erase(const Position& pos);
+    void clear() { m_buckets.clear(); }
+
+    // appends positions in rectangle, unordered
+    void find(int left, int top, int right, int bottom, int z, std::vector<Position>& positions) const;
+
+private:
+    struct Entry {
+        uint16 x;
+        uint16 y;
+        uint16 creatures;
+    };
+
+    uint getBucketIndex(int x, int y) const { return ((y / BUCKET_SIZE) * (65536 / BUCKET_SIZE)) + (x / BUCKET_SIZE); }
+
+    std::unordered_map<uint, std::vector<Entry>> m_buckets;
+};
+
 struct AwareRange
 {
     int top;
@@ -145,14 +229,8 @@ struct PathFindResult
 };
 using PathFindResult_ptr = std::shared_ptr<PathFindResult>;
 
-struct Node {
-    float cost;
-    float totalCost;
-    Position pos;
-    Node *prev;
-    int distance;
-    int unseen;
-};
+class PathSnapshot;
+using PathSnapshotPtr = std::shared_ptr<const PathSnapshot>;
 
 //@bindsingleton g_map
 class Map
@@ -234,10 +312,27 @@ public:
     void addCreature(const CreaturePtr& creature);
     CreaturePtr getCreatureById(uint32 id);
     void removeCreatureById(uint32 id);
+    // floors with creatures having widgets, they can be drawn only by dispatcher thread
+    std::bitset<Otc::MAX_Z + 1> getCreatureWidgetFloors();
+    // called by tiles for every creature added or removed
+    void addCreatureToIndex(const Position& pos) { if(pos.isMapPosition()) m_creatureIndex[pos.z].add(pos); }
+    void removeCreatureFromIndex(const Position& pos) { if(pos.isMapPosition()) m_creatureIndex[pos.z].remove(pos); }
+
+    // looks up every position of aware range on every floor, returns lookup throughput
+    std::string benchmarkTileLookups(int iterations);
+    // rebuilds path snapshot and runs findPathReference, findPath, newFindPath and findEveryPath from start to positions around it, returns nodes throughput
+    std::string benchmarkPathFinding(const Position& start, int iterations);
+    // light map of width x height tiles with random lights, compares output with reference implementation
+    std::string benchmarkLightView(int width, int height, int lights, int iterations);
     std::vector<CreaturePtr> getSightSpectators(const Position& centerPos, bool multiFloor);
     std::vector<CreaturePtr> getSpectators(const Position& centerPos, bool multiFloor);
     std::vector<CreaturePtr> getSpectatorsInRange(const Position& centerPos, bool multiFloor, int xRange, int yRange);
     std::vector<CreaturePtr> getSpectatorsInRangeEx(const Position& centerPos, bool multiFloor, int minXRange, int maxXRange, int minYRange, int maxYRange);
+    // nearest first, creatures at the same distance are in the same order as in getSpectatorsInRangeEx
+    std::vector<CreaturePtr> getSpectatorsInRangeByDistance(const Position& centerPos, bool multiFloor, int minXRange, int maxXRange, int minYRange, int maxYRange);
+    // calls visitor for every spectator without building vector, visitor can't change the map
+    void forEachSpectatorInRange(const Position& centerPos, bool multiFloor, int minXRange, int maxXRange, int minYRange, int maxYRange, bool sortByDistance,
+                                 const std::function<void(const CreaturePtr&)>& visitor);
     std::vector<CreaturePtr> getSpectatorsByPattern(const Position& centerPos, const std::string& pattern, Otc::Direction direction);
 
     void setLight(const Light& light) { m_light = light; }
@@ -264,7 +359,7 @@ public:
     std::vector<StaticTextPtr> getStaticTexts() { return m_staticTexts; }
 
     std::tuple<std::vector<Otc::Direction>, Otc::PathFindResult> findPath(const Position& start, const Position& goal, int maxComplexity, int flags = 0);
-    PathFindResult_ptr newFindPath(const Position& start, const Position& goal, std::shared_ptr<std::list<Node*>> visibleNodes);
+    PathFindResult_ptr newFindPath(const Position& start, const Position& goal, const PathSnapshotPtr& snapshot);
     void findPathAsync(const Position & start, const Position & goal, std::function<void(PathFindResult_ptr)> callback);
 
     // tuple = <cost, distance, prevPos>
@@ -276,17 +371,30 @@ public:
     bool isSightClear(const Position& fromPos, const Position& toPos);
     bool checkSightLine(const Position& fromPos, const Position& toPos);
 
+    // snapshot of floor z around central position for path searches on other threads,
+    // the same snapshot is returned until tiles in it change
+    PathSnapshotPtr getPathSnapshot(int z);
+
 private:
     void removeUnawareThings();
+    void invalidatePathSnapshot(const Position& pos);
+    void createPathChunk(PathSnapshot& snapshot, const Position& origin);
+    // findPath before PathFinder was added, kept only as baseline for benchmarkPathFinding
+    std::tuple<std::vector<Otc::Direction>, Otc::PathFindResult> findPathReference(const Position& startPos, const Position& goalPos, int maxComplexity, int flags);
     uint getBlockIndex(const Position& pos) { return ((pos.y / BLOCK_SIZE) * (65536 / BLOCK_SIZE)) + (pos.x / BLOCK_SIZE); }
 
-    std::map<uint, TileBlock> m_tileBlocks[Otc::MAX_Z+1];
+    TileBlockMap m_tileBlocks[Otc::MAX_Z+1];
+    CreatureIndex m_creatureIndex[Otc::MAX_Z+1];
     std::map<uint32, CreaturePtr> m_knownCreatures;
     std::array<std::vector<MissilePtr>, Otc::MAX_Z+1> m_floorMissiles;
     std::vector<AnimatedTextPtr> m_animatedTexts;
     std::vector<StaticTextPtr> m_staticTexts;
     std::vector<MapViewPtr> m_mapViews;
     std::unordered_map<Position, std::string, PositionHasher> m_waypoints;
+    PathSnapshotPtr m_pathSnapshots[Otc::MAX_Z+1];
+    std::unordered_set<uint> m_pathDirtyChunks[Otc::MAX_Z+1];
+    uint32 m_pathSnapshotVersion = 0;
+    uint32 m_pathMinimapVersion = 0;
 
     uint8 m_animationFlags;
     uint32 m_zoneFlags;
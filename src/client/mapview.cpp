@@ -29,6 +29,7 @@
 #include "animatedtext.h"
 #include "missile.h"
 #include "lightview.h"
+#include "animator.h"
 #include "localplayer.h"
 #include "game.h"
 #include "spritemanager.h"
@@ -37,6 +38,7 @@
 #include <framework/graphics/image.h>
 #include <framework/graphics/framebuffermanager.h>
 #include <framework/core/eventdispatcher.h>
+#include <framework/core/asyncdispatcher.h>
 #include <framework/core/application.h>
 #include <framework/core/resourcemanager.h>
 #include <framework/graphics/texturemanager.h>
@@ -109,7 +111,7 @@ void MapView::drawTileWidget(const Rect& rect, const Rect& srcRect)
 
 void MapView::drawMapBackground(const Rect& rect, const TilePtr& crosshairTile) {
     Position cameraPosition = getCameraPosition();
-    if (m_mustUpdateVisibleTilesCache) {
+    if (m_mustUpdateVisibleTilesCache || m_mustPatchVisibleTilesCache) {
         updateVisibleTilesCache();
     }
 
@@ -129,8 +131,11 @@ void MapView::drawMapBackground(const Rect& rect, const TilePtr& crosshairTile)
             m_lightTexture = TexturePtr(new Texture(m_drawDimension, false, true));
         m_lightView = std::make_unique<LightView>(m_lightTexture, m_drawDimension, rect, srcRect, ambientLight.color,
                                                   std::max<int>(m_minimumAmbientLight * 255, ambientLight.intensity));
+        m_lightView->setThreaded(m_threadedLights);
+        m_lightView->setGpu(m_gpuLights);
     }
 
+    std::vector<std::pair<short, float>> floors; // floor, fading
     for (int z = m_cachedLastVisibleFloor; z >= m_cachedFirstFadingFloor; --z) {
         float fading = 1.0;
         if (m_floorFading > 0) {
@@ -142,31 +147,123 @@ void MapView::drawMapBackground(const Rect& rect, const TilePtr& crosshairTile)
             }
             if (fading == 0) break;
         }
+        floors.push_back(std::make_pair(z, fading));
+    }
+
+    if (m_parallelFloors && floors.size() > 1)
+        return drawFloorsParallel(floors, cameraPosition, crosshairTile);
 
+    for (auto& floor : floors) {
         size_t floorStart = g_drawQueue->size();
-        drawFloor(z, cameraPosition, crosshairTile);
+        drawFloor(floor.first, cameraPosition, m_lightView.get(), crosshairTile);
 
-        if (fading < 0.99)
-            g_drawQueue->setOpacity(floorStart, fading);
+        if (floor.second < 0.99)
+            g_drawQueue->setOpacity(floorStart, floor.second);
     }
-
 } 
 
-void MapView::drawFloor(short floor, const Position& cameraPosition, const TilePtr& crosshairTile)
+void MapView::drawFloorsParallel(const std::vector<std::pair<short, float>>& floors, const Position& cameraPosition, const TilePtr& crosshairTile)
+{
+    struct FloorJob {
+        short floor;
+        std::shared_ptr<DrawQueue> queue;
+        std::unique_ptr<LightView> lights; // recorded, replayed into m_lightView in floor order
+        ThingType::DeferredTextures textures;
+    };
+    // shared with async dispatcher tasks which may start after this function returned, then they find no job
+    struct State {
+        std::vector<FloorJob> jobs;
+        std::vector<size_t> parallelJobs;
+        std::atomic<size_t> next{ 0 };
+        size_t done = 0;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    auto state = std::make_shared<State>();
+    std::bitset<Otc::MAX_Z + 1> widgetFloors = g_map.getCreatureWidgetFloors();
+    state->jobs.resize(floors.size());
+    for (size_t i = 0; i < floors.size(); ++i) {
+        FloorJob& job = state->jobs[i];
+        job.floor = floors[i].first;
+        job.queue = DrawQueue::create();
+        if (m_lightView)
+            job.lights = std::make_unique<LightView>();
+        // creature widgets may call lua, so these floors are drawn only by this thread
+        if (!widgetFloors.test(job.floor))
+            state->parallelJobs.push_back(i);
+    }
+
+    const TilePtr* crosshair = &crosshairTile; // not copied, task could release last reference on other thread
+    auto drawJob = [this, cameraPosition, crosshair](FloorJob& job) {
+        std::shared_ptr<DrawQueue> queue = g_drawQueue;
+        g_drawQueue = job.queue;
+        ThingType::setDeferredTextures(&job.textures);
+        try {
+            drawFloor(job.floor, cameraPosition, job.lights.get(), *crosshair);
+        } catch (std::exception& e) {
+            g_logger.error(stdext::format("Exception while drawing floor %i: %s", job.floor, e.what()));
+        }
+        ThingType::setDeferredTextures(nullptr);
+        g_drawQueue = queue;
+    };
+    auto work = [state, drawJob] {
+        size_t index;
+        while ((index = state->next.fetch_add(1)) < state->parallelJobs.size()) {
+            drawJob(state->jobs[state->parallelJobs[index]]);
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (++state->done == state->parallelJobs.size())
+                state->condition.notify_all();
+        }
+    };
+
+    Animator::setParallelAccess(true);
+    size_t tasks = std::min<size_t>(state->parallelJobs.size() - 1, g_asyncDispatcher.getThreadsCount());
+    for (size_t i = 0; i < tasks; ++i)
+        g_asyncDispatcher.dispatch(work);
+
+    for (size_t i = 0, j = 0; i < state->jobs.size(); ++i) {
+        if (j < state->parallelJobs.size() && state->parallelJobs[j] == i) {
+            j += 1;
+            continue;
+        }
+        drawJob(state->jobs[i]);
+    }
+    work();
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->condition.wait(lock, [&] { return state->done == state->parallelJobs.size(); });
+    }
+    Animator::setParallelAccess(false);
+
+    for (size_t i = 0; i < state->jobs.size(); ++i) {
+        FloorJob& job = state->jobs[i];
+        size_t floorStart = g_drawQueue->size();
+        g_drawQueue->append(job.queue);
+        if (floors[i].second < 0.99)
+            g_drawQueue->setOpacity(floorStart, floors[i].second);
+        if (m_lightView)
+            job.lights->replay(m_lightView.get());
+        ThingType::loadDeferredTextures(job.textures);
+    }
+    state->jobs.clear();
+}
+
+void MapView::drawFloor(short floor, const Position& cameraPosition, LightView* lightView, const TilePtr& crosshairTile)
 {
     if (floor < 0 || floor > Otc::MAX_Z)
         return;
 
     auto& tiles = m_cachedVisibleTiles[floor];
-    size_t lightFloorStart = m_lightView ? m_lightView->size() : 0;
+    size_t lightFloorStart = lightView ? lightView->size() : 0;
 
     // light
-    if (m_lightView) {
+    if (lightView) {
         for (auto& tile : tiles) {
             Point tileDrawPos = transformPositionTo2D(tile->getPosition(), cameraPosition);
             ItemPtr ground = tile->getGround();
             if (ground && ground->isGround() && !ground->isTranslucent()) {
-                m_lightView->setFieldBrightness(tileDrawPos, lightFloorStart, 0);
+                lightView->setFieldBrightness(tileDrawPos, lightFloorStart, 0);
             }
         }
     }
@@ -175,50 +272,50 @@ void MapView::drawFloor(short floor, const Position& cameraPosition, const TileP
         // ground
         for (auto& tile : tiles) {
             Point tileDrawPos = transformPositionTo2D(tile->getPosition(), cameraPosition);
-            tile->drawGround(tileDrawPos, m_lightView.get());
+            tile->drawGround(tileDrawPos, lightView);
         }
         // bottom, creatures, top
         for (auto& tile : tiles) {
             Point tileDrawPos = transformPositionTo2D(tile->getPosition(), cameraPosition);
 
-            tile->drawBottom(tileDrawPos, m_lightView.get());
+            tile->drawBottom(tileDrawPos, lightView);
 
             if (m_crosshair && tile == crosshairTile) {
                 g_drawQueue->addTexturedRect(Rect(tileDrawPos, tileDrawPos + g_sprites.spriteSize() - 1),
                                              m_crosshair, Rect(0, 0, m_crosshair->getSize()));
             }
 
-            tile->drawCreatures(tileDrawPos, m_lightView.get());
-            tile->drawTop(tileDrawPos, m_lightView.get());
+            tile->drawCreatures(tileDrawPos, lightView);
+            tile->drawTop(tileDrawPos, lightView);
         }
     } else {
         // ground, bottom, creatures, top
         for (auto& tile : tiles) {
             Point tileDrawPos = transformPositionTo2D(tile->getPosition(), cameraPosition);
 
-            if (m_lightView) {
+            if (lightView) {
                 ItemPtr ground = tile->getGround();
                 if (ground && ground->isGround() && !ground->isTranslucent()) {
-                    m_lightView->setFieldBrightness(tileDrawPos, lightFloorStart, 0);
+                    lightView->setFieldBrightness(tileDrawPos, lightFloorStart, 0);
                 }
             }
 
-            tile->drawGround(tileDrawPos, m_lightView.get());
+            tile->drawGround(tileDrawPos, lightView);
 
-            tile->drawBottom(tileDrawPos, m_lightView.get());
+            tile->drawBottom(tileDrawPos, lightView);
 
             if (m_crosshair && tile == crosshairTile) {
                 g_drawQueue->addTexturedRect(Rect(tileDrawPos, tileDrawPos + g_sprites.spriteSize() - 1),
                                              m_crosshair, Rect(0, 0, m_crosshair->getSize()));
             }
 
-            tile->drawCreatures(tileDrawPos, m_lightView.get());
-            tile->drawTop(tileDrawPos, m_lightView.get());
+            tile->drawCreatures(tileDrawPos, lightView);
+            tile->drawTop(tileDrawPos, lightView);
         }
     }
 
     for (const MissilePtr& missile : g_map.getFloorMissiles(floor)) {
-        missile->draw(transformPositionTo2D(missile->getPosition(), cameraPosition), true, m_lightView.get());
+        missile->draw(transformPositionTo2D(missile->getPosition(), cameraPosition), true, lightView);
     }
 }
 
@@ -237,9 +334,9 @@ void MapView::drawMapForeground(const Rect& rect)
 
     // creatures
     std::vector<std::pair<CreaturePtr, Point>> creatures;
-    for (const CreaturePtr& creature : g_map.getSpectatorsInRangeEx(cameraPosition, false, m_visibleDimension.width() / 2, m_visibleDimension.width() / 2 + 1, m_visibleDimension.height() / 2, m_visibleDimension.height() / 2 + 1)) {
+    g_map.forEachSpectatorInRange(cameraPosition, false, m_visibleDimension.width() / 2, m_visibleDimension.width() / 2 + 1, m_visibleDimension.height() / 2, m_visibleDimension.height() / 2 + 1, false, [&](const CreaturePtr& creature) {
         if (!creature->canBeSeen())
-            continue;
+            return;
 
         PointF jumpOffset = creature->getJumpOffset();
         Point creatureOffset = Point(16 * g_sprites.getOffsetFactor() - creature->getDisplacementX(), -creature->getDisplacementY() - 2 * g_sprites.getOffsetFactor());
@@ -250,7 +347,7 @@ void MapView::drawMapForeground(const Rect& rect)
         p.y = p.y * verticalStretchFactor;
         p += rect.topLeft();
         creatures.push_back(std::make_pair(creature, p));
-    }
+    });
 
     for (auto& c : creatures) {
         int flags = Otc::DrawIcons;
@@ -338,11 +435,11 @@ void MapView::updateVisibleTilesCache()
     if(m_cachedLastVisibleFloor < m_cachedFirstVisibleFloor)
         m_cachedLastVisibleFloor = m_cachedFirstVisibleFloor;
 
-    m_mustUpdateVisibleTilesCache = false;
-
     // there is no tile to render on invalid positions
     Position cameraPosition = getCameraPosition();
     if (!cameraPosition.isValid()) {
+        m_mustUpdateVisibleTilesCache = false;
+        m_mustPatchVisibleTilesCache = false;
         return;
     }
 
@@ -365,31 +462,140 @@ void MapView::updateVisibleTilesCache()
 
     m_lastCameraPosition = cameraPosition;
 
-    const int numDiagonals = m_drawDimension.width() + m_drawDimension.height() - 1;
+    int firstFloor = m_floorFading ? m_cachedFirstFadingFloor : m_cachedFirstVisibleFloor;
+    bool full = m_mustUpdateVisibleTilesCache || !m_incrementalTilesCache;
+    m_mustUpdateVisibleTilesCache = false;
+    m_mustPatchVisibleTilesCache = false;
+    updateTilesGrid(cameraPosition, firstFloor, full);
+
     for (auto& cachedVisibleTiles : m_cachedVisibleTiles) {
         cachedVisibleTiles.clear();
     }
 
     // draw from last floor (the lower) to first floor (the higher)
-    for(int iz = m_cachedLastVisibleFloor; iz >= (m_floorFading ? m_cachedFirstFadingFloor : m_cachedFirstVisibleFloor); --iz) {
+    const int numDiagonals = m_drawDimension.width() + m_drawDimension.height() - 1;
+    for(int iz = m_cachedLastVisibleFloor; iz >= firstFloor; --iz) {
+        const auto& grid = m_tilesGrid[iz];
         for (int diagonal = 0; diagonal < numDiagonals; ++diagonal) {
             // loop current diagonal tiles
             int advance = std::max<int>(diagonal - m_drawDimension.height(), 0);
             for (int iy = diagonal - advance, ix = advance; iy >= 0 && ix < m_drawDimension.width(); --iy, ++ix) {
-                // position on current floor
-                //TODO: check position limits
-                Position tilePos = cameraPosition.translated(ix - m_virtualCenterOffset.x, iy - m_virtualCenterOffset.y);
-                // adjust tilePos to the wanted floor
-                tilePos.coveredUp(cameraPosition.z - iz);
-                if (const TilePtr& tile = g_map.getTile(tilePos)) {
-                    if (!tile->isDrawable())
-                        continue;
-                    m_cachedVisibleTiles[tilePos.z].push_back(tile);
-                    tile->calculateCorpseCorrection();
+                const TilePtr& tile = grid[iy * m_drawDimension.width() + ix];
+                if (!tile || !tile->isDrawable())
+                    continue;
+                m_cachedVisibleTiles[iz].push_back(tile);
+                tile->calculateCorpseCorrection();
+            }
+        }
+    }
+}
+
+void MapView::updateTilesGrid(const Position& cameraPosition, int firstFloor, bool full)
+{
+    // diagonals loop reaches one row below draw dimension
+    const int width = m_drawDimension.width(), height = m_drawDimension.height() + 1;
+    int dx = cameraPosition.x - m_tilesGridPosition.x;
+    int dy = cameraPosition.y - m_tilesGridPosition.y;
+
+    if (!m_tilesGridPosition.isValid() || m_tilesGridPosition.z != cameraPosition.z || m_tilesGridDimension != m_drawDimension ||
+        m_tilesGridFirstFloor != firstFloor || m_tilesGridLastFloor != m_cachedLastVisibleFloor ||
+        std::abs(dx) >= width || std::abs(dy) >= height || m_dirtyTiles.size() > (size_t)(width * height)) {
+        full = true;
+    }
+
+    auto getTile = [&](int ix, int iy, int iz) -> const TilePtr& {
+        // position on current floor adjusted to the wanted floor
+        Position tilePos = cameraPosition.translated(ix - m_virtualCenterOffset.x, iy - m_virtualCenterOffset.y);
+        if (!tilePos.coveredUp(cameraPosition.z - iz))
+            return m_nullTile;
+        return g_map.getTile(tilePos);
+    };
+
+    if (full) {
+        m_fullTilesCacheUpdates += 1;
+        for (int iz = 0; iz <= Otc::MAX_Z; ++iz) {
+            auto& grid = m_tilesGrid[iz];
+            grid.assign(iz >= firstFloor && iz <= m_cachedLastVisibleFloor ? width * height : 0, nullptr);
+            if (grid.empty())
+                continue;
+            for (int iy = 0; iy < height; ++iy)
+                for (int ix = 0; ix < width; ++ix)
+                    grid[iy * width + ix] = getTile(ix, iy, iz);
+        }
+    } else {
+        m_incrementalTilesCacheUpdates += 1;
+        for (int iz = firstFloor; iz <= m_cachedLastVisibleFloor; ++iz) {
+            auto& grid = m_tilesGrid[iz];
+            if (dx != 0 || dy != 0) {
+                // keep tiles which are still visible, load only uncovered rows and columns
+                std::vector<TilePtr> shifted(width * height);
+                for (int iy = 0; iy < height; ++iy) {
+                    for (int ix = 0; ix < width; ++ix) {
+                        int ox = ix + dx, oy = iy + dy;
+                        if (ox >= 0 && ox < width && oy >= 0 && oy < height)
+                            shifted[iy * width + ix] = std::move(grid[oy * width + ox]);
+                        else
+                            shifted[iy * width + ix] = getTile(ix, iy, iz);
+                    }
                 }
+                grid = std::move(shifted);
             }
         }
+
+        for (const Position& pos : m_dirtyTiles) {
+            if (pos.z < firstFloor || pos.z > m_cachedLastVisibleFloor)
+                continue;
+            int covered = cameraPosition.z - pos.z;
+            int ix = pos.x - covered - cameraPosition.x + m_virtualCenterOffset.x;
+            int iy = pos.y - covered - cameraPosition.y + m_virtualCenterOffset.y;
+            if (ix < 0 || ix >= width || iy < 0 || iy >= height)
+                continue;
+            m_tilesGrid[pos.z][iy * width + ix] = g_map.getTile(pos);
+        }
+    }
+
+    m_dirtyTiles.clear();
+    m_tilesGridPosition = cameraPosition;
+    m_tilesGridDimension = m_drawDimension;
+    m_tilesGridFirstFloor = firstFloor;
+    m_tilesGridLastFloor = m_cachedLastVisibleFloor;
+}
+
+std::string MapView::compareParallelFloors(const Rect& rect)
+{
+    std::shared_ptr<DrawQueue> queue = g_drawQueue;
+    bool parallelFloors = m_parallelFloors;
+    std::shared_ptr<DrawQueue> queues[2] = { DrawQueue::create(), DrawQueue::create() };
+    ticks_t time[2];
+    for (int i = 0; i < 2; ++i) {
+        m_parallelFloors = i == 1;
+        g_drawQueue = queues[i];
+        stdext::timer timer;
+        drawMapBackground(rect);
+        time[i] = timer.elapsed_micros();
     }
+    m_parallelFloors = parallelFloors;
+    g_drawQueue = queue;
+
+    // textures missing in serial pass are loaded by it, so both passes draw the same things
+    bool identical = queues[0]->isSameAs(*queues[1]);
+    return stdext::format("%d items: serial %d us, parallel %d us, %s draw queues", (int)queues[0]->size(), (int)time[0], (int)time[1],
+                          identical ? "identical" : "different");
+}
+
+std::string MapView::getLightStats()
+{
+    return LightView::getStats();
+}
+
+int MapView::getLightMapCount(bool gpu)
+{
+    return LightView::getLightMapCount(gpu);
+}
+
+std::string MapView::getTilesCacheStats()
+{
+    return stdext::format("full: %d, incremental: %d", (int)m_fullTilesCacheUpdates, (int)m_incrementalTilesCacheUpdates);
 }
 
 void MapView::updateGeometry(const Size& visibleDimension, const Size& optimizedSize)
@@ -405,12 +611,18 @@ void MapView::updateGeometry(const Size& visibleDimension, const Size& optimized
 
 void MapView::onTileUpdate(const Position& pos)
 {
-    requestVisibleTilesCacheUpdate();
+    if (!m_incrementalTilesCache || m_dirtyTiles.size() >= MAX_DIRTY_TILES) {
+        m_dirtyTiles.clear();
+        requestVisibleTilesCacheUpdate();
+        return;
+    }
+    m_dirtyTiles.push_back(pos);
+    requestVisibleTilesCachePatch();
 }
 
 void MapView::onMapCenterChange(const Position& pos)
 {
-    requestVisibleTilesCacheUpdate();
+    requestVisibleTilesCachePatch();
 }
 
 void MapView::lockFirstVisibleFloor(int firstVisibleFloor)
@@ -452,14 +664,14 @@ void MapView::followCreature(const CreaturePtr& creature)
 {
     m_follow = true;
     m_followingCreature = creature;
-    requestVisibleTilesCacheUpdate();
+    requestVisibleTilesCachePatch();
 }
 
 void MapView::setCameraPosition(const Position& pos)
 {
     m_follow = false;
     m_customCameraPosition = pos;
-    requestVisibleTilesCacheUpdate();
+    requestVisibleTilesCachePatch();
 }
 
 Position MapView::getPosition(const Point& point, const Size& mapSize)
@@ -528,7 +740,7 @@ void MapView::move(int x, int y)
     }
 
     if(requestTilesUpdate)
-        requestVisibleTilesCacheUpdate();
+        requestVisibleTilesCachePatch();
 }
 
 Rect MapView::calcFramebufferSource(const Size& destSize, bool inNextFrame)
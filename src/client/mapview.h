@@ -33,6 +33,10 @@
 // @bindclass
 class MapView : public LuaObject
 {
+    enum {
+        MAX_DIRTY_TILES = 1024 // more tile updates between frames cause full visible tiles cache update
+    };
+
 public:
     MapView();
     ~MapView();
@@ -40,12 +44,22 @@ public:
     void drawMapForeground(const Rect& rect);
 
 private:
-    void drawFloor(short floor, const Position& cameraPosition, const TilePtr& crosshairTile = nullptr);
+    void drawFloor(short floor, const Position& cameraPosition, LightView* lightView, const TilePtr& crosshairTile = nullptr);
+    // draws every floor into own draw queue, then appends them in painter order
+    void drawFloorsParallel(const std::vector<std::pair<short, float>>& floors, const Position& cameraPosition, const TilePtr& crosshairTile);
     void drawTileTexts(const Rect& rect, const Rect& srcRect);
     void drawTileWidget(const Rect& rect, const Rect& srcRect);
     void updateGeometry(const Size& visibleDimension, const Size& optimizedSize);
     void updateVisibleTilesCache();
+    void updateTilesGrid(const Position& cameraPosition, int firstFloor, bool full);
     void requestVisibleTilesCacheUpdate() { m_mustUpdateVisibleTilesCache = true; }
+    // camera has moved or tiles changed, cache can be patched when incremental mode is enabled
+    void requestVisibleTilesCachePatch() {
+        if (m_incrementalTilesCache)
+            m_mustPatchVisibleTilesCache = true;
+        else
+            m_mustUpdateVisibleTilesCache = true;
+    }
 
 protected:
     void onTileUpdate(const Position& pos);
@@ -111,6 +125,21 @@ public:
     bool isAnimating() { return m_animated; }
 
     void setFloorFading(int value) { m_floorFading = value; }
+
+    void setIncrementalTilesCache(bool enable) { m_incrementalTilesCache = enable; requestVisibleTilesCacheUpdate(); }
+    bool isIncrementalTilesCache() { return m_incrementalTilesCache; }
+    std::string getTilesCacheStats();
+
+    void setParallelFloors(bool enable) { m_parallelFloors = enable; }
+    bool isParallelFloors() { return m_parallelFloors; }
+    // draws map background serially and with parallel floors at the same game time and compares draw queues
+    std::string compareParallelFloors(const Rect& rect);
+    void setThreadedLights(bool enable) { m_threadedLights = enable; }
+    bool isThreadedLights() { return m_threadedLights; }
+    void setGpuLights(bool enable) { m_gpuLights = enable; }
+    bool isGpuLights() { return m_gpuLights; }
+    std::string getLightStats();
+    int getLightMapCount(bool gpu);
     void setCrosshair(const std::string& file);
 
     //void setShader(const PainterShaderProgramPtr& shader, float fadein, float fadeout);
@@ -160,6 +189,22 @@ private:
 
     stdext::boolean<true> m_follow;
     std::vector<TilePtr> m_cachedVisibleTiles[Otc::MAX_Z + 1];
+
+    // tiles of every floor indexed by position relative to camera, allows shifting cache on camera move
+    std::vector<TilePtr> m_tilesGrid[Otc::MAX_Z + 1];
+    Position m_tilesGridPosition;
+    Size m_tilesGridDimension;
+    int m_tilesGridFirstFloor = -1;
+    int m_tilesGridLastFloor = -1;
+    std::vector<Position> m_dirtyTiles;
+    TilePtr m_nullTile;
+    bool m_incrementalTilesCache = true;
+    bool m_mustPatchVisibleTilesCache = false;
+    uint64_t m_fullTilesCacheUpdates = 0;
+    uint64_t m_incrementalTilesCacheUpdates = 0;
+    bool m_parallelFloors = false;
+    bool m_threadedLights = false;
+    bool m_gpuLights = false;
     CreaturePtr m_followingCreature;
     Otc::DrawFlags m_drawFlags;
     bool m_drawLight = false;
@@ -96,6 +96,7 @@ void Minimap::clean()
     std::lock_guard<std::mutex> lock(m_lock);
     for(int i=0;i<=Otc::MAX_Z;++i)
         m_tileBlocks[i].clear();
+    m_version += 1;
 }
 
 void Minimap::draw(const Rect& screenRect, const Position& mapCenter, float scale, const Color& color)
@@ -220,20 +221,6 @@ const MinimapTile& Minimap::getTile(const Position& pos)
     return nulltile;
 }
 
-std::pair<MinimapBlock_ptr, MinimapTile> Minimap::threadGetTile(const Position& pos) {
-    std::lock_guard<std::mutex> lock(m_lock);
-    static MinimapTile nulltile;
-    
-    if (pos.z <= Otc::MAX_Z && hasBlock(pos)) {
-        MinimapBlock_ptr block = m_tileBlocks[pos.z][getBlockIndex(pos)];
-        if (block) {
-            Point offsetPos = getBlockOffset(Point(pos.x, pos.y));
-            return std::make_pair(block, block->getTile(pos.x - offsetPos.x, pos.y - offsetPos.y));
-        }
-    }
-    return std::make_pair(nullptr, nulltile);
-}
-
 bool Minimap::loadImage(const std::string& fileName, const Position& topLeft, float colorFactor)
 {
     if(colorFactor <= 0.01f)
@@ -303,6 +290,7 @@ bool Minimap::loadImage(const std::string& fileName, const Position& topLeft, fl
                 }
             }
         }
+        m_version += 1;
         return true;
     } catch(stdext::exception& e) {
         g_logger.error(stdext::format("failed to load OTMM minimap: %s", e.what()));
@@ -369,6 +357,7 @@ bool Minimap::loadOtmm(const std::string& fileName)
         }
 
         fin->close();
+        m_version += 1;
         return true;
     } catch(stdext::exception& e) {
         g_logger.error(stdext::format("failed to load OTMM minimap: %s", e.what()));
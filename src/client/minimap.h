@@ -94,7 +94,13 @@ public:
 
     void updateTile(const Position& pos, const TilePtr& tile);
     const MinimapTile& getTile(const Position& pos);
-    std::pair<MinimapBlock_ptr, MinimapTile> threadGetTile(const Position& pos);
+    // returns nullptr when block doesn't exist, doesn't create it
+    MinimapBlock* findBlock(const Position& pos) {
+        auto it = m_tileBlocks[pos.z].find(getBlockIndex(pos));
+        return it != m_tileBlocks[pos.z].end() ? it->second.get() : nullptr;
+    }
+    // changed when whole minimap is cleaned or loaded, single tiles are updated by map
+    uint32 getVersion() { return m_version; }
 
     bool loadImage(const std::string& fileName, const Position& topLeft, float colorFactor);
     void saveImage(const std::string& fileName, const Rect& mapRect);
@@ -118,6 +124,7 @@ private:
     uint getBlockIndex(const Position& pos) { return ((pos.y / MMBLOCK_SIZE) * (65536 / MMBLOCK_SIZE)) + (pos.x / MMBLOCK_SIZE); }
     std::unordered_map<uint, MinimapBlock_ptr> m_tileBlocks[Otc::MAX_Z+1];
     std::mutex m_lock;
+    uint32 m_version = 0;
 };
 
 extern Minimap g_minimap;
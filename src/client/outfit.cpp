@@ -299,8 +299,7 @@ void Outfit::draw(Point dest, Otc::Direction direction, uint walkAnimationPhase,
                     continue;
                 if (yPattern == 0)
                     center = outfitParams->dest.center();
-                DrawQueueItemTexturedRect* outfit = new DrawQueueItemOutfitWithShader(outfitParams->dest, outfitParams->texture, outfitParams->src, outfitParams->offset, center, 0, m_shader, m_center);
-                g_drawQueue->add(outfit);
+                g_drawQueue->emplace<DrawQueueItemOutfitWithShader>(outfitParams->dest, outfitParams->texture, outfitParams->src, outfitParams->offset, center, 0, m_shader, m_center);
                 continue;
             }
             type->draw(dest, 0, direction, yPattern, zPattern, animationPhase, Color::white, lightView);
@@ -312,15 +311,13 @@ void Outfit::draw(Point dest, Otc::Direction direction, uint walkAnimationPhase,
         if (!outfitParams)
             continue;
 
-        DrawQueueItemTexturedRect* outfit = nullptr;
         if (m_shader.empty())
-            outfit = new DrawQueueItemOutfit(outfitParams->dest, outfitParams->texture, outfitParams->src, outfitParams->offset, colors, outfitParams->color, m_center);
+            g_drawQueue->emplace<DrawQueueItemOutfit>(outfitParams->dest, outfitParams->texture, outfitParams->src, outfitParams->offset, colors, outfitParams->color, m_center);
         else {
             if (yPattern == 0)
                 center = outfitParams->dest.center();
-            outfit = new DrawQueueItemOutfitWithShader(outfitParams->dest, outfitParams->texture, outfitParams->src, outfitParams->offset, center, colors, m_shader, m_center);
+            g_drawQueue->emplace<DrawQueueItemOutfitWithShader>(outfitParams->dest, outfitParams->texture, outfitParams->src, outfitParams->offset, center, colors, m_shader, m_center);
         }
-        g_drawQueue->add(outfit);
     }
 
     if (m_wings && (direction == Otc::North || direction == Otc::West)) {
@@ -409,8 +406,10 @@ bool DrawQueueItemOutfit::cache()
         (((uint64_t)m_src.height())) +
         (((uint64_t)m_colors) * 1125899906842597ULL);
     bool drawNow = false;
-    Point atlasPos = g_atlas.cache(hash, m_src.size(), drawNow);
+    int page = 0;
+    Point atlasPos = g_atlas.cache(hash, m_src.size(), drawNow, page);
     if (atlasPos.x < 0) { return false; } // can't be cached
+    g_drawCache.setPage(page);
     if (drawNow) { g_drawCache.bind(); draw(atlasPos); }
 
     if (!g_drawCache.hasSpace(6))
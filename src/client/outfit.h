@@ -90,6 +90,12 @@ struct DrawQueueItemOutfit : public DrawQueueItemTexturedRect {
     void draw() override;
     void draw(const Point& pos) override;
     bool cache() override;
+    bool getBatchInfo(Rect& bounds, uint64_t& key) override
+    {
+        bounds = m_dest;
+        key = DrawQueue::ATLAS_BATCH_KEY;
+        return true;
+    }
 
     Point m_offset;
     int32_t m_colors;
@@ -108,6 +114,12 @@ struct DrawQueueItemOutfitWithShader : public DrawQueueItemTexturedRect {
     {
         return false;
     }
+    bool getBatchInfo(Rect& bounds, uint64_t& key) override
+    {
+        bounds = m_dest;
+        key = DrawQueue::shaderBatchKey(m_shader, m_texture);
+        return true;
+    }
 
     Point m_offset;
     Point m_center;
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2010-2017 OTClient <https://github.com/edubart/otclient>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "pathfinder.h"
+
+#include <algorithm>
+#include <functional>
+
+PathFinder& PathFinder::getInstance()
+{
+    thread_local PathFinder instance;
+    return instance;
+}
+
+void PathFinder::reset(int z)
+{
+    m_z = z;
+    m_nodes = 0;
+    m_usedPages = 0;
+    m_lastPageKey = 0xFFFFFFFF;
+    m_heap.clear();
+
+    if (m_pages.size() > MAX_CACHED_PAGES)
+        m_pages.resize(MAX_CACHED_PAGES);
+    if (m_pageTable.empty()) {
+        m_pageTable.resize(64, PageSlot{ 0, 0, 0 });
+        m_pageTableShift = 32 - 6;
+    }
+
+    if (++m_generation == 0) {
+        // stamps wrapped around, old nodes could look valid
+        for (auto& page : m_pages) {
+            for (Node& node : page->nodes)
+                node.generation = 0;
+        }
+        for (PageSlot& slot : m_pageTable)
+            slot.generation = 0;
+        m_generation = 1;
+    }
+}
+
+uint32 PathFinder::findPage(uint32 key)
+{
+    size_t mask = m_pageTable.size() - 1;
+    size_t i = pageSlot(key);
+    for (; m_pageTable[i].generation == m_generation; i = (i + 1) & mask) {
+        if (m_pageTable[i].key == key) {
+            m_lastPageKey = key;
+            m_lastPage = m_pageTable[i].page;
+            return m_lastPage;
+        }
+    }
+
+    if ((m_usedPages + 1) * 2 > m_pageTable.size()) {
+        growPageTable();
+        return findPage(key);
+    }
+
+    if (m_usedPages == m_pages.size())
+        m_pages.emplace_back(new Page);
+    Page& page = *m_pages[m_usedPages];
+    page.x = (key >> 16) << PAGE_BITS;
+    page.y = (key & 0xFFFF) << PAGE_BITS;
+    // nodes of reused page have older generation, so they're reset on first use
+    m_pageTable[i] = PageSlot{ key, m_usedPages, m_generation };
+    m_lastPageKey = key;
+    m_lastPage = m_usedPages++;
+    return m_lastPage;
+}
+
+void PathFinder::growPageTable()
+{
+    std::vector<PageSlot> pageTable(m_pageTable.size() * 2, PageSlot{ 0, 0, 0 });
+    pageTable.swap(m_pageTable);
+    m_pageTableShift -= 1;
+
+    size_t mask = m_pageTable.size() - 1;
+    for (const PageSlot& slot : pageTable) {
+        if (slot.generation != m_generation)
+            continue;
+        size_t i = pageSlot(slot.key);
+        while (m_pageTable[i].generation == m_generation)
+            i = (i + 1) & mask;
+        m_pageTable[i] = slot;
+    }
+}
+
+void PathFinder::push(uint32 index, float key)
+{
+    m_heap.push_back(std::make_pair(key, index));
+    std::push_heap(m_heap.begin(), m_heap.end(), std::greater<std::pair<float, uint32>>());
+}
+
+bool PathFinder::pop(uint32& index, float& key)
+{
+    if (m_heap.empty())
+        return false;
+    std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<std::pair<float, uint32>>());
+    key = m_heap.back().first;
+    index = m_heap.back().second;
+    m_heap.pop_back();
+    return true;
+}
+
+const PathSnapshot::Cell& PathSnapshot::getCell(const Position& pos) const
+{
+    static const Cell unknownCell = { 100, 0 };
+    if(pos.z != m_z || pos.x < 0 || pos.y < 0 || pos.x >= 65536 || pos.y >= 65536)
+        return unknownCell;
+    auto it = m_chunks.find(getChunkIndex(pos));
+    if(it == m_chunks.end())
+        return unknownCell;
+    return (*it->second)[getCellIndex(pos)];
+}
+
+PathSnapshot::ChunkPtr PathSnapshot::getChunk(uint index) const
+{
+    auto it = m_chunks.find(index);
+    if(it == m_chunks.end())
+        return nullptr;
+    return it->second;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2010-2017 OTClient <https://github.com/edubart/otclient>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#include "declarations.h"
+#include "position.h"
+
+#include <unordered_map>
+
+// search state shared by Map path finding functions (findPath, newFindPath, findEveryPath),
+// nodes are stored in pages of PAGE_SIZE x PAGE_SIZE positions, pages and heap are kept between
+// searches and invalidated by generation stamps, so search doesn't allocate after warm up
+class PathFinder
+{
+public:
+    enum {
+        PAGE_BITS = 5,
+        PAGE_SIZE = 1 << PAGE_BITS,
+        PAGE_NODES = PAGE_SIZE * PAGE_SIZE,
+        MAX_CACHED_PAGES = 128 // pages kept by thread after big search
+    };
+
+    enum NodeState : uint8 {
+        NodeUnknown = 0, // tile wasn't checked yet in current search
+        NodeBlocked,
+        NodeWalkable
+    };
+
+    static const uint32 NO_NODE = 0xFFFFFFFF;
+
+    struct Node {
+        float cost;
+        float totalCost;
+        float speed;
+        uint32 prev;
+        uint32 generation;
+        int distance;
+        int unseen;
+        Otc::Direction dir;
+        NodeState state;
+    };
+
+    // every thread has own instance, async path finding runs on many threads
+    static PathFinder& getInstance();
+
+    // starts new search on floor z, invalidates all nodes
+    void reset(int z);
+
+    // returns index of node, node is in NodeUnknown state when it's used first time in current search
+    uint32 getNodeIndex(const Position& pos)
+    {
+        uint32 key = ((uint32)(pos.x >> PAGE_BITS) << 16) | (uint32)(pos.y >> PAGE_BITS);
+        uint32 page = key == m_lastPageKey ? m_lastPage : findPage(key);
+        uint32 index = (page << (PAGE_BITS * 2)) | ((pos.y & (PAGE_SIZE - 1)) << PAGE_BITS) | (pos.x & (PAGE_SIZE - 1));
+        Node& node = getNode(index);
+        if (node.generation != m_generation) {
+            node = Node{ 0, 0, 0, NO_NODE, m_generation, 0, 0, Otc::InvalidDirection, NodeUnknown };
+            m_nodes += 1;
+        }
+        return index;
+    }
+    Node& getNode(uint32 index) { return m_pages[index >> (PAGE_BITS * 2)]->nodes[index & (PAGE_NODES - 1)]; }
+    Position getPosition(uint32 index)
+    {
+        const Page& page = *m_pages[index >> (PAGE_BITS * 2)];
+        uint32 local = index & (PAGE_NODES - 1);
+        return Position(page.x + (local & (PAGE_SIZE - 1)), page.y + (local >> PAGE_BITS), m_z);
+    }
+    // nodes used in current search
+    size_t getNodesCount() { return m_nodes; }
+
+    // min heap of nodes, node can be pushed many times, outdated entries must be skipped by caller
+    void push(uint32 index, float key);
+    bool pop(uint32& index, float& key);
+
+private:
+    struct Page {
+        Node nodes[PAGE_NODES];
+        int x;
+        int y;
+    };
+
+    struct PageSlot {
+        uint32 key;
+        uint32 page;
+        uint32 generation;
+    };
+
+    uint32 findPage(uint32 key);
+    void growPageTable();
+    size_t pageSlot(uint32 key) { return (key * 2654435769u) >> m_pageTableShift; }
+
+    std::vector<std::unique_ptr<Page>> m_pages;
+    std::vector<PageSlot> m_pageTable;
+    std::vector<std::pair<float, uint32>> m_heap;
+    uint32 m_usedPages = 0;
+    uint32 m_pageTableShift = 32;
+    uint32 m_generation = 0;
+    uint32 m_lastPageKey = 0xFFFFFFFF;
+    uint32 m_lastPage = 0;
+    size_t m_nodes = 0;
+    int m_z = 0;
+};
+
+
+// immutable walkability and cost grid of single floor made of visible tiles and minimap,
+// created by dispatcher thread and shared by async path searches, so they don't need locks
+// chunks are shared between snapshots, only chunks with changed tiles are created again
+class PathSnapshot
+{
+public:
+    enum {
+        CHUNK_SIZE = 64, // same as minimap block
+        CHUNK_CELLS = CHUNK_SIZE * CHUNK_SIZE,
+        RANGE = 3 // chunks in every direction from central position, more than newFindPath can reach
+    };
+
+    enum CellFlags : uint8 {
+        CellSeen = 1, // minimap knows the tile
+        CellNotPathable = 2, // minimap tile is not walkable, not pathable or empty
+        CellVisible = 4, // tile is in map, speed is ground speed
+        CellBlocked = 8, // visible tile is not walkable or not pathable
+        CellCreature = 16 // visible tile is blocked by creature
+    };
+
+    struct Cell {
+        uint16 speed;
+        uint8 flags;
+    };
+
+    using Chunk = std::array<Cell, CHUNK_CELLS>;
+    using ChunkPtr = std::shared_ptr<const Chunk>;
+
+    PathSnapshot(int z, uint32 version, uint centerChunk) : m_z(z), m_version(version), m_centerChunk(centerChunk) { }
+
+    static uint getChunkIndex(const Position& pos) { return ((pos.y / CHUNK_SIZE) * (65536 / CHUNK_SIZE)) + (pos.x / CHUNK_SIZE); }
+    static uint getCellIndex(const Position& pos) { return ((pos.y % CHUNK_SIZE) * CHUNK_SIZE) + (pos.x % CHUNK_SIZE); }
+
+    // positions outside of snapshot are unknown, like tiles missing in minimap
+    const Cell& getCell(const Position& pos) const;
+
+    ChunkPtr getChunk(uint index) const;
+    void setChunk(uint index, const ChunkPtr& chunk) { m_chunks[index] = chunk; }
+    size_t getChunksCount() const { return m_chunks.size(); }
+
+    int getZ() const { return m_z; }
+    uint32 getVersion() const { return m_version; }
+    uint getCenterChunk() const { return m_centerChunk; }
+
+private:
+    std::unordered_map<uint, ChunkPtr> m_chunks;
+    int m_z;
+    uint32 m_version;
+    uint m_centerChunk;
+};
+
+#endif
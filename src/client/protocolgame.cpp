@@ -55,6 +55,8 @@ void ProtocolGame::onConnect()
     if(g_game.getFeature(Otc::GameProtocolChecksum))
         enableChecksum();
 
+    enableCoalescedRecv();
+
     if(!g_game.getFeature(Otc::GameChallengeOnLogin))
         sendLoginPacket(0, 0);
 
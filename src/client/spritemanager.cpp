@@ -27,7 +27,8 @@
 #include <framework/graphics/image.h>
 #include <framework/graphics/atlas.h>
 #include <framework/util/crypt.h>
-#include <framework/util/pngunpacker.h>
+#include <framework/platform/platform.h>
+#include <framework/stdext/math.h>
 
 SpriteManager g_sprites;
 
@@ -44,16 +45,12 @@ void SpriteManager::terminate()
 
 bool SpriteManager::loadSpr(std::string file)
 {
-    m_spritesCount = 0;
-    m_signature = 0;
+    unload();
     m_loaded = false;
-    m_sprites.clear();
 
     auto cwmFile = g_resources.guessFilePath(file, "cwm");
-    if (g_resources.fileExists(cwmFile)) {
-        m_isHdMod = true;
+    if (g_resources.fileExists(cwmFile))
         return loadCwmSpr(cwmFile);
-    }
 
     auto sprFile = g_resources.guessFilePath(file, "spr");
     if (g_resources.fileExists(sprFile)) {
@@ -69,7 +66,8 @@ void SpriteManager::saveSpr(std::string fileName)
 {
     if (!m_loaded)
         stdext::throw_exception("failed to save, spr is not loaded");
-    if (!m_spritesFile)
+    SpriteStorePtr store = std::atomic_load(&m_store);
+    if (!store || store->hdMod || store->encrypted)
         stdext::throw_exception("not allowed");
 
     try {
@@ -77,35 +75,32 @@ void SpriteManager::saveSpr(std::string fileName)
         if (!fin)
             stdext::throw_exception(stdext::format("failed to open file '%s' for write", fileName));
 
-        fin->addU32(m_signature);
+        fin->addU32(store->signature);
         if (g_game.getFeature(Otc::GameSpritesU32))
-            fin->addU32(m_spritesCount);
+            fin->addU32(store->spritesCount);
         else
-            fin->addU16(m_spritesCount);
+            fin->addU16(store->spritesCount);
 
         uint32 offset = fin->tell();
-        uint32 spriteAddress = offset + 4 * m_spritesCount;
-        for (int i = 1; i <= m_spritesCount; i++)
+        uint32 spriteAddress = offset + 4 * store->spritesCount;
+        for (int i = 1; i <= store->spritesCount; i++)
             fin->addU32(0);
 
-        for (int i = 1; i <= m_spritesCount; i++) {
-            m_spritesFile->seek((i - 1) * 4 + m_spritesOffset);
-            uint32 fromAdress = m_spritesFile->getU32();
-            if (fromAdress != 0) {
+        for (int i = 1; i <= store->spritesCount; i++) {
+            uint32 fromAdress = stdext::readULE32(store->data + (i - 1) * 4 + store->spritesOffset);
+            if (fromAdress != 0 && fromAdress + 5 <= store->size) {
                 fin->seek(offset + (i - 1) * 4);
                 fin->addU32(spriteAddress);
                 fin->seek(spriteAddress);
 
-                m_spritesFile->seek(fromAdress);
-                fin->addU8(m_spritesFile->getU8());
-                fin->addU8(m_spritesFile->getU8());
-                fin->addU8(m_spritesFile->getU8());
+                const uint8* from = store->data + fromAdress;
+                fin->addU8(from[0]);
+                fin->addU8(from[1]);
+                fin->addU8(from[2]);
 
-                uint16 dataSize = m_spritesFile->getU16();
+                uint16 dataSize = std::min<size_t>(stdext::readULE16(from + 3), store->size - fromAdress - 5);
                 fin->addU16(dataSize);
-                std::vector<char> spriteData(m_spriteSize * m_spriteSize);
-                m_spritesFile->read(spriteData.data(), dataSize);
-                fin->write(spriteData.data(), dataSize);
+                fin->write(from + 5, dataSize);
 
                 spriteAddress = fin->tell();
             }
@@ -123,7 +118,7 @@ void SpriteManager::saveSpr64(std::string fileName)
 {
     if (!m_loaded)
         stdext::throw_exception("failed to save, spr is not loaded");
-    if (!m_spritesFile || m_spriteSize != 32)
+    if (isHdMod() || m_spriteSize != 32)
         stdext::throw_exception("not allowed");
 
     try {
@@ -298,47 +293,178 @@ void SpriteManager::unload()
 {
     m_spritesCount = 0;
     m_signature = 0;
-    m_spritesFile = nullptr;
-    m_sprites.clear();
+    m_loaded = false;
+    std::atomic_store(&m_store, SpriteStorePtr()); // released when last reader is done with it
+}
+
+void SpriteManager::setStore(const SpriteStorePtr& store)
+{
+    std::atomic_store(&m_store, store);
+    m_signature = store->signature;
+    m_spritesCount = store->spritesCount;
+    m_spriteSize = store->spriteSize;
+    m_loaded = true;
+}
+
+bool SpriteManager::isHdMod() const
+{
+    SpriteStorePtr store = std::atomic_load(&m_store);
+    return store && store->hdMod;
 }
 
 ImagePtr SpriteManager::getSpriteImage(int id)
 {
-    if (m_isHdMod) {
-        return getSpriteImageHd(id);
+    // textures are built by async dispatcher too, so keep own reference of current store
+    SpriteStorePtr store = std::atomic_load(&m_store);
+    if (!store || id <= 0)
+        return nullptr;
+
+    size_t budget = m_cacheBudget / CACHE_SHARDS;
+    if (budget == 0)
+        return decodeSpriteImage(store, id);
+
+    CacheShard& shard = store->cache[id % CACHE_SHARDS];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(id);
+        if (it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            m_cacheHits += 1;
+            return it->second->second;
+        }
     }
-    else {
-        return getSpriteImageCasual(id);
+
+    m_cacheMisses += 1;
+    ImagePtr image = decodeSpriteImage(store, id); // decoded without lock, other thread may do the same
+    if (!image)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.index.find(id) != shard.index.end())
+        return image;
+    shard.entries.emplace_front(id, image);
+    shard.index[id] = shard.entries.begin();
+    shard.bytes += image->getPixels().size();
+    while (shard.bytes > budget && shard.entries.size() > 1) {
+        auto& last = shard.entries.back();
+        shard.bytes -= last.second->getPixels().size();
+        shard.index.erase(last.first);
+        shard.entries.pop_back();
+        m_cacheEvictions += 1;
+    }
+    return image;
+}
+
+ImagePtr SpriteManager::decodeSpriteImage(const SpriteStorePtr& store, int id)
+{
+    try {
+        if (store->hdMod)
+            return getSpriteImageHd(store, id);
+        if (store->encrypted)
+            return getSpriteImageEncrypted(store, id);
+        return getSpriteImageCasual(store, id);
+    } catch (stdext::exception& e) {
+        g_logger.error(stdext::format("Failed to get sprite id %d: %s", id, e.what()));
+        return nullptr;
+    }
+}
+
+std::string SpriteManager::benchmarkKernels(int count, int iterations)
+{
+    SpriteStorePtr store = std::atomic_load(&m_store);
+    if (!store || store->spritesCount <= 0)
+        return "sprites not loaded";
+
+    // decoded directly, benchmark shouldn't change sprites cache
+    count = std::max<int>(1, std::min<int>(count, store->spritesCount));
+    std::vector<ImagePtr> images;
+    for (int i = 0; i < count; ++i) {
+        int id = 1 + (int)((int64_t)i * store->spritesCount / count);
+        if (ImagePtr image = decodeSpriteImage(store, id))
+            images.push_back(image);
+    }
+    return stdext::format("sprites: %d, ", (int)images.size()) + Image::benchmarkKernelsOnImages(images, iterations);
+}
+
+std::string SpriteManager::getCacheStats()
+{
+    size_t bytes = 0, entries = 0;
+    if (SpriteStorePtr store = std::atomic_load(&m_store)) {
+        for (auto& shard : store->cache) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            bytes += shard.bytes;
+            entries += shard.entries.size();
+        }
+    }
+    uint64_t lookups = std::max<uint64_t>(1, m_cacheHits + m_cacheMisses);
+    std::stringstream ss;
+    ss << "Sprites: " << entries << " (" << bytes / 1024 << "/" << m_cacheBudget / 1024 << " KB)"
+       << " | hit rate: " << (m_cacheHits * 100) / lookups << "% | misses: " << m_cacheMisses << " | evictions: " << m_cacheEvictions;
+    return ss.str();
+}
+
+SpriteManager::SpriteStore::~SpriteStore()
+{
+    if (mapped)
+        g_platform.unmapFile(data, size);
+}
+
+SpriteManager::SpriteStorePtr SpriteManager::openStore(const std::string& file)
+{
+    SpriteStorePtr store = std::make_shared<SpriteStore>();
+    std::string realPath = g_resources.getRealPath(file);
+    if (!realPath.empty())
+        store->data = g_platform.mapFile(realPath, store->size);
+
+    if (store->data) {
+        store->mapped = true;
+    } else { // packed in archive or encrypted
+        store->buffer = g_resources.readFileContents(file);
+        store->data = (const uint8*)store->buffer.data();
+        store->size = store->buffer.size();
     }
+    return store;
 }
 
 bool SpriteManager::loadCasualSpr(std::string file)
 {
-    m_spriteSize = 32u;
     try {
         file = g_resources.guessFilePath(file, "spr");
-
-        m_spritesFile = g_resources.openFile(file, g_game.getFeature(Otc::GameDontCacheFiles));
-
-        m_signature = m_spritesFile->getU32();
-        if (m_signature == *((uint32_t*)"OTV8")) {
-            m_signature = m_spritesFile->getU32();
-            m_spritesCount = m_spritesFile->getU32();
-            m_sprites.resize(m_spritesCount + 1);
-            for (int i = 1; i <= m_spritesCount; ++i) {
-                int bufferSize = m_spritesFile->getU16();
-                if (bufferSize == 0) continue;
-                m_sprites[i].resize(bufferSize + 1);
-                m_sprites[i][0] = 0;
-                m_spritesFile->read(m_sprites[i].data() + 1, bufferSize);
+        SpriteStorePtr store = openStore(file);
+        if (store->size < 8)
+            stdext::throw_exception("invalid file size");
+
+        const uint8* data = store->data;
+        store->signature = stdext::readULE32(data);
+        if (store->signature == *((uint32_t*)"OTV8")) {
+            if (store->size < 12)
+                stdext::throw_exception("invalid file size");
+            store->encrypted = true;
+            store->signature = stdext::readULE32(data + 4);
+            store->spritesCount = stdext::readULE32(data + 8);
+
+            // sizes are stored before every sprite, so offsets must be collected once
+            store->entries.resize(store->spritesCount + 1);
+            size_t pos = 12;
+            for (int i = 1; i <= store->spritesCount; ++i) {
+                if (pos + 2 > store->size)
+                    stdext::throw_exception("unexpected end of file");
+                uint32 bufferSize = stdext::readULE16(data + pos);
+                pos += 2;
+                if (pos + bufferSize > store->size)
+                    stdext::throw_exception("unexpected end of file");
+                store->entries[i] = std::make_pair((uint32)pos, bufferSize);
+                pos += bufferSize;
             }
-            m_spritesFile = nullptr;
         }
         else {
-            m_spritesCount = g_game.getFeature(Otc::GameSpritesU32) ? m_spritesFile->getU32() : m_spritesFile->getU16();
-            m_spritesOffset = m_spritesFile->tell();
+            bool u32 = g_game.getFeature(Otc::GameSpritesU32);
+            store->spritesCount = u32 ? stdext::readULE32(data + 4) : stdext::readULE16(data + 4);
+            store->spritesOffset = u32 ? 8 : 6;
+            if (store->spritesOffset + (size_t)store->spritesCount * 4 > store->size)
+                stdext::throw_exception("unexpected end of file");
         }
-        m_loaded = true;
+        setStore(store);
         g_lua.callGlobalField("g_sprites", "onLoadSpr", file);
         return true;
     }
@@ -352,27 +478,69 @@ bool SpriteManager::loadCwmSpr(std::string file)
 {
     try {
         auto inFilePath = g_resources.guessFilePath(file, "cwm");
-        auto spritesFile = g_resources.openFile(inFilePath, g_game.getFeature(Otc::GameDontCacheFiles));
+        SpriteStorePtr store = openStore(inFilePath);
+        const uint8* data = store->data;
+        if (store->size < 7)
+            stdext::throw_exception("invalid file size");
 
-        uint8_t version = spritesFile->getU8();
+        uint8_t version = data[0];
         if (version != 0x01) {
             g_logger.error(stdext::format("Invalid CWM file version - %s", file));
             return false;
         }
 
-        m_spriteSize = spritesFile->getU16();
-        m_cachedData = std::move(PngUnpacker::unpack(spritesFile));
-        m_spritesCount = m_cachedData.size();
+        store->hdMod = true;
+        store->spriteSize = stdext::readULE16(data + 1);
+
+        // entries metadata (offset, size, file name which is sprite id) followed by png files
+        uint32 entries = stdext::readULE32(data + 3);
+        if (entries > (store->size - 7) / 10)
+            stdext::throw_exception("invalid entries count");
+        std::vector<std::pair<uint32, std::pair<uint32, uint32>>> metadata;
+        metadata.reserve(entries);
+        size_t pos = 7;
+        uint32 maxId = 0;
+        for (uint32 i = 0; i < entries; ++i) {
+            if (pos + 10 > store->size)
+                stdext::throw_exception("unexpected end of file");
+            uint32 offset = stdext::readULE32(data + pos);
+            uint32 size = stdext::readULE32(data + pos + 4);
+            uint16 nameLength = stdext::readULE16(data + pos + 8);
+            pos += 10;
+            if (pos + nameLength > store->size)
+                stdext::throw_exception("unexpected end of file");
+            // file name is sprite id, optionally followed by extension
+            uint32 id = 0;
+            uint16 digits = 0;
+            while (digits < nameLength && isdigit(data[pos + digits]) && id <= MAX_CWM_SPRITE_ID)
+                id = id * 10 + (data[pos + digits++] - '0');
+            if (digits == 0 || id == 0 || id > MAX_CWM_SPRITE_ID)
+                stdext::throw_exception(stdext::format("invalid sprite file name '%s'", std::string((const char*)data + pos, nameLength)));
+            pos += nameLength;
+            metadata.emplace_back(id, std::make_pair(offset, size));
+            maxId = std::max(maxId, id);
+        }
+
+        store->entries.resize(maxId + 1);
+        for (auto& it : metadata) {
+            auto& entry = store->entries[it.first];
+            if (entry.second != 0)
+                continue; // duplicated
+            if (pos + it.second.first + it.second.second > store->size)
+                stdext::throw_exception("unexpected end of file");
+            entry = std::make_pair((uint32)(pos + it.second.first), it.second.second);
+            store->spritesCount += 1;
+        }
 
-        if (m_spritesCount == 0) {
+        if (store->spritesCount == 0) {
             g_logger.error(stdext::format("Failed to load sprites from '%s' - no sprites", file));
             return false;
         }
 
-        m_loaded = true;
+        setStore(store);
         return true;
     }
-    catch (stdext::exception& e) {
+    catch (std::exception& e) {
         g_logger.error(stdext::format("Failed to load sprites from '%s': %s", file, e.what()));
         return false;
     }
@@ -380,128 +548,126 @@ bool SpriteManager::loadCwmSpr(std::string file)
     return false;
 }
 
-ImagePtr SpriteManager::getSpriteImageCasual(int id)
+ImagePtr SpriteManager::getSpriteImageEncrypted(const SpriteStorePtr& store, int id)
 {
-    try {
-        int spriteDataSize = m_spriteSize * m_spriteSize * 4;
-
-        if (!m_sprites.empty()) {
-            if (id >= (int)m_sprites.size())
-                return nullptr;
-            auto& buffer = m_sprites[id];
-            if (buffer.size() < 5)
-                return nullptr;
-            if (buffer[0] == 0) {
-                buffer[0] = 1;
-                g_crypt.bdecrypt(buffer.data() + 1, buffer.size() - 1, (uint64_t)m_signature + id);
-            }
-
-            if (buffer[1] > 1) {
-                stdext::throw_exception("Invalid sprite encryption");
-            }
-
-            bool hasAlpha = (buffer[1] == 1);
+    if (id >= (int)store->entries.size())
+        return nullptr;
 
-            ImagePtr image(new Image(Size(m_spriteSize, m_spriteSize)));
-            uint8* pixels = image->getPixelData();
-            int writePos = 0;
+    const auto& entry = store->entries[id];
+    if (entry.second < 4)
+        return nullptr;
 
-            size_t bufferPos = 2;
-            while (bufferPos != buffer.size()) {
-                uint16_t transparentPixels = *(uint16_t*)(&buffer[bufferPos]);
-                bufferPos += 2;
-                uint16_t coloredPixels = *(uint16_t*)(&buffer[bufferPos]);
-                bufferPos += 2;
+    // store is read only, so every sprite is decrypted into own buffer
+    thread_local std::vector<uint8_t> buffer;
+    buffer.assign(store->data + entry.first, store->data + entry.first + entry.second);
+    g_crypt.bdecrypt(buffer.data(), buffer.size(), (uint64_t)store->signature + id);
 
-                writePos += transparentPixels * 4;
-                for (int i = 0; i < coloredPixels; ++i) {
-                    pixels[writePos++] = buffer[bufferPos++];
-                    pixels[writePos++] = buffer[bufferPos++];
-                    pixels[writePos++] = buffer[bufferPos++];
-                    if (hasAlpha) {
-                        pixels[writePos] = buffer[bufferPos++];
-                    }
-                    else {
-                        pixels[writePos] = 0xFF;
-                    }
-                    writePos += 1;
-                }
-            }
+    if (buffer[0] > 1) {
+        stdext::throw_exception("Invalid sprite encryption");
+    }
 
-            return image;
+    bool hasAlpha = (buffer[0] == 1);
+    int spriteDataSize = store->spriteSize * store->spriteSize * 4;
+
+    ImagePtr image(new Image(Size(store->spriteSize, store->spriteSize)));
+    uint8* pixels = image->getPixelData();
+    int writePos = 0;
+    int pixelSize = hasAlpha ? 4 : 3;
+
+    size_t bufferPos = 1;
+    while (bufferPos + 4 <= buffer.size()) {
+        uint16_t transparentPixels = stdext::readULE16(&buffer[bufferPos]);
+        uint16_t coloredPixels = stdext::readULE16(&buffer[bufferPos + 2]);
+        bufferPos += 4;
+
+        writePos += transparentPixels * 4;
+        if (writePos + coloredPixels * 4 > spriteDataSize || bufferPos + coloredPixels * pixelSize > buffer.size())
+            stdext::throw_exception("Invalid sprite data");
+
+        for (int i = 0; i < coloredPixels; ++i) {
+            pixels[writePos++] = buffer[bufferPos++];
+            pixels[writePos++] = buffer[bufferPos++];
+            pixels[writePos++] = buffer[bufferPos++];
+            pixels[writePos++] = hasAlpha ? buffer[bufferPos++] : 0xFF;
         }
+    }
 
-        if (id == 0 || !m_spritesFile)
-            return nullptr;
-
-        m_spritesFile->seek(((id - 1) * 4) + m_spritesOffset);
-
-        uint32 spriteAddress = m_spritesFile->getU32();
-
-        // no sprite? return an empty texture
-        if (spriteAddress == 0)
-            return nullptr;
-
-        m_spritesFile->seek(spriteAddress);
-
-        // color key
-        m_spritesFile->getU8();
-        m_spritesFile->getU8();
-        m_spritesFile->getU8();
-
-        uint16 pixelDataSize = m_spritesFile->getU16();
-
-        ImagePtr image(new Image(Size(m_spriteSize, m_spriteSize)));
+    return image;
+}
 
-        uint8* pixels = image->getPixelData();
-        int writePos = 0;
-        int read = 0;
-        bool useAlpha = g_game.getFeature(Otc::GameSpritesAlphaChannel);
+ImagePtr SpriteManager::getSpriteImageCasual(const SpriteStorePtr& store, int id)
+{
+    if (id > store->spritesCount)
+        return nullptr;
 
-        // decompress pixels
-        while (read < pixelDataSize && writePos < spriteDataSize) {
-            uint16 transparentPixels = m_spritesFile->getU16();
-            uint16 coloredPixels = m_spritesFile->getU16();
+    const uint8* data = store->data;
+    uint32 spriteAddress = stdext::readULE32(data + ((id - 1) * 4) + store->spritesOffset);
 
-            writePos += transparentPixels * 4;
+    // no sprite? return an empty texture
+    if (spriteAddress == 0)
+        return nullptr;
 
-            if (useAlpha) {
-                m_spritesFile->read(&pixels[writePos], std::min<uint16>(coloredPixels * 4, spriteDataSize - writePos));
-                writePos += coloredPixels * 4;
-                read += 4 + (4 * coloredPixels);
-            }
-            else {
-                for (int i = 0; i < coloredPixels && writePos < spriteDataSize; i++) {
-                    pixels[writePos + 0] = m_spritesFile->getU8();
-                    pixels[writePos + 1] = m_spritesFile->getU8();
-                    pixels[writePos + 2] = m_spritesFile->getU8();
-                    pixels[writePos + 3] = 0xFF;
-                    writePos += 4;
-                }
-                read += 4 + (3 * coloredPixels);
+    // color key and pixel data size
+    if (spriteAddress + 5 > store->size)
+        stdext::throw_exception("Invalid sprite address");
+    uint16 pixelDataSize = stdext::readULE16(data + spriteAddress + 3);
+    if (spriteAddress + 5 + pixelDataSize > store->size)
+        stdext::throw_exception("Invalid sprite data");
+    const uint8* spriteData = data + spriteAddress + 5;
+
+    int spriteDataSize = store->spriteSize * store->spriteSize * 4;
+    ImagePtr image(new Image(Size(store->spriteSize, store->spriteSize)));
+
+    uint8* pixels = image->getPixelData();
+    int writePos = 0;
+    int read = 0;
+    bool useAlpha = g_game.getFeature(Otc::GameSpritesAlphaChannel);
+    int pixelSize = useAlpha ? 4 : 3;
+
+    // decompress pixels
+    while (read + 4 <= pixelDataSize && writePos < spriteDataSize) {
+        uint16 transparentPixels = stdext::readULE16(spriteData + read);
+        uint16 coloredPixels = stdext::readULE16(spriteData + read + 2);
+        read += 4;
+
+        writePos += transparentPixels * 4;
+        // space left in image is counted in rgba pixels, data left in source pixels
+        int count = std::min<int>(coloredPixels, std::min<int>((spriteDataSize - writePos) / 4, (pixelDataSize - read) / pixelSize));
+        if (count <= 0)
+            break;
+
+        if (useAlpha) {
+            memcpy(&pixels[writePos], spriteData + read, count * 4);
+            writePos += count * 4;
+        }
+        else {
+            const uint8* src = spriteData + read;
+            for (int i = 0; i < count; i++) {
+                pixels[writePos + 0] = src[0];
+                pixels[writePos + 1] = src[1];
+                pixels[writePos + 2] = src[2];
+                pixels[writePos + 3] = 0xFF;
+                writePos += 4;
+                src += 3;
             }
         }
-
-        return image;
-    }
-    catch (stdext::exception& e) {
-        g_logger.error(stdext::format("Failed to get sprite id %d: %s", id, e.what()));
-        return nullptr;
+        read += coloredPixels * pixelSize;
     }
+
+    return image;
 }
 
-ImagePtr SpriteManager::getSpriteImageHd(int id)
+ImagePtr SpriteManager::getSpriteImageHd(const SpriteStorePtr& store, int id)
 {
-    if (id == 0 || !m_loaded)
+    if (id >= (int)store->entries.size())
         return nullptr;
 
-    if (m_cachedData.find(id) == m_cachedData.end())
-    {
+    const auto& entry = store->entries[id];
+    if (entry.second == 0)
         return nullptr;
-    }
 
     try {
-        return Image::loadPNG(m_cachedData[id].data(), m_cachedData[id].size());
+        return Image::loadPNG(store->data + entry.first, entry.second);
     } catch (...) {}
     return nullptr;
 }
@@ -26,6 +26,9 @@
 #include "const.h"
 #include <framework/core/declarations.h>
 #include <framework/graphics/declarations.h>
+#include <framework/stdext/thread.h>
+#include <atomic>
+#include <list>
 
 //@bindsingleton g_sprites
 class SpriteManager
@@ -48,28 +51,76 @@ public:
     uint32 getSignature() { return m_signature; }
     int getSpritesCount() { return m_spritesCount; }
 
+    // thread safe, returned images are shared with sprites cache and must not be modified
     ImagePtr getSpriteImage(int id);
     bool isLoaded() { return m_loaded; }
 
     int spriteSize() { return m_spriteSize; }
     float getOffsetFactor() const { return static_cast<float>(m_spriteSize) / 32.0f; }
-    bool isHdMod() const { return m_isHdMod; }
+    bool isHdMod() const;
+
+    // memory limit in bytes for decoded sprites, 0 disables cache
+    void setCacheBudget(int bytes) { m_cacheBudget = std::max<int>(0, bytes); }
+    int getCacheBudget() { return m_cacheBudget; }
+    std::string getCacheStats();
+    // compares image pixel kernels on rows of up to count sprites spread over loaded file
+    std::string benchmarkKernels(int count, int iterations);
 
 private:
+    enum {
+        CACHE_SHARDS = 16,
+        MAX_CWM_SPRITE_ID = 1 << 22 // bounds entries table of corrupted files (32 MB)
+    };
+
+    // lru of decoded sprites, sharded by sprite id to reduce contention between threads
+    struct CacheShard {
+        std::mutex mutex;
+        std::list<std::pair<int, ImagePtr>> entries; // most recently used first
+        std::unordered_map<int, std::list<std::pair<int, ImagePtr>>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    // whole sprites file, mapped from disk when possible, otherwise read into single buffer
+    struct SpriteStore {
+        ~SpriteStore();
+
+        const uint8* data = nullptr;
+        size_t size = 0;
+        bool mapped = false;
+        std::string buffer;
+        uint32 spritesOffset = 0; // offsets table of casual spr
+        std::vector<std::pair<uint32, uint32>> entries; // offset and size of every sprite, otv8 and cwm only
+        // format of this file, decoders must not use manager fields since file can be replaced while they run
+        bool hdMod = false;
+        bool encrypted = false;
+        uint32 signature = 0;
+        int spritesCount = 0;
+        int spriteSize = 32;
+        CacheShard cache[CACHE_SHARDS]; // dies with store, so sprites of unloaded file are never returned
+    };
+    using SpriteStorePtr = std::shared_ptr<SpriteStore>;
+
+    SpriteStorePtr openStore(const std::string& file);
     bool loadCasualSpr(std::string file);
     bool loadCwmSpr(std::string file);
+    void setStore(const SpriteStorePtr& store);
+
+    ImagePtr decodeSpriteImage(const SpriteStorePtr& store, int id);
+    ImagePtr getSpriteImageCasual(const SpriteStorePtr& store, int id);
+    ImagePtr getSpriteImageEncrypted(const SpriteStorePtr& store, int id);
+    ImagePtr getSpriteImageHd(const SpriteStorePtr& store, int id);
 
-    ImagePtr getSpriteImageCasual(int id);
-    ImagePtr getSpriteImageHd(int id);
     bool m_loaded = false;
-    bool m_isHdMod = false;
+    // copies of current store format for main thread and drawing
     uint32 m_signature;
     int m_spritesCount;
-    int m_spritesOffset;
-    int m_spriteSize;
-    FileStreamPtr m_spritesFile;
-    std::vector<std::vector<uint8_t>> m_sprites;
-    std::unordered_map<uint32, std::string> m_cachedData;
+    int m_spriteSize = 32;
+    SpriteStorePtr m_store; // accessed atomically, readers keep their own reference
+
+    std::atomic_int m_cacheBudget = { 64 * 1024 * 1024 };
+    std::atomic<uint64_t> m_cacheHits = { 0 };
+    std::atomic<uint64_t> m_cacheMisses = { 0 };
+    std::atomic<uint64_t> m_cacheEvictions = { 0 };
 };
 
 extern SpriteManager g_sprites;
@@ -24,6 +24,7 @@
 #include "spritemanager.h"
 #include "game.h"
 #include "lightview.h"
+#include "thingtypemanager.h"
 
 #include <framework/graphics/graphics.h>
 #include <framework/graphics/texture.h>
@@ -32,8 +33,13 @@
 #include <framework/graphics/framebuffermanager.h>
 #include <framework/graphics/shadermanager.h>
 #include <framework/core/filestream.h>
+#include <framework/core/asyncdispatcher.h>
 #include <framework/otml/otml.h>
 
+namespace {
+    thread_local ThingType::DeferredTextures* t_deferredTextures = nullptr;
+}
+
 ThingType::ThingType()
 {
     m_category = ThingInvalidCategory;
@@ -393,8 +399,10 @@ void ThingType::unserialize(uint16 clientId, ThingCategory category, const FileS
     m_texturesFramesRects.resize(m_animationPhases);
     m_texturesFramesOriginRects.resize(m_animationPhases);
     m_texturesFramesOffsets.resize(m_animationPhases);
+    m_texturesPending.resize(m_animationPhases);
+    m_texturesUploading.resize(m_animationPhases);
 
-    m_lastUsage = g_clock.seconds();
+    m_lastUsage.store(g_clock.seconds(), std::memory_order_relaxed);
 }
 
 void ThingType::exportImage(std::string fileName)
@@ -496,11 +504,15 @@ void ThingType::unload()
     m_texturesFramesRects.clear();
     m_texturesFramesOriginRects.clear();
     m_texturesFramesOffsets.clear();
+    m_texturesPending.clear(); // results of textures being built are discarded
+    m_texturesUploading.clear();
 
     m_textures.resize(m_animationPhases);
     m_texturesFramesRects.resize(m_animationPhases);
     m_texturesFramesOriginRects.resize(m_animationPhases);
     m_texturesFramesOffsets.resize(m_animationPhases);
+    m_texturesPending.resize(m_animationPhases);
+    m_texturesUploading.resize(m_animationPhases);
 
     m_loaded = false;
 }
@@ -544,7 +556,7 @@ DrawQueueItem* ThingType::draw(const Rect& dest, int layer, int xPattern, int yP
     if (animationPhase < 0 || animationPhase >= m_animationPhases)
         return nullptr;
 
-    const TexturePtr& texture = getTexture(animationPhase); // texture might not exists, neither its rects.
+    const TexturePtr& texture = getTexture(animationPhase, false); // ui items are built synchronously, they would be blank for a frame
     if (!texture)
         return nullptr;
 
@@ -664,8 +676,7 @@ void ThingType::drawWithShader(const Point& dest, int layer, int xPattern, int y
     if (lightView && hasLight())
         lightView->addLight(screenRect.center(), getLight());
 
-    DrawQueueItemTexturedRect* thing = new DrawQueueItemThingWithShader(screenRect, texture, textureRect, textureOffset, screenRect.center(), 0, shader);
-    g_drawQueue->add(thing);
+    g_drawQueue->emplace<DrawQueueItemThingWithShader>(screenRect, texture, textureRect, textureOffset, screenRect.center(), 0, shader);
 
     //return g_drawQueue->addTexturedRect(screenRect, texture, textureRect, color);
 }
@@ -678,7 +689,7 @@ void ThingType::drawWithShader(const Rect& dest, int layer, int xPattern, int yP
     if (animationPhase < 0 || animationPhase >= m_animationPhases)
         return;
 
-    const TexturePtr& texture = getTexture(animationPhase); // texture might not exists, neither its rects.
+    const TexturePtr& texture = getTexture(animationPhase, false); // ui items are built synchronously, they would be blank for a frame
     if (!texture)
         return;
 
@@ -708,93 +719,161 @@ void ThingType::drawWithShader(const Rect& dest, int layer, int xPattern, int yP
     float scale = std::min<float>((float)dest.width() / size.width(), (float)dest.height() / size.height());
 
     Rect screenRect = Rect(dest.topLeft() + (textureOffset * scale), textureRect.size() * scale);
-    DrawQueueItemTexturedRect* thing = new DrawQueueItemThingWithShader(screenRect, texture, textureRect, textureOffset, screenRect.center(), 0, shader);
-    g_drawQueue->add(thing);
+    g_drawQueue->emplace<DrawQueueItemThingWithShader>(screenRect, texture, textureRect, textureOffset, screenRect.center(), 0, shader);
 
     //return g_drawQueue->addTexturedRect(Rect(dest.topLeft() + (textureOffset * scale), textureRect.size() * scale), texture, textureRect, color);
 }
 
-const TexturePtr& ThingType::getTexture(int animationPhase)
+void ThingType::setDeferredTextures(DeferredTextures* deferred)
 {
-    m_lastUsage = g_clock.seconds();
+    t_deferredTextures = deferred;
+}
+
+void ThingType::loadDeferredTextures(DeferredTextures& deferred)
+{
+    for (auto& it : deferred)
+        it.first->getTexture(it.second);
+    deferred.clear();
+}
+
+const TexturePtr& ThingType::getTexture(int animationPhase, bool async)
+{
+    // may be called by many threads at once (parallel floors drawing), but only the first branch then
+    m_lastUsage.store(g_clock.seconds(), std::memory_order_relaxed);
 
-    int spriteSize = g_sprites.spriteSize();
     TexturePtr& animationPhaseTexture = m_textures[animationPhase];
-    if(!animationPhaseTexture) {
-        bool useCustomImage = false; 
-        if(animationPhase == 0 && !m_customImage.empty())
-            useCustomImage = true;
-
-        // we don't need layers in common items, they will be pre-drawn
-        int textureLayers = 1;
-        int numLayers = m_layers;
-        if(m_category == ThingCategoryCreature && numLayers >= 2) {
-            // otcv8 optimization from 5 to 2 layers
-            textureLayers = 2;
-            numLayers = 2;
+    if (animationPhaseTexture)
+        return animationPhaseTexture;
+
+    if (t_deferredTextures && async) {
+        t_deferredTextures->push_back(std::make_pair(static_self_cast<ThingType>(), animationPhase));
+        return animationPhaseTexture;
+    }
+
+    TexturePtr& uploadingTexture = m_texturesUploading[animationPhase];
+    if (uploadingTexture) {
+        // render thread uploads scheduled textures within per frame budget
+        if (async && !uploadingTexture->isUploaded())
+            return animationPhaseTexture;
+        animationPhaseTexture = std::move(uploadingTexture);
+        return animationPhaseTexture;
+    }
+
+    std::shared_future<TextureDataPtr>& pending = m_texturesPending[animationPhase];
+    if (pending.valid()) {
+        if (async && pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return animationPhaseTexture;
+        TextureDataPtr data;
+        try {
+            data = pending.get();
+        } catch (const std::exception& e) {
+            g_logger.error(stdext::format("Failed to build texture of thing %d (phase %d): %s", m_id, animationPhase, e.what()));
         }
+        pending = std::shared_future<TextureDataPtr>();
+        installTexture(animationPhase, data, async);
+        return animationPhaseTexture; // empty until uploaded if async
+    }
 
-        int indexSize = textureLayers * m_numPatternX * m_numPatternY * m_numPatternZ;
-        Size textureSize = getBestTextureDimension(m_size.width(), m_size.height(), indexSize);
-        ImagePtr fullImage;
+    // custom images are loaded from resources which are not thread safe
+    bool useCustomImage = animationPhase == 0 && !m_customImage.empty();
+    if (async && !useCustomImage && g_things.isAsyncTextureLoading()) {
+        ThingTypePtr self = static_self_cast<ThingType>();
+        pending = g_asyncDispatcher.schedule([self, animationPhase] {
+            return self->buildTexture(animationPhase);
+        });
+        return animationPhaseTexture;
+    }
 
-        if(useCustomImage)
-            fullImage = Image::load(m_customImage);
-        else
-            fullImage = ImagePtr(new Image(textureSize * spriteSize));
-
-        m_texturesFramesRects[animationPhase].resize(indexSize);
-        m_texturesFramesOriginRects[animationPhase].resize(indexSize);
-        m_texturesFramesOffsets[animationPhase].resize(indexSize);
-
-        for(int z = 0; z < m_numPatternZ; ++z) {
-            for(int y = 0; y < m_numPatternY; ++y) {
-                for(int x = 0; x < m_numPatternX; ++x) {
-                    for(int l = 0; l < numLayers; ++l) {
-                        bool spriteMask = (m_category == ThingCategoryCreature && l > 0);
-                        int frameIndex = getTextureIndex(l % textureLayers, x, y, z);
-                        Point framePos = Point(frameIndex % (textureSize.width() / m_size.width()) * m_size.width(),
-                                               frameIndex / (textureSize.width() / m_size.width()) * m_size.height()) * spriteSize;
-
-                        if (!useCustomImage) {
-                            for (int h = 0; h < m_size.height(); ++h) {
-                                for (int w = 0; w < m_size.width(); ++w) {
-                                    uint spriteIndex = getSpriteIndex(w, h, spriteMask ? 1 : l, x, y, z, animationPhase);
-                                    ImagePtr spriteImage = g_sprites.getSpriteImage(m_spritesIndex[spriteIndex]);
-                                    if (!spriteImage) {
-                                        continue;
-                                    }
-                                    Point spritePos = Point(m_size.width() - w - 1,
-                                                            m_size.height() - h - 1) * spriteSize;
-                                    fullImage->blit(framePos + spritePos, spriteImage);
-                                }
-                            }
-                        }
+    installTexture(animationPhase, buildTexture(animationPhase));
+    return animationPhaseTexture;
+}
 
-                        Rect drawRect(framePos + Point(m_size.width(), m_size.height()) * spriteSize - Point(1,1), framePos);
-                        for(int x = framePos.x; x < framePos.x + m_size.width() * spriteSize; ++x) {
-                            for(int y = framePos.y; y < framePos.y + m_size.height() * spriteSize; ++y) {
-                                uint8 *p = fullImage->getPixel(x,y);
-                                if(p[3] != 0x00) {
-                                    drawRect.setTop   (std::min<int>(y, (int)drawRect.top()));
-                                    drawRect.setLeft  (std::min<int>(x, (int)drawRect.left()));
-                                    drawRect.setBottom(std::max<int>(y, (int)drawRect.bottom()));
-                                    drawRect.setRight (std::max<int>(x, (int)drawRect.right()));
+ThingType::TextureDataPtr ThingType::buildTexture(int animationPhase)
+{
+    int spriteSize = g_sprites.spriteSize();
+    bool useCustomImage = false;
+    if(animationPhase == 0 && !m_customImage.empty())
+        useCustomImage = true;
+
+    // we don't need layers in common items, they will be pre-drawn
+    int textureLayers = 1;
+    int numLayers = m_layers;
+    if(m_category == ThingCategoryCreature && numLayers >= 2) {
+        // otcv8 optimization from 5 to 2 layers
+        textureLayers = 2;
+        numLayers = 2;
+    }
+
+    int indexSize = textureLayers * m_numPatternX * m_numPatternY * m_numPatternZ;
+    Size textureSize = getBestTextureDimension(m_size.width(), m_size.height(), indexSize);
+    TextureDataPtr data = std::make_shared<TextureData>();
+    ImagePtr& fullImage = data->image;
+
+    if(useCustomImage)
+        fullImage = Image::load(m_customImage);
+    else
+        fullImage = ImagePtr(new Image(textureSize * spriteSize));
+
+    data->framesRects.resize(indexSize);
+    data->framesOriginRects.resize(indexSize);
+    data->framesOffsets.resize(indexSize);
+
+    for(int z = 0; z < m_numPatternZ; ++z) {
+        for(int y = 0; y < m_numPatternY; ++y) {
+            for(int x = 0; x < m_numPatternX; ++x) {
+                for(int l = 0; l < numLayers; ++l) {
+                    bool spriteMask = (m_category == ThingCategoryCreature && l > 0);
+                    int frameIndex = getTextureIndex(l % textureLayers, x, y, z);
+                    Point framePos = Point(frameIndex % (textureSize.width() / m_size.width()) * m_size.width(),
+                                           frameIndex / (textureSize.width() / m_size.width()) * m_size.height()) * spriteSize;
+
+                    if (!useCustomImage) {
+                        for (int h = 0; h < m_size.height(); ++h) {
+                            for (int w = 0; w < m_size.width(); ++w) {
+                                uint spriteIndex = getSpriteIndex(w, h, spriteMask ? 1 : l, x, y, z, animationPhase);
+                                ImagePtr spriteImage = g_sprites.getSpriteImage(m_spritesIndex[spriteIndex]);
+                                if (!spriteImage) {
+                                    continue;
                                 }
+                                Point spritePos = Point(m_size.width() - w - 1,
+                                                        m_size.height() - h - 1) * spriteSize;
+                                fullImage->blit(framePos + spritePos, spriteImage);
                             }
                         }
-
-                        m_texturesFramesRects[animationPhase][frameIndex] = drawRect;
-                        m_texturesFramesOriginRects[animationPhase][frameIndex] = Rect(framePos, Size(m_size.width(), m_size.height()) * spriteSize);// *0.5;
-                        m_texturesFramesOffsets[animationPhase][frameIndex] = (drawRect.topLeft() - framePos);
                     }
+
+                    Rect drawRect = fullImage->getAlphaBounds(Rect(framePos, Size(m_size.width(), m_size.height()) * spriteSize));
+
+                    data->framesRects[frameIndex] = drawRect;
+                    data->framesOriginRects[frameIndex] = Rect(framePos, Size(m_size.width(), m_size.height()) * spriteSize);// *0.5;
+                    data->framesOffsets[frameIndex] = (drawRect.topLeft() - framePos);
                 }
             }
         }
-        animationPhaseTexture = TexturePtr(new Texture(fullImage, true, false, true));
-        m_loaded = true;
     }
-    return animationPhaseTexture;
+    return data;
+}
+
+void ThingType::installTexture(int animationPhase, TextureDataPtr data, bool scheduleUpload)
+{
+    if (!data || !data->image) {
+        // failed build, transparent texture without frames is never drawn nor built again
+        data = std::make_shared<TextureData>();
+        data->image = ImagePtr(new Image(Size(1, 1)));
+        scheduleUpload = false;
+    }
+
+    m_texturesFramesRects[animationPhase] = std::move(data->framesRects);
+    m_texturesFramesOriginRects[animationPhase] = std::move(data->framesOriginRects);
+    m_texturesFramesOffsets[animationPhase] = std::move(data->framesOffsets);
+    TexturePtr texture(new Texture(data->image, true, false, true));
+    if (scheduleUpload) {
+        g_textures.scheduleUpload(texture);
+        m_texturesUploading[animationPhase] = texture;
+    } else {
+        m_textures[animationPhase] = texture;
+    }
+    m_loaded = true;
 }
 
 Size ThingType::getBestTextureDimension(int w, int h, int count)
@@ -855,7 +934,8 @@ int ThingType::getExactSize(int layer, int xPattern, int yPattern, int zPattern,
     if(m_null)
         return 0;
 
-    getTexture(animationPhase); // we must calculate it anyway.
+    if (!getTexture(animationPhase, false)) // we must calculate it anyway.
+        return 0;
     int frameIndex = getTextureIndex(layer, xPattern, yPattern, zPattern);
     Size size = m_texturesFramesOriginRects[animationPhase][frameIndex].size() - m_texturesFramesOffsets[animationPhase][frameIndex].toSize();
     return std::max<int>(size.width(), size.height());
@@ -191,7 +191,12 @@ public:
     bool isNull() { return m_null; }
     bool hasAttr(ThingAttr attr) { return m_attribs.has(attr); }
     bool isLoaded() { return m_loaded; }
-    ticks_t getLastUsage() { return m_lastUsage; }
+    ticks_t getLastUsage() { return m_lastUsage.load(std::memory_order_relaxed); }
+
+    // while set, textures missing on calling thread aren't loaded, only collected for loadDeferredTextures
+    using DeferredTextures = std::vector<std::pair<ThingTypePtr, int>>;
+    static void setDeferredTextures(DeferredTextures* deferred);
+    static void loadDeferredTextures(DeferredTextures& deferred);
 
     Size getSize() { return m_size; }
     int getWidth() { return m_size.width(); }
@@ -267,7 +272,20 @@ public:
     void setPathable(bool var);
 
 private:
-    const TexturePtr& getTexture(int animationPhase);
+    // composed texture of single animation phase, built on async dispatcher thread
+    struct TextureData {
+        ImagePtr image;
+        std::vector<Rect> framesRects;
+        std::vector<Rect> framesOriginRects;
+        std::vector<Point> framesOffsets;
+    };
+    using TextureDataPtr = std::shared_ptr<TextureData>;
+
+    // returns null texture while texture is being built in background, unless async is false
+    const TexturePtr& getTexture(int animationPhase, bool async = true);
+    TextureDataPtr buildTexture(int animationPhase);
+    // async textures are uploaded by render thread before they are published in m_textures
+    void installTexture(int animationPhase, TextureDataPtr data, bool scheduleUpload = false);
     Size getBestTextureDimension(int w, int h, int count);
     uint getSpriteIndex(int w, int h, int l, int x, int y, int z, int a);
     uint getTextureIndex(int l, int x, int y, int z);
@@ -296,9 +314,11 @@ private:
     std::vector<std::vector<Rect>> m_texturesFramesRects;
     std::vector<std::vector<Rect>> m_texturesFramesOriginRects;
     std::vector<std::vector<Point>> m_texturesFramesOffsets;
+    std::vector<std::shared_future<TextureDataPtr>> m_texturesPending;
+    std::vector<TexturePtr> m_texturesUploading;
 
     bool m_loaded = false;
-    time_t m_lastUsage;
+    std::atomic<time_t> m_lastUsage;
 };
 
 struct DrawQueueItemThingWithShader : public DrawQueueItemTexturedRect {
@@ -313,6 +333,12 @@ struct DrawQueueItemThingWithShader : public DrawQueueItemTexturedRect {
     {
         return false;
     }
+    bool getBatchInfo(Rect& bounds, uint64_t& key) override
+    {
+        bounds = m_dest;
+        key = DrawQueue::shaderBatchKey(m_shader, m_texture);
+        return true;
+    }
 
     Point m_offset;
     Point m_center;
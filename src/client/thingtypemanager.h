@@ -92,6 +92,11 @@ public:
     bool isValidDatId(uint16 id, ThingCategory category) { return id >= 1 && id < m_thingTypes[category].size(); }
     bool isValidOtbId(uint16 id) { return id >= 1 && id < m_itemTypes.size(); }
 
+    // when enabled textures of things drawn at a point (map, outfits) are built by async dispatcher and skipped
+    // until uploaded, things drawn into a rect (ui items) stay synchronous, disabled by default
+    void setAsyncTextureLoading(bool value) { m_asyncTextureLoading = value; }
+    bool isAsyncTextureLoading() { return m_asyncTextureLoading; }
+
 private:
     ThingTypeList m_thingTypes[ThingLastCategory];
     ItemTypeList m_reverseItemTypes;
@@ -104,6 +109,7 @@ private:
     bool m_datLoaded;
     bool m_xmlLoaded;
     bool m_otbLoaded;
+    bool m_asyncTextureLoading = false;
 
     uint32 m_otbMinorVersion;
     uint32 m_otbMajorVersion;
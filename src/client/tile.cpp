@@ -323,6 +323,8 @@ void Tile::addThing(const ThingPtr& thing, int stackPos)
             stackPos = m_things.size();
 
         m_things.insert(m_things.begin() + stackPos, thing);
+        if(thing->isCreature())
+            g_map.addCreatureToIndex(m_position);
 
         if(!g_game.getFeature(Otc::GameNewCreatureStacking) && m_things.size() > MAX_THINGS)
             removeThing(m_things[MAX_THINGS]);
@@ -368,6 +370,8 @@ bool Tile::removeThing(ThingPtr thing)
         if(it != m_things.end()) {
             m_things.erase(it);
             removed = true;
+            if(thing->isCreature())
+                g_map.removeCreatureFromIndex(m_position);
         }
     }
 
@@ -65,6 +65,18 @@ public:
     void setMinimumAmbientLight(float intensity) { m_mapView->setMinimumAmbientLight(intensity); }
     void setLimitVisibleRange(bool limitVisibleRange) { m_limitVisibleRange = limitVisibleRange; updateVisibleDimension(); }
     void setFloorFading(int value) { m_mapView->setFloorFading(value); }
+    void setIncrementalTilesCache(bool enable) { m_mapView->setIncrementalTilesCache(enable); }
+    bool isIncrementalTilesCache() { return m_mapView->isIncrementalTilesCache(); }
+    void setParallelFloors(bool enable) { m_mapView->setParallelFloors(enable); }
+    bool isParallelFloors() { return m_mapView->isParallelFloors(); }
+    std::string compareParallelFloors() { return m_mapView->compareParallelFloors(m_mapRect); }
+    void setThreadedLights(bool enable) { m_mapView->setThreadedLights(enable); }
+    bool isThreadedLights() { return m_mapView->isThreadedLights(); }
+    void setGpuLights(bool enable) { m_mapView->setGpuLights(enable); }
+    bool isGpuLights() { return m_mapView->isGpuLights(); }
+    std::string getLightStats() { return m_mapView->getLightStats(); }
+    int getLightMapCount(bool gpu) { return m_mapView->getLightMapCount(gpu); }
+    std::string getTilesCacheStats() { return m_mapView->getTilesCacheStats(); }
     void setCrosshair(const std::string& type) { m_mapView->setCrosshair(type); }
     bool isMultifloor() { return m_mapView->isMultifloor(); }
     bool isDrawingTexts() { return m_mapView->isDrawingTexts(); }
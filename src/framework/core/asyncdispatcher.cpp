@@ -21,24 +21,33 @@
  */
 
 #include "asyncdispatcher.h"
+#include "eventdispatcher.h"
+
+#include <sstream>
 
 AsyncDispatcher g_asyncDispatcher;
 
+namespace {
+    // worker index of current thread, tasks pushed by worker go to its own deque
+    thread_local AsyncDispatcher* currentDispatcher = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
 void AsyncDispatcher::init()
 {
-    spawn_thread();
+    // leave cores for main and dispatcher threads, map floors are drawn by these threads too
+    int threads = std::min<int>(MAX_THREADS, (int)std::thread::hardware_concurrency() - 2);
+    // workers steal from each other, so all of them must exist before first thread starts
+    for (int i = 0; i < std::max<int>(1, threads); ++i)
+        m_workers.push_back(std::make_unique<Worker>());
+    m_running = true;
+    for (size_t i = 0; i < m_workers.size(); ++i)
+        m_workers[i]->thread = std::thread(std::bind(&AsyncDispatcher::exec_loop, this, i));
 }
 
 void AsyncDispatcher::terminate()
 {
     stop();
-    m_tasks.clear();
-}
-
-void AsyncDispatcher::spawn_thread()
-{
-    m_running = true;
-    m_threads.push_back(std::thread(std::bind(&AsyncDispatcher::exec_loop, this)));
 }
 
 void AsyncDispatcher::stop()
@@ -47,25 +56,118 @@ void AsyncDispatcher::stop()
     m_running = false;
     m_condition.notify_all();
     m_mutex.unlock();
-    for(std::thread& thread : m_threads)
-        thread.join();
-    m_threads.clear();
-};
-
-void AsyncDispatcher::exec_loop() {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    while(true) {
-        while(m_tasks.size() == 0 && m_running)
-            m_condition.wait(lock);
+    for (auto& worker : m_workers)
+        worker->thread.join();
+    // not executed tasks are dropped, their futures are broken
+    m_workers.clear();
+    m_pending = 0;
+}
+
+void AsyncDispatcher::push(std::function<void()> task, Priority priority, const AsyncCancelToken* token)
+{
+    if (token) {
+        AsyncCancelToken taskToken = *token;
+        task = [this, taskToken, task]() {
+            if (taskToken.isCanceled()) {
+                m_canceled += 1;
+                return;
+            }
+            task();
+        };
+    }
+
+    size_t index;
+    if (currentDispatcher == this)
+        index = currentWorker;
+    else if (!m_workers.empty())
+        index = m_nextWorker++ % m_workers.size();
+    else {
+        // not initialized or terminated, task is executed by calling thread so its future isn't broken
+        m_executed[priority] += 1;
+        task();
+        return;
+    }
+
+    {
+        Worker& worker = *m_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks[priority].push_back(std::move(task));
+    }
 
-        if(!m_running)
+    // sleeping worker checks pending tasks with m_mutex locked, so notification can't be lost
+    m_pending += 1;
+    if (m_sleeping > 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_condition.notify_one();
+    }
+}
+
+bool AsyncDispatcher::pop(size_t index, std::function<void()>& task)
+{
+    for (int priority = Interactive; priority < PriorityCount; ++priority) {
+        // own tasks from back, they are most likely in cache
+        {
+            Worker& worker = *m_workers[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            auto& tasks = worker.tasks[priority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                m_executed[priority] += 1;
+                return true;
+            }
+        }
+
+        // steal oldest task of other worker
+        for (size_t i = 1; i < m_workers.size(); ++i) {
+            Worker& victim = *m_workers[(index + i) % m_workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            auto& tasks = victim.tasks[priority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                m_executed[priority] += 1;
+                m_stolen += 1;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void AsyncDispatcher::exec_loop(size_t index) {
+    currentDispatcher = this;
+    currentWorker = index;
+
+    std::function<void()> task;
+    while (true) {
+        if (!m_running)
             return;
 
-        std::function<void()> task = m_tasks.front();
-        m_tasks.pop_front();
+        if (pop(index, task)) {
+            m_pending -= 1;
+            task();
+            task = nullptr;
+            continue;
+        }
 
-        lock.unlock();
-        task();
-        lock.lock();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sleeping += 1;
+        while (m_pending <= 0 && m_running)
+            m_condition.wait(lock);
+        m_sleeping -= 1;
     }
 }
+
+void AsyncDispatcher::addDispatcherEvent(const std::function<void()>& callback)
+{
+    g_dispatcher.addEvent(callback);
+}
+
+std::string AsyncDispatcher::getStats()
+{
+    std::stringstream ss;
+    ss << "threads: " << m_workers.size() << ", interactive: " << m_executed[Interactive] << ", background: " << m_executed[Background]
+        << ", stolen: " << m_stolen << ", canceled: " << m_canceled << ", pending: " << m_pending;
+    return ss.str();
+}
@@ -25,39 +25,110 @@
 
 #include "declarations.h"
 #include <framework/stdext/thread.h>
+#include <deque>
+#include <vector>
+
+// shared by task and its owner, canceled tasks and their continuations are skipped
+class AsyncCancelToken {
+public:
+    AsyncCancelToken() : m_canceled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { *m_canceled = true; }
+    bool isCanceled() const { return *m_canceled; }
+
+private:
+    std::shared_ptr<std::atomic<bool>> m_canceled;
+};
 
 class AsyncDispatcher {
 public:
+    enum {
+        MAX_THREADS = 4
+    };
+
+    // interactive tasks (drawing, path finding) are taken before background ones (files, screenshots)
+    enum Priority {
+        Interactive = 0,
+        Background,
+        PriorityCount
+    };
+
     void init();
     void terminate();
 
-    void spawn_thread();
     void stop();
+    size_t getThreadsCount() { return m_workers.size(); }
 
+    // future is broken (std::future_error) when task is canceled, without worker threads task is executed right away
     template<class F>
-    std::shared_future<typename std::invoke_result<F>::type> schedule(const F& task) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        auto prom = std::make_shared<std::promise<typename std::invoke_result<F>::type>>();
-        m_tasks.push_back([=]() { prom->set_value(task()); });
-        m_condition.notify_all();
-        return std::shared_future<typename std::invoke_result<F>::type>(prom->get_future());
+    std::shared_future<typename std::invoke_result<F>::type> schedule(const F& task, Priority priority = Interactive,
+                                                                      const AsyncCancelToken* token = nullptr) {
+        using Result = typename std::invoke_result<F>::type;
+        auto prom = std::make_shared<std::promise<Result>>();
+        std::shared_future<Result> future(prom->get_future());
+        push([=]() {
+            if constexpr (std::is_void<Result>::value) {
+                task();
+                prom->set_value();
+            } else
+                prom->set_value(task());
+        }, priority, token);
+        return future;
+    }
+
+    // continuation is called with task result by g_dispatcher, it's skipped when token is canceled meanwhile
+    template<class F, class C>
+    void post(const F& task, const C& continuation, Priority priority = Interactive, const AsyncCancelToken* token = nullptr) {
+        using Result = typename std::invoke_result<F>::type;
+        AsyncCancelToken continuationToken = token ? *token : AsyncCancelToken();
+        push([=]() {
+            if constexpr (std::is_void<Result>::value) {
+                task();
+                addDispatcherEvent([=]() {
+                    if (!continuationToken.isCanceled())
+                        continuation();
+                });
+            } else {
+                auto result = std::make_shared<Result>(task());
+                addDispatcherEvent([=]() {
+                    if (!continuationToken.isCanceled())
+                        continuation(*result);
+                });
+            }
+        }, priority, token);
     }
 
-    void dispatch(std::function<void()> f) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_tasks.push_back(f);
-        m_condition.notify_all();
+    void dispatch(std::function<void()> f, Priority priority = Interactive, const AsyncCancelToken* token = nullptr) {
+        push(std::move(f), priority, token);
     }
 
+    std::string getStats();
+
 protected:
-    void exec_loop();
+    void exec_loop(size_t index);
 
 private:
-    std::list<std::function<void()>> m_tasks;
-    std::list<std::thread> m_threads;
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks[PriorityCount];
+        std::thread thread;
+    };
+
+    void push(std::function<void()> task, Priority priority, const AsyncCancelToken* token);
+    bool pop(size_t index, std::function<void()>& task);
+    static void addDispatcherEvent(const std::function<void()>& callback);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_nextWorker{ 0 };
+    std::atomic<int> m_pending{ 0 };
+    std::atomic<int> m_sleeping{ 0 };
     std::mutex m_mutex;
     std::condition_variable m_condition;
-    stdext::boolean<false> m_running;
+    std::atomic<bool> m_running{ false };
+
+    std::atomic<uint64_t> m_executed[PriorityCount] = {};
+    std::atomic<uint64_t> m_stolen{ 0 };
+    std::atomic<uint64_t> m_canceled{ 0 };
 };
 
 extern AsyncDispatcher g_asyncDispatcher;
@@ -33,11 +33,17 @@ Clock::Clock()
 
 void Clock::update()
 {
-    m_currentMicros = stdext::micros();
+    m_currentMicros = stdext::micros() + m_offset;
     m_currentMillis = m_currentMicros / 1000;
     m_currentSeconds = m_currentMicros / 1000000.0f;
 }
 
+void Clock::advance(ticks_t micros)
+{
+    m_offset += std::max<ticks_t>(0, micros);
+    update();
+}
+
 ticks_t Clock::realMicros()
 {
     return stdext::micros();
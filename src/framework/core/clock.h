@@ -32,6 +32,9 @@ public:
     Clock();
 
     void update();
+    // moves clock forward without waiting, used to replay records faster than real time,
+    // offset is never removed because clock must stay monotonic for scheduled events and timers
+    void advance(ticks_t micros);
 
     ticks_t micros() { return m_currentMicros; }
     ticks_t millis() { return m_currentMillis; }
@@ -43,6 +46,7 @@ private:
     std::atomic<ticks_t> m_currentMicros;
     std::atomic<ticks_t> m_currentMillis;
     std::atomic<float> m_currentSeconds;
+    std::atomic<ticks_t> m_offset{ 0 };
 };
 
 extern Clock g_clock;
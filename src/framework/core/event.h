@@ -33,7 +33,7 @@ public:
     virtual ~Event();
 
     virtual void execute();
-    void cancel();
+    virtual void cancel();
 
     bool isCanceled() { return m_canceled; }
     bool isExecuted() { return m_executed; }
@@ -28,21 +28,46 @@
 #include <framework/util/stats.h>
 #include "timer.h"
 
+#include <queue>
+#include <random>
+
 EventDispatcher g_dispatcher;
 EventDispatcher g_graphicsDispatcher;
 std::thread::id g_mainThreadId = std::this_thread::get_id();
 std::thread::id g_graphicsThreadId = std::this_thread::get_id();
 std::thread::id g_dispatcherThreadId = std::this_thread::get_id();
 
+EventDispatcher::~EventDispatcher()
+{
+    drainInbox();
+    for(auto& level : m_wheel) {
+        for(auto& slot : level) {
+            while(slot.head) {
+                ScheduledEvent* scheduledEvent = slot.head;
+                unlink(scheduledEvent);
+                scheduledEvent->m_dispatcher = nullptr;
+                ScheduledEventPtr(scheduledEvent, false); // release wheel reference
+            }
+        }
+    }
+}
+
 void EventDispatcher::shutdown()
 {
-    while(!m_eventList.empty())
+    while(hasPendingEvents())
         poll();
 
-    while(!m_scheduledEventList.empty()) {
-        ScheduledEventPtr scheduledEvent = m_scheduledEventList.top();
-        scheduledEvent->cancel();
-        m_scheduledEventList.pop();
+    std::unique_lock<std::recursive_mutex> lock(m_mutex);
+    for(auto& level : m_wheel) {
+        for(auto& slot : level) {
+            while(slot.head) {
+                ScheduledEventPtr scheduledEvent(slot.head, false); // takes wheel reference
+                unlink(scheduledEvent.get());
+                m_scheduledEvents -= 1;
+                scheduledEvent->m_dispatcher = nullptr;
+                scheduledEvent->cancel();
+            }
+        }
     }
     m_disabled = true;
 }
@@ -52,30 +77,13 @@ void EventDispatcher::poll()
     AutoStat s(this == &g_dispatcher ? STATS_MAIN : STATS_RENDER, "PollDispatcher");
     std::unique_lock<std::recursive_mutex> lock(m_mutex);
 
-    int events = 0;
-    int loops = 0;
-    for(int count = 0, max = m_scheduledEventList.size(); count < max && !m_scheduledEventList.empty(); ++count) {
-        ScheduledEventPtr scheduledEvent = m_scheduledEventList.top();
-        if(scheduledEvent->remainingTicks() > 0)
-            break;
-        m_scheduledEventList.pop();
-        {
-            AutoStat s2(STATS_DISPATCHER, scheduledEvent->getFunction());
-            m_botSafe = scheduledEvent->isBotSafe();
-            lock.unlock();
-            scheduledEvent->execute();
-            events += 1;
-            lock.lock();
-        }
-
-        if(scheduledEvent->nextCycle())
-            m_scheduledEventList.push(scheduledEvent);
-    }
+    int events = executeScheduledEvents(lock, g_clock.millis());
 
     // execute events list until all events are out, this is needed because some events can schedule new events that would
     // change the UIWidgets layout, in this case we must execute these new events before we continue rendering,
+    drainInbox();
     m_pollEventsSize = m_eventList.size();
-    loops = 0;
+    int loops = 0;
     while(m_pollEventsSize > 0) {
         if(loops > 100) {
             static Timer reportTimer;
@@ -104,6 +112,7 @@ void EventDispatcher::poll()
                 lock.lock();
             }
         }
+        drainInbox();
         m_pollEventsSize = m_eventList.size();
         
         loops++;
@@ -114,6 +123,148 @@ void EventDispatcher::poll()
     m_botSafe = false;
 }
 
+int EventDispatcher::executeScheduledEvents(std::unique_lock<std::recursive_mutex>& lock, ticks_t now)
+{
+    std::vector<ScheduledEventPtr> expired;
+    advance(now, expired);
+    for(auto& scheduledEvent : expired) {
+        {
+            AutoStat s2(STATS_DISPATCHER, scheduledEvent->getFunction());
+            m_botSafe = scheduledEvent->isBotSafe();
+            lock.unlock();
+            scheduledEvent->execute();
+            lock.lock();
+        }
+
+        // cycle events scheduled for now or earlier are executed in next poll
+        if(scheduledEvent->nextCycle())
+            addScheduledEvent(scheduledEvent);
+        else
+            scheduledEvent->m_dispatcher = nullptr;
+    }
+    return expired.size();
+}
+
+void EventDispatcher::drainInbox()
+{
+    InboxNode* node = m_inbox.exchange(nullptr, std::memory_order_acquire);
+    if(!node)
+        return;
+
+    // stack is in reverse order
+    InboxNode* reversed = nullptr;
+    while(node) {
+        InboxNode* next = node->next;
+        node->next = reversed;
+        reversed = node;
+        node = next;
+    }
+    while(reversed) {
+        InboxNode* next = reversed->next;
+        m_eventList.push_back(std::move(reversed->event));
+        delete reversed;
+        reversed = next;
+    }
+}
+
+void EventDispatcher::addScheduledEvent(const ScheduledEventPtr& scheduledEvent)
+{
+    if(m_scheduledEvents == 0)
+        m_wheelTicks = std::max<ticks_t>(m_wheelTicks, g_clock.millis());
+    scheduledEvent->add_ref(); // released when event is taken from wheel
+    scheduledEvent->m_dispatcher = this;
+    link(scheduledEvent.get());
+    m_scheduledEvents += 1;
+}
+
+void EventDispatcher::unscheduleEvent(ScheduledEvent* scheduledEvent)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    scheduledEvent->m_dispatcher = nullptr;
+    if(scheduledEvent->m_wheelSlot < 0)
+        return; // being executed
+    unlink(scheduledEvent);
+    m_scheduledEvents -= 1;
+    ScheduledEventPtr(scheduledEvent, false); // release wheel reference
+}
+
+void EventDispatcher::link(ScheduledEvent* scheduledEvent)
+{
+    // events from past are put to the slot of next processed tick
+    ticks_t ticks = std::max<ticks_t>(scheduledEvent->ticks(), m_wheelTicks);
+    ticks_t delta = ticks - m_wheelTicks;
+    int level = 0;
+    while(level < WHEEL_LEVELS - 1 && delta >= ((ticks_t)1 << (WHEEL_BITS * (level + 1))))
+        level += 1;
+    int index = (ticks >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+
+    WheelSlot& slot = m_wheel[level][index];
+    scheduledEvent->m_wheelSlot = level * WHEEL_SLOTS + index;
+    scheduledEvent->m_wheelPrev = slot.tail;
+    scheduledEvent->m_wheelNext = nullptr;
+    if(slot.tail)
+        slot.tail->m_wheelNext = scheduledEvent;
+    else
+        slot.head = scheduledEvent;
+    slot.tail = scheduledEvent;
+    m_wheelLevelEvents[level] += 1;
+}
+
+void EventDispatcher::unlink(ScheduledEvent* scheduledEvent)
+{
+    int level = scheduledEvent->m_wheelSlot / WHEEL_SLOTS;
+    WheelSlot& slot = m_wheel[level][scheduledEvent->m_wheelSlot % WHEEL_SLOTS];
+    if(scheduledEvent->m_wheelPrev)
+        scheduledEvent->m_wheelPrev->m_wheelNext = scheduledEvent->m_wheelNext;
+    else
+        slot.head = scheduledEvent->m_wheelNext;
+    if(scheduledEvent->m_wheelNext)
+        scheduledEvent->m_wheelNext->m_wheelPrev = scheduledEvent->m_wheelPrev;
+    else
+        slot.tail = scheduledEvent->m_wheelPrev;
+    scheduledEvent->m_wheelPrev = scheduledEvent->m_wheelNext = nullptr;
+    scheduledEvent->m_wheelSlot = -1;
+    m_wheelLevelEvents[level] -= 1;
+}
+
+void EventDispatcher::advance(ticks_t now, std::vector<ScheduledEventPtr>& expired)
+{
+    while(m_wheelTicks <= now) {
+        if(m_scheduledEvents == 0) {
+            m_wheelTicks = now + 1;
+            break;
+        }
+
+        // slots of higher levels are moved down when lower level wraps
+        for(int level = 1; level < WHEEL_LEVELS; ++level) {
+            if((m_wheelTicks & (((ticks_t)1 << (WHEEL_BITS * level)) - 1)) != 0)
+                break;
+            WheelSlot& slot = m_wheel[level][(m_wheelTicks >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+            ScheduledEvent* scheduledEvent = slot.head;
+            while(scheduledEvent) {
+                ScheduledEvent* next = scheduledEvent->m_wheelNext;
+                unlink(scheduledEvent);
+                link(scheduledEvent);
+                scheduledEvent = next;
+            }
+        }
+
+        WheelSlot& slot = m_wheel[0][m_wheelTicks & (WHEEL_SLOTS - 1)];
+        while(slot.head) {
+            ScheduledEvent* scheduledEvent = slot.head;
+            unlink(scheduledEvent);
+            m_scheduledEvents -= 1;
+            expired.push_back(ScheduledEventPtr(scheduledEvent, false)); // takes wheel reference
+        }
+
+        // nothing on first level, jump to its next wrap
+        if(m_wheelLevelEvents[0] == 0)
+            m_wheelTicks = std::min<ticks_t>(now + 1, (m_wheelTicks | (WHEEL_SLOTS - 1)) + 1);
+        else
+            m_wheelTicks += 1;
+    }
+}
+
 ScheduledEventPtr EventDispatcher::scheduleEventEx(const std::string& function, const std::function<void()>& callback, int delay)
 {
     if(m_disabled)
@@ -123,7 +274,7 @@ ScheduledEventPtr EventDispatcher::scheduleEventEx(const std::string& function,
 
     VALIDATE(delay >= 0);
     ScheduledEventPtr scheduledEvent(new ScheduledEvent(function, callback, delay, 1, g_app.isOnInputEvent()));
-    m_scheduledEventList.push(scheduledEvent);
+    addScheduledEvent(scheduledEvent);
     return scheduledEvent;
 }
 
@@ -136,7 +287,7 @@ ScheduledEventPtr EventDispatcher::cycleEventEx(const std::string& function, con
 
     VALIDATE(delay > 0);
     ScheduledEventPtr scheduledEvent(new ScheduledEvent(function, callback, delay, 0, g_app.isOnInputEvent()));
-    m_scheduledEventList.push(scheduledEvent);
+    addScheduledEvent(scheduledEvent);
     return scheduledEvent;
 }
 
@@ -147,15 +298,95 @@ EventPtr EventDispatcher::addEventEx(const std::string& function, const std::fun
 
     EventPtr event(new Event(function, callback, g_app.isOnInputEvent()));
 
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
     // front pushing is a way to execute an event before others
     if(pushFront) {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
         m_eventList.push_front(event);
         // the poll event list only grows when pushing into front
         m_pollEventsSize++;
-    } else
-        m_eventList.push_back(event);
+        return event;
+    }
+
+    InboxNode* node = new InboxNode{ event, m_inbox.load(std::memory_order_relaxed) };
+    while(!m_inbox.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed));
     return event;
 }
 
+std::string EventDispatcher::benchmark(int timers)
+{
+    // half of timers is canceled, rest is executed during simulated minute polled every 16 ms
+    const int duration = 60000;
+    std::mt19937 generator(timers);
+    std::uniform_int_distribution<int> delayDistribution(0, duration);
+    std::vector<int> delays(timers);
+    for(auto& delay : delays)
+        delay = delayDistribution(generator);
+
+    int executed = 0;
+    ticks_t start = g_clock.millis();
+    std::stringstream ss;
+    ss << timers << " timers";
+    {
+        EventDispatcher dispatcher;
+        std::unique_lock<std::recursive_mutex> lock(dispatcher.m_mutex);
+        std::vector<ScheduledEventPtr> events;
+        events.reserve(timers);
+
+        stdext::timer timer;
+        for(int delay : delays)
+            events.push_back(dispatcher.scheduleEventEx("benchmark", [&] { executed += 1; }, delay));
+        ticks_t scheduleTime = timer.elapsed_micros();
+
+        timer.restart();
+        for(size_t i = 1; i < events.size(); i += 2)
+            events[i]->cancel();
+        ticks_t cancelTime = timer.elapsed_micros();
+
+        timer.restart();
+        for(ticks_t now = start; now <= start + duration; now += 16)
+            dispatcher.executeScheduledEvents(lock, now);
+        ticks_t executeTime = timer.elapsed_micros();
+
+        ss << ", wheel: schedule " << scheduleTime / 1000.0f << " ms, cancel " << cancelTime / 1000.0f
+            << " ms, execute " << executeTime / 1000.0f << " ms (" << executed << " executed, "
+            << dispatcher.getScheduledEventsCount() << " left)";
+    }
+
+    // previous implementation, canceled events stay in heap until they fire
+    struct Compare {
+        bool operator()(const ScheduledEventPtr& a, const ScheduledEventPtr& b) { return b->ticks() < a->ticks(); }
+    };
+    std::priority_queue<ScheduledEventPtr, std::vector<ScheduledEventPtr>, Compare> heap;
+    std::vector<ScheduledEventPtr> events;
+    events.reserve(timers);
+    executed = 0;
+
+    stdext::timer timer;
+    for(int delay : delays) {
+        events.push_back(ScheduledEventPtr(new ScheduledEvent("benchmark", [&] { executed += 1; }, delay, 1)));
+        heap.push(events.back());
+    }
+    ticks_t scheduleTime = timer.elapsed_micros();
+
+    timer.restart();
+    for(size_t i = 1; i < events.size(); i += 2)
+        events[i]->cancel();
+    ticks_t cancelTime = timer.elapsed_micros();
+
+    timer.restart();
+    int popped = 0;
+    for(ticks_t now = start; now <= start + duration; now += 16) {
+        while(!heap.empty() && heap.top()->ticks() <= now) {
+            ScheduledEventPtr scheduledEvent = heap.top();
+            heap.pop();
+            AutoStat s(STATS_DISPATCHER, scheduledEvent->getFunction());
+            scheduledEvent->execute();
+            popped += 1;
+        }
+    }
+    ticks_t executeTime = timer.elapsed_micros();
+
+    ss << ", heap: schedule " << scheduleTime / 1000.0f << " ms, cancel " << cancelTime / 1000.0f
+        << " ms, execute " << executeTime / 1000.0f << " ms (" << executed << " executed, " << popped << " popped)";
+    return ss.str();
+}
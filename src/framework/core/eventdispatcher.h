@@ -26,12 +26,15 @@
 #include "clock.h"
 #include "scheduledevent.h"
 
-#include <queue>
+#include <atomic>
+#include <deque>
 
 // @bindsingleton g_dispatcher
 class EventDispatcher
 {
 public:
+    ~EventDispatcher();
+
     void shutdown();
     void poll();
 
@@ -39,15 +42,52 @@ public:
     ScheduledEventPtr scheduleEventEx(const std::string& function, const std::function<void()>& callback, int delay);
     ScheduledEventPtr cycleEventEx(const std::string& function, const std::function<void()>& callback, int delay);
 
+    // called by canceled event, removes it from timing wheel
+    void unscheduleEvent(ScheduledEvent* scheduledEvent);
+
     bool isBotSafe() { return m_botSafe; }
+    size_t getScheduledEventsCount() { return m_scheduledEvents; }
+
+    static std::string benchmark(int timers);
 
 private:
-    std::list<EventPtr> m_eventList;
+    enum {
+        WHEEL_BITS = 8,
+        WHEEL_SLOTS = 1 << WHEEL_BITS,
+        WHEEL_LEVELS = 4 // 2^32 ms, more than max delay
+    };
+
+    struct WheelSlot {
+        ScheduledEvent* head = nullptr;
+        ScheduledEvent* tail = nullptr;
+    };
+
+    // lock-free stack of events added by any thread, drained by poll
+    struct InboxNode {
+        EventPtr event;
+        InboxNode* next;
+    };
+
+    void addScheduledEvent(const ScheduledEventPtr& scheduledEvent);
+    void link(ScheduledEvent* scheduledEvent);
+    void unlink(ScheduledEvent* scheduledEvent);
+    // moves events with ticks <= now to expired in execution order
+    void advance(ticks_t now, std::vector<ScheduledEventPtr>& expired);
+    int executeScheduledEvents(std::unique_lock<std::recursive_mutex>& lock, ticks_t now);
+    void drainInbox();
+    bool hasPendingEvents() { return !m_eventList.empty() || m_inbox.load(std::memory_order_acquire) != nullptr; }
+
+    std::deque<EventPtr> m_eventList;
+    std::atomic<InboxNode*> m_inbox{ nullptr };
     int m_pollEventsSize;
     bool m_disabled = false;
     bool m_botSafe = false;
     std::recursive_mutex m_mutex;
-    std::priority_queue<ScheduledEventPtr, std::vector<ScheduledEventPtr>, lessScheduledEvent> m_scheduledEventList;
+
+    WheelSlot m_wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+    size_t m_wheelLevelEvents[WHEEL_LEVELS] = {};
+    ticks_t m_wheelTicks = 0; // next tick to process
+    size_t m_scheduledEvents = 0;
 };
 
 extern EventDispatcher g_dispatcher;
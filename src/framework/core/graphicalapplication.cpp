@@ -169,14 +169,16 @@ void GraphicalApplication::run()
             ticks_t renderStart = stdext::millis();
             {
                 AutoStat s(STATS_MAIN, "DrawMapBackground");
-                g_drawQueue = std::make_shared<DrawQueue>();
+                g_drawQueue = DrawQueue::create();
                 g_ui.render(Fw::MapBackgroundPane);
+                batchDrawQueue();
             }
             std::shared_ptr<DrawQueue> mapBackgroundQueue = g_drawQueue;
             {
                 AutoStat s(STATS_MAIN, "DrawMapForeground");
-                g_drawQueue = std::make_shared<DrawQueue>();
+                g_drawQueue = DrawQueue::create();
                 g_ui.render(Fw::MapForegroundPane);
+                batchDrawQueue();
             }
 
             mutex.lock();
@@ -186,8 +188,9 @@ void GraphicalApplication::run()
 
             {
                 AutoStat s(STATS_MAIN, "DrawForeground");
-                g_drawQueue = std::make_shared<DrawQueue>();
+                g_drawQueue = DrawQueue::create();
                 g_ui.render(Fw::ForegroundPane);
+                batchDrawQueue();
             }
 
             mutex.lock();
@@ -252,6 +255,8 @@ void GraphicalApplication::run()
         lastRender = stdext::micros() > lastRender + frameDelay * 2 ? stdext::micros() : lastRender + frameDelay;
 
         g_painter->resetDraws();
+        g_atlas.newFrame();
+        g_textures.uploadScheduledTextures();
         if (m_scaling > 1.0f) {
             AutoStat s(STATS_RENDER, "SetupScaling");
             g_painter->setResolution(g_graphics.getViewportSize() / m_scaling);
@@ -333,6 +338,7 @@ void GraphicalApplication::run()
 
         g_graphs[GRAPH_GPU_CALLS].addValue(g_painter->calls());
         g_graphs[GRAPH_GPU_DRAWS].addValue(g_painter->draws());
+        g_stats.addDrawFrame(g_painter->calls(), g_painter->stateSwitches());
 
         AutoStat s(STATS_RENDER, "SwapBuffers");
         g_window.swapBuffers();
@@ -370,6 +376,15 @@ void GraphicalApplication::run()
     m_running = false;
 }
 
+void GraphicalApplication::batchDrawQueue()
+{
+    if (!m_drawBatching)
+        return;
+    AutoStat s(STATS_MAIN, "BatchDrawQueue");
+    g_drawQueue->batch();
+    g_stats.addBatchedItems(g_drawQueue->getMovedItems());
+}
+
 void GraphicalApplication::poll() {
     ticks_t start = stdext::millis();
 #ifdef FW_SOUND
@@ -443,7 +458,7 @@ void GraphicalApplication::doScreenshot(std::string file)
         } catch (stdext::exception& e) {
             g_logger.error(std::string("Can't do screenshot: ") + e.what());
         }
-    });
+    }, AsyncDispatcher::Background);
 }
 
 void GraphicalApplication::scaleUp()
@@ -62,18 +62,22 @@ public:
     void scaleDown();
     void scale(float value);
     void setSmooth(bool value);
+    void setDrawBatching(bool value) { m_drawBatching = value; }
+    bool isDrawBatching() { return m_drawBatching; }
 
     void doMapScreenshot(std::string fileName);
 
 protected:
     void resize(const Size& size);
     void inputEvent(InputEvent event);
+    void batchDrawQueue();
 
 private:
     int m_iteration = 0;
     std::atomic<float> m_scaling = 1.0;
     std::atomic<float> m_lastScaling = 1.0;
     std::atomic_int m_maxFps = 100;
+    std::atomic_bool m_drawBatching = false;
     stdext::boolean<false> m_onInputEvent;
     stdext::boolean<false> m_mustRepaint;
     FrameBufferPtr m_framebuffer, m_mapFramebuffer;
@@ -652,6 +652,20 @@ std::string ResourceManager::resolvePath(std::string path)
     return path;
 }
 
+std::string ResourceManager::getRealPath(const std::string& fileName)
+{
+    std::string fullPath = resolvePath(fileName);
+    const char* realDir = PHYSFS_getRealDir(fullPath.c_str());
+    if (!realDir || isFileEncryptedOrCompressed(fullPath))
+        return "";
+
+    std::error_code ec;
+    std::filesystem::path dir(realDir);
+    if (!std::filesystem::is_directory(dir, ec)) // inside of archive
+        return "";
+    return (dir / fullPath.substr(1)).string();
+}
+
 std::string ResourceManager::guessFilePath(const std::string& filename, const std::string& type)
 {    
     if(isFileType(filename, type))
@@ -64,6 +64,8 @@ public:
     std::list<std::string> listDirectoryFiles(const std::string & directoryPath = "", bool fullPath = false, bool raw = false);
 
     std::string resolvePath(std::string path);
+    // path in native filesystem, empty when file is packed in archive, encrypted or compressed
+    std::string getRealPath(const std::string& fileName);
     std::string getWorkDir() { return "/"; }
 #ifdef ANDROID
     std::string getWriteDir() { return "/"; }
@@ -21,6 +21,7 @@
  */
 
 #include "scheduledevent.h"
+#include "eventdispatcher.h"
 
 ScheduledEvent::ScheduledEvent(const std::string& function, const std::function<void()>& callback, int delay, int maxCycles, bool botSafe) : Event(function, callback, botSafe)
 {
@@ -44,6 +45,15 @@ void ScheduledEvent::execute()
     m_cyclesExecuted++;
 }
 
+void ScheduledEvent::cancel()
+{
+    // wheel may hold last reference
+    ScheduledEventPtr self = static_self_cast<ScheduledEvent>();
+    Event::cancel();
+    if(m_dispatcher)
+        m_dispatcher->unscheduleEvent(this);
+}
+
 bool ScheduledEvent::nextCycle()
 {
     if(m_callback && !m_canceled && (m_maxCycles == 0 || m_cyclesExecuted < m_maxCycles)) {
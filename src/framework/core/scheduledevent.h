@@ -27,12 +27,15 @@
 #include "event.h"
 #include "clock.h"
 
+class EventDispatcher;
+
 // @bindclass
 class ScheduledEvent : public Event
 {
 public:
     ScheduledEvent(const std::string& function, const std::function<void()>& callback, int delay, int maxCycles, bool botSafe = false);
     void execute();
+    void cancel() override;
     bool nextCycle();
 
     int ticks() { return m_ticks; }
@@ -46,12 +49,13 @@ private:
     int m_delay;
     int m_maxCycles;
     int m_cyclesExecuted;
-};
 
-struct lessScheduledEvent {
-    bool operator()(const ScheduledEventPtr& a, const ScheduledEventPtr& b) {
-        return  b->ticks() < a->ticks();
-    }
+    // timing wheel slot links, guarded by dispatcher mutex
+    friend class EventDispatcher;
+    EventDispatcher* m_dispatcher = nullptr;
+    ScheduledEvent* m_wheelPrev = nullptr;
+    ScheduledEvent* m_wheelNext = nullptr;
+    int m_wheelSlot = -1;
 };
 
 #endif
@@ -13,104 +13,201 @@ void Atlas::init()
     m_size = std::min<size_t>(4096, g_graphics.getMaxTextureSize());
     g_logger.info(stdext::format("[Atlas] Texture size is: %ix%i (max: %ix%i)", m_size, m_size, g_graphics.getMaxTextureSize(), g_graphics.getMaxTextureSize()));
 
-    for(size_t i = 0; i < 2; ++i) {
-        m_atlas[i] = g_framebuffers.createFrameBuffer();
-        if (i == 0) {
-            m_atlas[i]->resize(Size(m_size, m_size));
-        } else { // text atlas
-            m_atlas[i]->setSmooth(false);
+    m_maxLevel = m_size > 2048 ? 4 : 3; // max 512x512 or 256x256
+
+    m_pages.reserve(MAX_PAGES);
+    m_pages.emplace_back();
+    createPage(m_pages.back(), m_size, true);
 #ifdef BIG_FONTS
-            m_atlas[i]->resize(Size(m_size, m_size));
+    createPage(m_fontPage, m_size, false);
 #else
-            m_atlas[i]->resize(Size(2048, 2048));
+    createPage(m_fontPage, std::min<size_t>(2048, m_size), false);
 #endif
-        }
 
-        glActiveTexture(GL_TEXTURE6 + i);
-        glBindTexture(GL_TEXTURE_2D, m_atlas[i]->getTexture()->getId());
-        glActiveTexture(GL_TEXTURE0);
-    }
-    reset();
-    resetAtlas(1);
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, m_pages[0].framebuffer->getTexture()->getId());
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D, m_fontPage.framebuffer->getTexture()->getId());
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Atlas::createPage(Page& page, size_t size, bool smooth)
+{
+    page.framebuffer = g_framebuffers.createFrameBuffer();
+    if (!smooth)
+        page.framebuffer->setSmooth(false);
+    page.framebuffer->resize(Size(size, size));
+    page.topLevel = std::max<int>(0, std::min<int>(LEVELS - 1, calculateIndex(Size(size, size))));
+    resetPage(page);
 }
 
 void Atlas::reset()
 {
-    m_doReset = false;
-    resetAtlas(0);
+    for (auto& page : m_pages)
+        resetPage(page);
+    m_entries.clear();
     m_cache.clear();
 }
 
 void Atlas::reload()
 {
     reset();
-    resetAtlas(1);
+    resetPage(m_fontPage);
 }
 
-void Atlas::resetAtlas(int location) {
-    if (!m_atlas[location])
+void Atlas::resetPage(Page& page)
+{
+    if (!page.framebuffer)
         return;
-    for (auto& location : m_locations[location])
-        location.clear();
-
-    size_t size = m_atlas[location]->getSize().width();
-    for (size_t i = 0; i < size; i += 2048) {
-        m_locations[location][6].push_back(Point(i, i));
-        for (size_t x = 0; x < i; x += 2048) {
-            m_locations[location][6].push_back(Point(i, x));
-            m_locations[location][6].push_back(Point(x, i));
-        }
+    for (auto& blocks : page.freeBlocks)
+        blocks.clear();
+
+    int size = page.framebuffer->getSize().width();
+    int topSize = blockSize(page.topLevel);
+    for (int x = 0; x + topSize <= size; x += topSize) {
+        for (int y = 0; y + topSize <= size; y += topSize)
+            page.freeBlocks[page.topLevel].insert((x << 16) | y);
     }
 
-    m_atlas[location]->bind();
+    page.framebuffer->bind();
     g_painter->clear(Color::alpha);
-    m_atlas[location]->release();
+    page.framebuffer->release();
 }
 
-
-void Atlas::terminate() {
-    for(auto& it : m_atlas)
-        it = nullptr;
+void Atlas::terminate()
+{
+    m_entries.clear();
+    m_cache.clear();
+    m_pages.clear();
+    m_fontPage.framebuffer = nullptr;
 }
 
-Point Atlas::cache(uint64_t hash, const Size& size, bool& draw)
+Point Atlas::cache(uint64_t hash, const Size& size, bool& draw, int& page)
 {
-    if (m_doReset) {
-        reset();
-    }
     auto it = m_cache.find(hash);
     if (it != m_cache.end()) {
-        return it->second;
+        Entry& entry = *it->second;
+        entry.lastUse = m_frame;
+        if (it->second != m_entries.begin())
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+        m_hits += 1;
+        page = entry.page;
+        return entry.pos;
     }
+    m_misses += 1;
 
     int index = calculateIndex(size);
-    if (index < 0 || index > 4 || (index == 4 && m_size == 2048)) { // too big to be cached, max 512x512
+    if (index < 0 || index > m_maxLevel) { // too big to be cached
         draw = false;
         return Point(-1, -1);
     }
 
-    if (m_locations[0][index].empty() && !findSpace(0, index)) {
+    Point location;
+    if (!allocate(index, location, page)) {
+        m_failures += 1;
         draw = false;
-        m_doReset = true;
         return Point(-1, -1);
     }
 
-    Point location = m_locations[0][index].front();
-    m_locations[0][index].pop_front();
-    m_cache.emplace(hash, location);
+    m_entries.push_front(Entry{ hash, location, (uint8_t)page, (uint8_t)index, m_frame });
+    m_cache.emplace(hash, m_entries.begin());
     draw = true;
     return location;
 }
 
-void Atlas::bind()
+bool Atlas::allocate(int level, Point& pos, int& page)
 {
-    m_atlas[0]->bind();
+    for (size_t i = 0; i < m_pages.size(); ++i) {
+        if (allocate(m_pages[i], level, pos)) {
+            page = i;
+            return true;
+        }
+    }
+
+    if ((int)m_pages.size() < m_maxPages) {
+        m_pages.emplace_back();
+        createPage(m_pages.back(), m_size, true);
+        page = m_pages.size() - 1;
+        return allocate(m_pages.back(), level, pos);
+    }
+
+    // evict least recently used entries which weren't used in current frame
+    while (!m_entries.empty() && m_entries.back().lastUse < m_frame) {
+        Entry& entry = m_entries.back();
+        Page& entryPage = m_pages[entry.page];
+        free(entryPage, entry.pos, entry.level);
+        m_cache.erase(entry.hash);
+        page = entry.page;
+        m_entries.pop_back();
+        m_evictions += 1;
+        if (allocate(entryPage, level, pos))
+            return true;
+    }
+    return false;
+}
+
+bool Atlas::allocate(Page& page, int level, Point& pos)
+{
+    int freeLevel = level;
+    while (freeLevel <= page.topLevel && page.freeBlocks[freeLevel].empty())
+        ++freeLevel;
+    if (freeLevel > page.topLevel)
+        return false;
+
+    uint32_t block = *page.freeBlocks[freeLevel].begin();
+    page.freeBlocks[freeLevel].erase(page.freeBlocks[freeLevel].begin());
+    int x = block >> 16, y = block & 0xFFFF;
+    // split bigger block, first quarter is used, the rest goes to free list
+    while (freeLevel > level) {
+        --freeLevel;
+        int size = blockSize(freeLevel);
+        page.freeBlocks[freeLevel].insert(((x + size) << 16) | y);
+        page.freeBlocks[freeLevel].insert((x << 16) | (y + size));
+        page.freeBlocks[freeLevel].insert(((x + size) << 16) | (y + size));
+    }
+    pos = Point(x, y);
+    return true;
+}
+
+void Atlas::free(Page& page, Point pos, int level)
+{
+    // merge with free buddies into bigger block
+    while (level < page.topLevel) {
+        int size = blockSize(level);
+        int px = pos.x & ~(size * 2 - 1), py = pos.y & ~(size * 2 - 1);
+        uint32_t buddies[4] = {
+            (uint32_t)((px << 16) | py), (uint32_t)(((px + size) << 16) | py),
+            (uint32_t)((px << 16) | (py + size)), (uint32_t)(((px + size) << 16) | (py + size))
+        };
+        uint32_t self = (pos.x << 16) | pos.y;
+        auto& blocks = page.freeBlocks[level];
+        bool merge = true;
+        for (uint32_t buddy : buddies) {
+            if (buddy != self && blocks.find(buddy) == blocks.end()) {
+                merge = false;
+                break;
+            }
+        }
+        if (!merge)
+            break;
+        for (uint32_t buddy : buddies)
+            blocks.erase(buddy);
+        pos = Point(px, py);
+        level += 1;
+    }
+    page.freeBlocks[level].insert((pos.x << 16) | pos.y);
+}
+
+void Atlas::bind(int page)
+{
+    m_boundPage = page;
+    m_pages[page].framebuffer->bind();
     g_painter->setCompositionMode(Painter::CompositionMode_Replace);
 }
 
 void Atlas::release()
 {
-    m_atlas[0]->release();
+    m_pages[m_boundPage].framebuffer->release();
 }
 
 Point Atlas::cacheFont(const TexturePtr& fontTexture)
@@ -120,15 +217,14 @@ Point Atlas::cacheFont(const TexturePtr& fontTexture)
     if (index < 0) {
         g_logger.fatal("[Atlas] Too big font texture. Max is 2048x2048");
     }
-    if (m_locations[1][index].empty() && !findSpace(1, index)) {
+    Point location;
+    if (!allocate(m_fontPage, index, location)) {
         g_logger.fatal("[Atlas] Out of space for new fonts, compile with BIG_FONTS or DONT_CACHE_FONTS definition");
     }
-    Point location = m_locations[1][index].front();
-    m_locations[1][index].pop_front();
-    m_atlas[1]->bind();
+    m_fontPage.framebuffer->bind();
     g_painter->setCompositionMode(Painter::CompositionMode_Replace);
     g_painter->drawTexturedRect(Rect(location, fontTexture->getSize()), fontTexture);
-    m_atlas[1]->release();
+    m_fontPage.framebuffer->release();
     return location;
 }
 
@@ -144,31 +240,26 @@ int Atlas::calculateIndex(const Size& size)
     return s <= 2048 ? 6 : -1;
 }
 
-bool Atlas::findSpace(int location, int index) {
-    static const size_t sizes[7] = { 32, 64, 128, 256, 512, 1024, 2048 };
-    if (location >= 2 || index >= 6) {
-        return false;
-    }
-    if (m_locations[location][index + 1].size() == 0 && !findSpace(location, index + 1)) {
-        return false;
-    }
-    auto pos = m_locations[location][index + 1].front();
-    m_locations[location][index + 1].pop_front();
-    m_locations[location][index].push_back(pos);
-    m_locations[location][index].push_back(Point(pos.x, pos.y + sizes[index]));
-    m_locations[location][index].push_back(Point(pos.x + sizes[index], pos.y));
-    m_locations[location][index].push_back(Point(pos.x + sizes[index], pos.y + sizes[index]));
-    return true;
-}
-
 std::string Atlas::getStats() {
     std::stringstream ss;
-    for (int l = 0; l < 2; ++l) {
-        for (auto& it : m_locations[l]) {
-            ss << it.size() << " ";
+    uint64_t pageArea = (uint64_t)m_size * m_size;
+    uint64_t freeArea = 0, smallFreeArea = 0;
+    for (auto& page : m_pages) {
+        for (int level = 0; level <= page.topLevel; ++level) {
+            uint64_t area = (uint64_t)blockSize(level) * blockSize(level) * page.freeBlocks[level].size();
+            freeArea += area;
+            if (level < m_maxLevel)
+                smallFreeArea += area;
         }
-        ss << "| ";
     }
+    uint64_t usedArea = pageArea * m_pages.size() - freeArea;
+    uint64_t lookups = std::max<uint64_t>(1, m_hits + m_misses);
+
+    ss << "pages: " << m_pages.size() << "/" << m_maxPages << " | entries: " << m_entries.size()
+       << " | used: " << (usedArea * 100) / std::max<uint64_t>(1, pageArea * m_pages.size()) << "%"
+       << " | hit rate: " << (m_hits * 100) / lookups << "% | evictions: " << m_evictions << " | failures: " << m_failures
+       // part of free space which can't hold the biggest cachable texture
+       << " | fragmentation: " << (smallFreeArea * 100) / std::max<uint64_t>(1, freeArea) << "% ";
     ss << "(" << m_size << "|" << g_graphics.getMaxTextureSize() << ")";
     return ss.str();
 }
@@ -3,37 +3,83 @@
 
 #include "drawqueue.h"
 #include "framebuffer.h"
-#include <map>
+#include <atomic>
+#include <list>
+#include <set>
+#include <unordered_map>
 #include <vector>
 
 class Atlas {
 public:
+    enum {
+        MIN_BLOCK_SIZE = 32,
+        LEVELS = 7, // 32x32 - 2048x2048 blocks
+        DEFAULT_PAGES = 1,
+        MAX_PAGES = 8
+    };
+
     void init();
     void terminate();
     void reload();
 
-    Point cache(uint64_t hash, const Size& size, bool& draw);
+    // returns position of cached texture in atlas page, draw is set when texture must be drawn at returned position
+    Point cache(uint64_t hash, const Size& size, bool& draw, int& page);
     Point cacheFont(const TexturePtr& fontTexture);
 
-    TexturePtr get(int location) { return m_atlas[location]->getTexture(); }
-    void bind();
+    TexturePtr getPageTexture(int page) { return m_pages[page].framebuffer->getTexture(); }
+    TexturePtr getFontTexture() { return m_fontPage.framebuffer->getTexture(); }
+    void bind(int page);
     void release();
 
+    // entries used in current frame are never evicted
+    void newFrame() { m_frame += 1; }
+
+    void setMaxPages(int pages) { m_maxPages = std::max<int>(1, std::min<int>(MAX_PAGES, pages)); }
+    int getMaxPages() { return m_maxPages; }
+
     std::string getStats(); // not thread safe!
 
 private:
+    struct Page {
+        FrameBufferPtr framebuffer;
+        std::set<uint32_t> freeBlocks[LEVELS]; // (x << 16) | y
+        int topLevel = LEVELS - 1;
+    };
+
+    struct Entry {
+        uint64_t hash;
+        Point pos;
+        uint8_t page;
+        uint8_t level;
+        uint64_t lastUse;
+    };
+    using EntryList = std::list<Entry>; // most recently used first
+
     void reset();
-    void resetAtlas(int location);
-    bool findSpace(int location, int index);
+    void resetPage(Page& page);
+    void createPage(Page& page, size_t size, bool smooth);
+    bool allocate(int level, Point& pos, int& page);
+    bool allocate(Page& page, int level, Point& pos);
+    void free(Page& page, Point pos, int level);
     inline int calculateIndex(const Size& size);
+    inline int blockSize(int level) { return MIN_BLOCK_SIZE << level; }
 
-    FrameBufferPtr m_atlas[2];
-    std::map<uint64_t, Point> m_cache;
-    std::list<Point> m_locations[2][7];
+    std::vector<Page> m_pages;
+    Page m_fontPage;
+    EntryList m_entries;
+    std::unordered_map<uint64_t, EntryList::iterator> m_cache;
     size_t m_size;
-    bool m_doReset = false;
+    int m_maxLevel = 4;
+    std::atomic_int m_maxPages = DEFAULT_PAGES;
+    uint64_t m_frame = 1;
+    int m_boundPage = 0;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_evictions = 0;
+    uint64_t m_failures = 0;
 };
 
 extern Atlas g_atlas;
 
-#endif
\ No newline at end of file
+#endif
@@ -113,3 +113,19 @@ Rect CoordsBuffer::getTextureRect()
     }
     return Rect(Point(x1, y1), Point(x2, y2));
 }
+
+Rect CoordsBuffer::getVertexRect()
+{
+    float* vertices = getVertexArray();
+    int size = getVertexCount() * 2;
+    if (size == 0)
+        return Rect();
+    float x1 = vertices[0], y1 = vertices[1], x2 = x1, y2 = y1;
+    for (int i = 2; i < size; i += 2) {
+        x1 = std::min(x1, vertices[i]);
+        x2 = std::max(x2, vertices[i]);
+        y1 = std::min(y1, vertices[i + 1]);
+        y2 = std::max(y2, vertices[i + 1]);
+    }
+    return Rect(Point(std::floor(x1), std::floor(y1)), Point(std::ceil(x2), std::ceil(y2)));
+}
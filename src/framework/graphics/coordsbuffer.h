@@ -99,6 +99,7 @@ public:
         m_textureCoordArray->cache();
     }
     Rect getTextureRect();
+    Rect getVertexRect();
 
 private:
     bool m_locked = false;
@@ -6,14 +6,14 @@ void DrawCache::draw()
 {
     release();
     if (m_size == 0) return;
-    g_painter->drawCache(m_destCoord, m_srcCoord, m_color, m_size);
+    g_painter->drawCache(m_destCoord, m_srcCoord, m_color, m_size, g_atlas.getPageTexture(m_page));
     m_size = 0;
 }
 
 void DrawCache::bind()
 {
     if (m_bound) return;
-    g_atlas.bind();
+    g_atlas.bind(m_page);
     m_bound = true;
 }
 
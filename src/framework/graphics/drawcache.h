@@ -14,6 +14,13 @@ public:
     void draw();
     void bind();
     void release();
+    // atlas page used by cached vertices, changing it draws current cache
+    void setPage(int page)
+    {
+        if (m_page == page) return;
+        draw();
+        m_page = page;
+    }
     bool hasSpace(int size) {
         return size + m_size < MAX_SIZE;
     }
@@ -48,6 +55,7 @@ private:
     std::vector<float> m_color = std::vector<float>(MAX_SIZE * 4);
     bool m_bound = false;
     int m_size = 0;
+    int m_page = 0;
 };
 
 extern DrawCache g_drawCache;
@@ -8,10 +8,21 @@
 #include <framework/graphics/textrender.h>
 #include <framework/graphics/drawcache.h>
 #include <framework/graphics/image.h>
+#include <framework/util/stats.h>
 #include <client/spritemanager.h>
 #include <client/outfit.h>
 
-std::shared_ptr<DrawQueue> g_drawQueue;
+thread_local std::shared_ptr<DrawQueue> g_drawQueue;
+
+namespace {
+    // queues are released by render thread and taken again by dispatcher thread
+    struct FreeQueuePool {
+        enum { MAX_QUEUES = 24 }; // map floors can be drawn into separate queues
+        std::mutex mutex;
+        std::vector<DrawQueue*> queues;
+    };
+    FreeQueuePool* freeQueuePool = new FreeQueuePool; // never deleted, queues may be released during static destruction
+}
 
 void DrawQueueItemTextureCoords::draw()
 {
@@ -27,8 +38,10 @@ bool DrawQueueItemTextureCoords::cache()
 
     uint64_t hash = 100 + m_texture->getUniqueId();
     bool drawNow = false;
-    Point atlasPos = g_atlas.cache(hash, m_texture->getSize(), drawNow);
+    int page = 0;
+    Point atlasPos = g_atlas.cache(hash, m_texture->getSize(), drawNow, page);
     if (atlasPos.x < 0) { return false; } // can't be cached
+    g_drawCache.setPage(page);
     if (drawNow) { g_drawCache.bind(); draw(atlasPos); }
 
     int size = m_coordsBuffer.getVertexCount();
@@ -76,6 +89,14 @@ void DrawQueueItemImageWithShader::draw(const Point& pos)
     g_painter->resetShaderProgram();
 }
 
+bool DrawQueueItemImageWithShader::getBatchInfo(Rect& bounds, uint64_t& key)
+{
+    if (!m_texture) return false;
+    bounds = m_coordsBuffer.getVertexRect();
+    key = DrawQueue::shaderBatchKey(m_shader, m_texture);
+    return true;
+}
+
 void DrawQueueItemTexturedRect::draw()
 {
     g_painter->setColor(m_color);
@@ -92,8 +113,10 @@ bool DrawQueueItemTexturedRect::cache()
     m_texture->update();
     uint64_t hash = 100 + m_texture->getUniqueId();
     bool drawNow = false;
-    Point atlasPos = g_atlas.cache(hash, m_texture->getSize(), drawNow);
+    int page = 0;
+    Point atlasPos = g_atlas.cache(hash, m_texture->getSize(), drawNow, page);
     if (atlasPos.x < 0) { return false; } // can't be cached
+    g_drawCache.setPage(page);
     if (drawNow) { g_drawCache.bind(); draw(atlasPos); }
 
     if (!g_drawCache.hasSpace(6))
@@ -195,6 +218,106 @@ void DrawQueueConditionMark::end(DrawQueue* queue)
     g_painter->resetShaderProgram();
 }
 
+std::shared_ptr<DrawQueue> DrawQueue::create()
+{
+    DrawQueue* queue = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(freeQueuePool->mutex);
+        if (!freeQueuePool->queues.empty()) {
+            queue = freeQueuePool->queues.back();
+            freeQueuePool->queues.pop_back();
+        }
+    }
+    if (!queue)
+        queue = new DrawQueue;
+
+    return std::shared_ptr<DrawQueue>(queue, [](DrawQueue* queue) {
+        queue->clear();
+        std::lock_guard<std::mutex> lock(freeQueuePool->mutex);
+        if (freeQueuePool->queues.size() >= FreeQueuePool::MAX_QUEUES) {
+            delete queue;
+            return;
+        }
+        freeQueuePool->queues.push_back(queue);
+    });
+}
+
+void DrawQueue::clear()
+{
+    for (auto& item : m_queue) {
+        if (item->m_arena)
+            item->~DrawQueueItem();
+        else
+            delete item;
+    }
+    m_queue.clear();
+    for (auto& condition : m_conditions)
+        condition->~DrawQueueCondition();
+    m_conditions.clear();
+    m_appended.clear();
+    m_arena.reset();
+    m_movedItems = 0;
+    m_batched = false;
+
+    m_frameBufferSize = Size();
+    m_frameBufferDest = m_frameBufferSrc = Rect();
+    mapPosition = 0;
+    m_useFrameBuffer = false;
+    m_scaling = 1.f;
+    m_shader.clear();
+}
+
+void DrawQueue::append(const std::shared_ptr<DrawQueue>& queue)
+{
+    size_t offset = m_queue.size();
+    m_queue.insert(m_queue.end(), queue->m_queue.begin(), queue->m_queue.end());
+    for (auto& condition : queue->m_conditions) {
+        condition->m_start += offset;
+        condition->m_end += offset;
+        m_conditions.push_back(condition);
+    }
+    queue->m_queue.clear();
+    queue->m_conditions.clear();
+    m_appended.push_back(queue);
+}
+
+bool DrawQueue::isSameAs(const DrawQueue& other)
+{
+    if (m_queue.size() != other.m_queue.size() || m_conditions.size() != other.m_conditions.size())
+        return false;
+
+    for (size_t i = 0; i < m_queue.size(); ++i) {
+        DrawQueueItem* a = m_queue[i];
+        DrawQueueItem* b = other.m_queue[i];
+        if (typeid(*a) != typeid(*b) || a->m_type != b->m_type || a->m_texture != b->m_texture || a->m_color != b->m_color)
+            return false;
+        auto rectA = dynamic_cast<DrawQueueItemTexturedRect*>(a);
+        auto rectB = dynamic_cast<DrawQueueItemTexturedRect*>(b);
+        if (rectA && (rectA->m_dest != rectB->m_dest || rectA->m_src != rectB->m_src))
+            return false;
+        Rect boundsA, boundsB;
+        uint64_t keyA = 0, keyB = 0;
+        bool batchA = getBatchInfo(a, boundsA, keyA);
+        bool batchB = getBatchInfo(b, boundsB, keyB);
+        if (batchA != batchB || boundsA != boundsB || keyA != keyB)
+            return false;
+    }
+
+    // conditions are sorted only when drawn
+    auto order = [](const DrawQueueCondition* a, const DrawQueueCondition* b) -> bool {
+        return a->m_start == b->m_start ? a->m_end < b->m_end : a->m_start < b->m_start;
+    };
+    std::vector<DrawQueueCondition*> conditions(m_conditions), otherConditions(other.m_conditions);
+    std::stable_sort(conditions.begin(), conditions.end(), order);
+    std::stable_sort(otherConditions.begin(), otherConditions.end(), order);
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        if (typeid(*conditions[i]) != typeid(*otherConditions[i]) ||
+            conditions[i]->m_start != otherConditions[i]->m_start || conditions[i]->m_end != otherConditions[i]->m_end)
+            return false;
+    }
+    return mapPosition == other.mapPosition && m_frameBufferDest == other.m_frameBufferDest && m_frameBufferSrc == other.m_frameBufferSrc;
+}
+
 void DrawQueue::setFrameBuffer(const Rect& dest, const Size& size, const Rect& src)
 {
     m_useFrameBuffer = true;
@@ -216,14 +339,18 @@ void DrawQueue::addText(BitmapFontPtr font, const std::string& text, const Rect&
 {
     if (!font || text.empty()) return;
     uint64_t hash = g_text.addText(font, text, screenCoords.size(), align);
-    m_queue.push_back(new DrawQueueItemText(screenCoords.topLeft(), font->getTexture(), hash, color, shadow));
+    auto item = emplace<DrawQueueItemText>(screenCoords.topLeft(), font->getTexture(), hash, color, shadow);
+    item->m_size = screenCoords.size();
+    item->m_type = DRAW_ITEM_TEXT;
 }
 
 void DrawQueue::addColoredText(BitmapFontPtr font, const std::string& text, const Rect& screenCoords, Fw::AlignmentFlag align, const std::vector<std::pair<int, Color>>& colors, bool shadow)
 {
     if (!font || text.empty()) return;
     uint64_t hash = g_text.addText(font, text, screenCoords.size(), align);
-    m_queue.push_back(new DrawQueueItemTextColored(screenCoords.topLeft(), font->getTexture(), hash, colors, shadow));
+    auto item = emplace<DrawQueueItemTextColored>(screenCoords.topLeft(), font->getTexture(), hash, colors, shadow);
+    item->m_size = screenCoords.size();
+    item->m_type = DRAW_ITEM_COLORED_TEXT;
 }
 
 void DrawQueue::correctOutfit(const Rect& dest, int fromPos, bool oldScaling)
@@ -290,6 +417,211 @@ void DrawQueue::correctOutfit(const Rect& dest, int fromPos, bool oldScaling)
     }
 }
 
+uint64_t DrawQueue::textureBatchKey(const TexturePtr& texture)
+{
+    if (!texture || texture->canCache())
+        return ATLAS_BATCH_KEY;
+    return texture->getUniqueId();
+}
+
+uint64_t DrawQueue::shaderBatchKey(const std::string& shader, const TexturePtr& texture)
+{
+    uint64_t key = std::hash<std::string>()(shader) * 1125899906842597ULL + (texture ? texture->getUniqueId() : 0);
+    return key | (1ULL << 63);
+}
+
+bool DrawQueue::getBatchInfo(DrawQueueItem* item, Rect& bounds, uint64_t& key)
+{
+    switch (item->m_type) {
+    case DRAW_ITEM_TEXTURED_RECT: {
+        auto rect = static_cast<DrawQueueItemTexturedRect*>(item);
+        bounds = rect->m_dest;
+        key = rect->m_dest.size() > rect->m_src.size() ? rect->m_texture->getUniqueId() : textureBatchKey(rect->m_texture);
+        return true;
+    }
+    case DRAW_ITEM_TEXTURE_COORDS:
+        bounds = static_cast<DrawQueueItemTextureCoords*>(item)->m_coordsBuffer.getVertexRect();
+        key = textureBatchKey(item->m_texture);
+        return true;
+    case DRAW_ITEM_FILLED_RECT:
+        bounds = static_cast<DrawQueueItemFilledRect*>(item)->m_dest;
+        key = ATLAS_BATCH_KEY;
+        return true;
+    case DRAW_ITEM_FILL_COORDS:
+        bounds = static_cast<DrawQueueItemFillCoords*>(item)->m_coordsBuffer.getVertexRect();
+        key = ATLAS_BATCH_KEY;
+        return true;
+    case DRAW_ITEM_TEXT: {
+        auto text = static_cast<DrawQueueItemText*>(item);
+        bounds = Rect(text->m_point, text->m_size + Size(1, 1)); // with shadow
+        key = textureBatchKey(text->m_texture);
+        return true;
+    }
+    case DRAW_ITEM_COLORED_TEXT: {
+        auto text = static_cast<DrawQueueItemTextColored*>(item);
+        bounds = Rect(text->m_point, text->m_size + Size(1, 1));
+        key = textureBatchKey(text->m_texture);
+        return true;
+    }
+    default:
+        return item->getBatchInfo(bounds, key);
+    }
+}
+
+void DrawQueue::batch()
+{
+    m_batched = true;
+    // items can't be moved between conditions and map position
+    std::vector<size_t> boundaries = { 0, mapPosition, m_queue.size() };
+    for (auto& condition : m_conditions) {
+        boundaries.push_back(condition->m_start);
+        boundaries.push_back(condition->m_end);
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    for (size_t i = 1; i < boundaries.size(); ++i) {
+        if (boundaries[i - 1] < boundaries[i] && boundaries[i] <= m_queue.size())
+            batch(boundaries[i - 1], boundaries[i]);
+    }
+}
+
+void DrawQueue::batch(size_t start, size_t end)
+{
+    if (end - start < 3)
+        return;
+
+    m_batchGroups.clear();
+    m_batchItemGroup.resize(end - start);
+    size_t firstMovableGroup = 0;
+    for (size_t i = start; i < end; ++i) {
+        Rect bounds;
+        uint64_t key = 0;
+        size_t group = m_batchGroups.size();
+        if (!getBatchInfo(m_queue[i], bounds, key) || !bounds.isValid()) {
+            m_batchGroups.push_back(BatchGroup{ 0, Rect(), 1 });
+            firstMovableGroup = m_batchGroups.size();
+            m_batchItemGroup[i - start] = group;
+            continue;
+        }
+
+        // move item back to the last group with the same key, if it doesn't overlap anything drawn after that group
+        size_t limit = std::max<size_t>(firstMovableGroup, m_batchGroups.size() > MAX_BATCH_GROUPS ? m_batchGroups.size() - MAX_BATCH_GROUPS : 0);
+        for (size_t g = m_batchGroups.size(); g > limit; --g) {
+            BatchGroup& batchGroup = m_batchGroups[g - 1];
+            if (batchGroup.key == key) {
+                group = g - 1;
+                break;
+            }
+            if (batchGroup.bounds.intersects(bounds))
+                break;
+        }
+
+        if (group == m_batchGroups.size()) {
+            m_batchGroups.push_back(BatchGroup{ key, bounds, 1 });
+        } else {
+            m_batchGroups[group].bounds = m_batchGroups[group].bounds.united(bounds);
+            m_batchGroups[group].items += 1;
+        }
+        m_batchItemGroup[i - start] = group;
+    }
+
+    if (m_batchGroups.size() == end - start)
+        return; // nothing to merge
+
+    // stable counting sort by group
+    size_t offset = 0;
+    for (auto& group : m_batchGroups) {
+        size_t items = group.items;
+        group.items = offset;
+        offset += items;
+    }
+    m_batchItems.resize(end - start);
+    for (size_t i = start; i < end; ++i) {
+        size_t pos = m_batchGroups[m_batchItemGroup[i - start]].items++;
+        if (pos != i - start)
+            m_movedItems += 1;
+        m_batchItems[pos] = m_queue[i];
+    }
+    std::copy(m_batchItems.begin(), m_batchItems.end(), m_queue.begin() + start);
+}
+
+size_t DrawQueue::drawMerged(size_t i, size_t end)
+{
+    // draws following textured rects with same texture and color in single call
+    auto first = static_cast<DrawQueueItemTexturedRect*>(m_queue[i]);
+    size_t last = i + 1;
+    while (last < end && m_queue[last]->m_type == DRAW_ITEM_TEXTURED_RECT &&
+           m_queue[last]->m_texture == first->m_texture && m_queue[last]->m_color == first->m_color)
+        ++last;
+
+    if (last - i == 1) {
+        first->DrawQueueItemTexturedRect::draw();
+        return 1;
+    }
+
+    m_mergeBuffer.clear();
+    for (size_t j = i; j < last; ++j) {
+        auto rect = static_cast<DrawQueueItemTexturedRect*>(m_queue[j]);
+        if (!rect->m_dest.isEmpty() && !rect->m_src.isEmpty())
+            m_mergeBuffer.addRect(rect->m_dest, rect->m_src);
+    }
+    g_painter->setColor(first->m_color);
+    g_painter->drawTextureCoords(m_mergeBuffer, first->m_texture);
+    g_stats.addMergedDraws(last - i - 1);
+    return last - i;
+}
+
+size_t DrawQueue::drawTexts(size_t i, size_t end)
+{
+    // draws following texts using same font texture in single call, shadows are drawn before all of them
+    const TexturePtr& texture = m_queue[i]->m_texture;
+    size_t last = i;
+    while (last < end && (m_queue[last]->m_type == DRAW_ITEM_TEXT || m_queue[last]->m_type == DRAW_ITEM_COLORED_TEXT) &&
+           m_queue[last]->m_texture == texture) {
+        if (m_queue[last]->m_type == DRAW_ITEM_TEXT) {
+            auto text = static_cast<DrawQueueItemText*>(m_queue[last]);
+            g_text.addTextToBatch(text->m_point, text->m_hash, text->m_color, text->m_shadow);
+        } else {
+            auto text = static_cast<DrawQueueItemTextColored*>(m_queue[last]);
+            g_text.addColoredTextToBatch(text->m_point, text->m_hash, text->m_colors);
+        }
+        ++last;
+    }
+
+    g_stats.addTextDraws(last - i, g_text.drawBatch(texture));
+    return last - i;
+}
+
+bool DrawQueue::cacheItem(DrawQueueItem* item)
+{
+    switch (item->m_type) {
+    case DRAW_ITEM_TEXTURED_RECT:
+        return static_cast<DrawQueueItemTexturedRect*>(item)->DrawQueueItemTexturedRect::cache();
+    case DRAW_ITEM_TEXTURE_COORDS:
+        return static_cast<DrawQueueItemTextureCoords*>(item)->DrawQueueItemTextureCoords::cache();
+    case DRAW_ITEM_FILLED_RECT:
+        return static_cast<DrawQueueItemFilledRect*>(item)->DrawQueueItemFilledRect::cache();
+    case DRAW_ITEM_FILL_COORDS:
+        return static_cast<DrawQueueItemFillCoords*>(item)->DrawQueueItemFillCoords::cache();
+    default:
+        return item->cache();
+    }
+}
+
+void DrawQueue::drawItem(DrawQueueItem* item)
+{
+    switch (item->m_type) {
+    case DRAW_ITEM_TEXTURED_RECT:
+        return static_cast<DrawQueueItemTexturedRect*>(item)->DrawQueueItemTexturedRect::draw();
+    case DRAW_ITEM_TEXTURE_COORDS:
+        return static_cast<DrawQueueItemTextureCoords*>(item)->DrawQueueItemTextureCoords::draw();
+    case DRAW_ITEM_FILLED_RECT:
+    case DRAW_ITEM_FILL_COORDS:
+        return; // nothing to draw without cache
+    default:
+        return item->draw();
+    }
+}
+
 void DrawQueue::draw(DrawType drawType)
 {
     size_t start = 0;
@@ -321,7 +653,7 @@ void DrawQueue::draw(DrawType drawType)
     while (condition != m_conditions.end() && (*condition)->m_end <= start)
         ++condition;
     // execute conditions & draw
-    for (size_t i = start; i < end; ++i) {
+    for (size_t i = start; i < end;) {
         while (!activeConditions.empty() && activeConditions.top()->m_end <= i) {
             g_drawCache.draw();
             activeConditions.top()->end(this);
@@ -334,15 +666,28 @@ void DrawQueue::draw(DrawType drawType)
             ++condition;
         }
 
-        if (!m_queue[i]->cache()) {
+        size_t drawn = 1;
+        if (!cacheItem(m_queue[i])) {
             g_drawCache.draw();
-            if (!m_queue[i]->cache()) { // try to cache again, now g_drawCache should be empty, maybe there's new space
-                m_queue[i]->draw();
+            if (!cacheItem(m_queue[i])) { // try to cache again, now g_drawCache should be empty, maybe there's new space
+                DrawQueueItemType type = m_queue[i]->m_type;
+                if (m_batched && (type == DRAW_ITEM_TEXTURED_RECT || type == DRAW_ITEM_TEXT || type == DRAW_ITEM_COLORED_TEXT)) {
+                    // merged draw can't cross condition boundary
+                    size_t mergeEnd = end;
+                    if (!activeConditions.empty())
+                        mergeEnd = std::min(mergeEnd, activeConditions.top()->m_end);
+                    if (condition != m_conditions.end())
+                        mergeEnd = std::min(mergeEnd, (*condition)->m_start);
+                    drawn = type == DRAW_ITEM_TEXTURED_RECT ? drawMerged(i, mergeEnd) : drawTexts(i, mergeEnd);
+                } else {
+                    drawItem(m_queue[i]);
+                }
             }
         }
         if (g_drawCache.getSize() >= g_drawCache.HALF_MAX_SIZE) {
             g_drawCache.draw();
         }
+        i += drawn;
     }
     g_drawCache.draw();
     // end all actibe conditions
@@ -19,6 +19,18 @@ enum DrawType : uint8_t {
     DRAW_AFTER_MAP = 2
 };
 
+// tag used by DrawQueue::draw to dispatch the framework items without virtual calls,
+// items created outside of DrawQueue (or derived from them) are always DRAW_ITEM_CUSTOM
+enum DrawQueueItemType : uint8_t {
+    DRAW_ITEM_CUSTOM = 0,
+    DRAW_ITEM_TEXTURED_RECT,
+    DRAW_ITEM_TEXTURE_COORDS,
+    DRAW_ITEM_FILLED_RECT,
+    DRAW_ITEM_FILL_COORDS,
+    DRAW_ITEM_TEXT,
+    DRAW_ITEM_COLORED_TEXT
+};
+
 struct DrawQueueItem {
     DrawQueueItem(const TexturePtr& texture, const Color& color = Color::white) : 
         m_texture(texture), m_color(color) {}
@@ -26,9 +38,13 @@ struct DrawQueueItem {
     virtual void draw() {}
     virtual void draw(const Point& pos) {}
     virtual bool cache() { return false; }
+    // screen bounds and batch key used by DrawQueue::batch, items returning false are never moved
+    virtual bool getBatchInfo(Rect& bounds, uint64_t& key) { return false; }
 
     TexturePtr m_texture;
     Color m_color;
+    DrawQueueItemType m_type = DRAW_ITEM_CUSTOM;
+    bool m_arena = false; // allocated by DrawQueueArena, destroyed but not deleted
 };
 
 struct DrawQueueItemTexturedRect : public DrawQueueItem {
@@ -78,6 +94,7 @@ struct DrawQueueItemImageWithShader : public DrawQueueItemTextureCoords {
     bool cache() override {
         return false;
     }
+    bool getBatchInfo(Rect& bounds, uint64_t& key) override;
 
     std::string m_shader;
 };
@@ -115,6 +132,7 @@ struct DrawQueueItemText : public DrawQueueItem {
     void draw();
 
     Point m_point;
+    Size m_size; // text box, used only for batching
     uint64_t m_hash;
     bool m_shadow = false;
 };
@@ -126,6 +144,7 @@ struct DrawQueueItemTextColored : public DrawQueueItem {
     void draw();
 
     Point m_point;
+    Size m_size; // text box, used only for batching
     uint64_t m_hash;
     std::vector<std::pair<int, Color>> m_colors;
     bool m_shadow = false;
@@ -186,52 +205,130 @@ struct DrawQueueConditionMark : public DrawQueueCondition {
     Color m_color;
 };
 
+// bump allocator for draw queue items, memory is kept between frames and only reset
+class DrawQueueArena {
+public:
+    enum {
+        BLOCK_SIZE = 256 * 1024
+    };
+
+    DrawQueueArena() = default;
+    DrawQueueArena(const DrawQueueArena&) = delete;
+    DrawQueueArena& operator= (const DrawQueueArena&) = delete;
+
+    void* allocate(size_t size)
+    {
+        size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        while (m_block < m_blocks.size()) {
+            Block& block = m_blocks[m_block];
+            if (block.used + size <= block.size) {
+                void* ptr = block.data.get() + block.used;
+                block.used += size;
+                return ptr;
+            }
+            m_block += 1;
+        }
+        size_t blockSize = std::max<size_t>(BLOCK_SIZE, size);
+        m_blocks.push_back(Block{ std::unique_ptr<uint8_t[]>(new uint8_t[blockSize]), blockSize, size });
+        m_block = m_blocks.size() - 1;
+        return m_blocks.back().data.get();
+    }
+
+    void reset()
+    {
+        for (auto& block : m_blocks)
+            block.used = 0;
+        m_block = 0;
+    }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (auto& block : m_blocks)
+            total += block.size;
+        return total;
+    }
+
+private:
+    static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t m_block = 0;
+};
+
 class DrawQueue {
 public:
     DrawQueue() = default;
     DrawQueue(const DrawQueue&) = delete;
     DrawQueue& operator= (const DrawQueue&) = delete;
     ~DrawQueue() {
-        for (auto& item : m_queue)
-            delete item;
-        m_queue.clear();
-        for (auto& condition : m_conditions)
-            delete condition;
-        m_conditions.clear();
+        clear();
     }
 
-    void draw(DrawType drawType = DRAW_ALL);
+    // returns empty queue, reusing the memory of queues released in previous frames
+    static std::shared_ptr<DrawQueue> create();
 
+    void draw(DrawType drawType = DRAW_ALL);
+    void clear();
+    // moves items and conditions of queue to the end of this queue, queue memory is released together with this queue
+    void append(const std::shared_ptr<DrawQueue>& queue);
+    // same items (type, texture, color, rects) and conditions in the same order, used to verify draw paths
+    bool isSameAs(const DrawQueue& other);
+    // groups items with the same texture and shader together, only items which don't overlap are moved,
+    // batched queue also draws following rects and texts with the same texture in single call
+    void batch();
+    size_t getMovedItems() { return m_movedItems; }
+
+    static const uint64_t ATLAS_BATCH_KEY = 0;
+    static uint64_t textureBatchKey(const TexturePtr& texture);
+    static uint64_t shaderBatchKey(const std::string& shader, const TexturePtr& texture);
+
+    // takes ownership of heap allocated item
     void add(DrawQueueItem* item)
     {
         if (!item) return;
         m_queue.push_back(item);
     }
-    DrawQueueItemTexturedRect* addTexturedRect(const Rect& dest, const TexturePtr& texture, const Rect& src, const Color& color = Color::white)
+    // constructs item in queue memory, it's valid until queue is cleared
+    template<typename T, typename... Args>
+    T* emplace(Args&&... args)
     {
-        DrawQueueItemTexturedRect* item(new DrawQueueItemTexturedRect(dest, texture, src, color));
+        T* item = new (m_arena.allocate(sizeof(T))) T(std::forward<Args>(args)...);
+        item->m_arena = true;
         m_queue.push_back(item);
         return item;
     }
+    DrawQueueItemTexturedRect* addTexturedRect(const Rect& dest, const TexturePtr& texture, const Rect& src, const Color& color = Color::white)
+    {
+        DrawQueueItemTexturedRect* item = emplace<DrawQueueItemTexturedRect>(dest, texture, src, color);
+        item->m_type = DRAW_ITEM_TEXTURED_RECT;
+        return item;
+    }
     void addTextureCoords(CoordsBuffer& coords, const TexturePtr& texture, const Color& color = Color::white)
     {
-        m_queue.push_back(new DrawQueueItemTextureCoords(coords, texture, color));
+        emplace<DrawQueueItemTextureCoords>(coords, texture, color)->m_type = DRAW_ITEM_TEXTURE_COORDS;
     }
     void addColoredTextureCoords(CoordsBuffer& coords, const TexturePtr& texture, const std::vector<std::pair<int, Color>>& colors)
     {
-        m_queue.push_back(new DrawQueueItemColoredTextureCoords(coords, texture, colors));
+        emplace<DrawQueueItemColoredTextureCoords>(coords, texture, colors);
     }
     void addFilledRect(const Rect& dest, const Color& color = Color::white)
     {
-        m_queue.push_back(new DrawQueueItemFilledRect(dest, color));
+        emplace<DrawQueueItemFilledRect>(dest, color)->m_type = DRAW_ITEM_FILLED_RECT;
     }
     void addFillCoords(CoordsBuffer& coords, const Color& color = Color::white)
     {
-        m_queue.push_back(new DrawQueueItemFillCoords(coords, color));
+        emplace<DrawQueueItemFillCoords>(coords, color)->m_type = DRAW_ITEM_FILL_COORDS;
     }
     void addClearRect(const Rect& dest, const Color& color = Color::white)
     {
-        m_queue.push_back(new DrawQueueItemClearRect(dest, color));
+        emplace<DrawQueueItemClearRect>(dest, color);
     }
     void addText(BitmapFontPtr font, const std::string& text, const Rect& screenCoords, Fw::AlignmentFlag align = Fw::AlignTopLeft, const Color& color = Color::white, bool shadow = false);
     void addColoredText(BitmapFontPtr font, const std::string& text, const Rect& screenCoords, Fw::AlignmentFlag align, const std::vector<std::pair<int, Color>>& colors, bool shadow = false);
@@ -260,7 +357,7 @@ public:
         if (points.empty() || width < 0)
             return;
 
-        m_queue.push_back(new DrawQueueItemLine(points, width, color));
+        emplace<DrawQueueItemLine>(points, width, color);
     }
 
     void setFrameBuffer(const Rect& dest, const Size& size, const Rect& src);
@@ -296,19 +393,19 @@ public:
     void setClip(size_t start, const Rect& clip)
     {
         if (start == m_queue.size()) return;
-        m_conditions.push_back(new DrawQueueConditionClip(start, m_queue.size(), clip));
+        m_conditions.push_back(new (m_arena.allocate(sizeof(DrawQueueConditionClip))) DrawQueueConditionClip(start, m_queue.size(), clip));
     }
 
     void setRotation(size_t start, const Point& center, float angle)
     {
         if (start == m_queue.size() || angle == 0) return;
-        m_conditions.push_back(new DrawQueueConditionRotation(start, m_queue.size(), center, angle));
+        m_conditions.push_back(new (m_arena.allocate(sizeof(DrawQueueConditionRotation))) DrawQueueConditionRotation(start, m_queue.size(), center, angle));
     }
 
     void setMark(size_t start, const Color& color)
     {
         if (start == m_queue.size()) return;
-        m_conditions.push_back(new DrawQueueConditionMark(start, m_queue.size(), color));
+        m_conditions.push_back(new (m_arena.allocate(sizeof(DrawQueueConditionMark))) DrawQueueConditionMark(start, m_queue.size(), color));
     }
 
     void markMapPosition()
@@ -328,8 +425,34 @@ public:
     }
 
 private:
+    enum {
+        MAX_BATCH_GROUPS = 64 // how many groups back an item can be moved
+    };
+
+    struct BatchGroup {
+        uint64_t key;
+        Rect bounds;
+        size_t items;
+    };
+
+    bool cacheItem(DrawQueueItem* item);
+    void drawItem(DrawQueueItem* item);
+    bool getBatchInfo(DrawQueueItem* item, Rect& bounds, uint64_t& key);
+    void batch(size_t start, size_t end);
+    size_t drawMerged(size_t i, size_t end);
+    size_t drawTexts(size_t i, size_t end);
+
+    std::vector<BatchGroup> m_batchGroups;
+    std::vector<uint32_t> m_batchItemGroup;
+    std::vector<DrawQueueItem*> m_batchItems;
+    CoordsBuffer m_mergeBuffer;
+    size_t m_movedItems = 0;
+    bool m_batched = false;
+
+    DrawQueueArena m_arena;
     std::vector<DrawQueueItem*> m_queue;
-    std::vector<DrawQueueCondition*> m_conditions;
+    std::vector<DrawQueueCondition*> m_conditions; // always allocated in m_arena
+    std::vector<std::shared_ptr<DrawQueue>> m_appended; // owners of appended items memory
     Size m_frameBufferSize;
     Rect m_frameBufferDest, m_frameBufferSrc;
     size_t mapPosition = 0;
@@ -340,6 +463,7 @@ private:
     friend struct DrawQueueConditionMark;
 };
 
-extern std::shared_ptr<DrawQueue> g_drawQueue;
+// every thread builds its own queue, MapView draws floors in parallel
+extern thread_local std::shared_ptr<DrawQueue> g_drawQueue;
 
 #endif
\ No newline at end of file
@@ -235,5 +235,5 @@ void FrameBuffer::doScreenshot(std::string fileName)
         catch (stdext::exception& e) {
             g_logger.error(std::string("Can't do map screenshot: ") + e.what());
         }
-    });
+    }, AsyncDispatcher::Background);
 }
\ No newline at end of file
@@ -31,6 +31,8 @@ void FrameBufferManager::init()
     m_temporaryFramebuffer->setSmooth(true);
     m_drawQueueTemporaryFramebuffer = FrameBufferPtr(new FrameBuffer());
     m_drawQueueTemporaryFramebuffer->setSmooth(true);
+    m_lightFramebuffer = FrameBufferPtr(new FrameBuffer());
+    m_lightFramebuffer->setSmooth(true);
 }
 
 void FrameBufferManager::terminate()
@@ -38,6 +40,7 @@ void FrameBufferManager::terminate()
     m_framebuffers.clear();
     m_temporaryFramebuffer = nullptr;
     m_drawQueueTemporaryFramebuffer = nullptr;
+    m_lightFramebuffer = nullptr;
 }
 
 FrameBufferPtr FrameBufferManager::createFrameBuffer(bool withDepth)
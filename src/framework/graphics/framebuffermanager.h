@@ -36,10 +36,12 @@ public:
     FrameBufferPtr createFrameBuffer(bool withDepth = false);
     const FrameBufferPtr& getTemporaryFrameBuffer() { return m_temporaryFramebuffer; }
     const FrameBufferPtr& getDrawQueueTemporaryFrameBuffer() { return m_drawQueueTemporaryFramebuffer; }
+    const FrameBufferPtr& getLightFrameBuffer() { return m_lightFramebuffer; }
 
 protected:
     FrameBufferPtr m_temporaryFramebuffer;
     FrameBufferPtr m_drawQueueTemporaryFramebuffer;
+    FrameBufferPtr m_lightFramebuffer;
     std::vector<FrameBufferPtr> m_framebuffers;
 };
 
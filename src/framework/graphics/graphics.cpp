@@ -77,6 +77,11 @@ void Graphics::init()
         glCheckFramebufferStatus = glCheckFramebufferStatusEXT;
         glGenerateMipmap = glGenerateMipmapEXT;
     }
+    m_canUseFBO = GLEW_ARB_framebuffer_object || GLEW_EXT_framebuffer_object;
+    m_canUseBlendMax = true;
+#else
+    m_canUseFBO = true;
+    m_canUseBlendMax = m_version.find("OpenGL ES 2") == std::string::npos || m_extensions.find("GL_EXT_blend_minmax") != std::string::npos;
 #endif
 
     // blending is always enabled
@@ -51,6 +51,8 @@ public:
     std::string getExtensions() { return m_extensions; }
 
     bool ok() { return m_ok; }
+    bool canUseFBO() { return m_canUseFBO; }
+    bool canUseBlendMax() { return m_canUseBlendMax; } // max blend equation, needed by gpu lights
     void checkForError(const std::string& function, const std::string& file, int line);
 
 private:
@@ -67,6 +69,8 @@ private:
     int m_maxTextureSize;
     int m_alphaBits;
     stdext::boolean<false> m_ok;
+    stdext::boolean<false> m_canUseFBO;
+    stdext::boolean<false> m_canUseBlendMax;
 };
 
 extern Graphics g_graphics;
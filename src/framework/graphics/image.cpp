@@ -27,6 +27,256 @@
 #include <framework/core/filestream.h>
 #include <framework/graphics/apngloader.h>
 #include <framework/util/qrcodegen.h>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define IMAGE_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define IMAGE_TARGET_AVX2
+#else
+#define IMAGE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// pixel row kernels, pixels are RGBA so alpha is the highest byte of little endian uint32
+namespace {
+
+void blitRowScalar(uint8* dst, const uint8* src, int count)
+{
+    for (int i = 0; i < count; ++i, dst += 4, src += 4) {
+        if (src[3] != 0)
+            *(uint32_t*)dst = *(const uint32_t*)src;
+    }
+}
+
+// returns false when row is fully transparent, otherwise first and last non transparent pixel
+bool alphaRowBoundsScalar(const uint8* row, int count, int& first, int& last)
+{
+    int i = 0;
+    while (i < count && row[i * 4 + 3] == 0)
+        ++i;
+    if (i == count)
+        return false;
+    first = i;
+    i = count - 1;
+    while (row[i * 4 + 3] == 0)
+        --i;
+    last = i;
+    return true;
+}
+
+#ifdef IMAGE_SIMD
+inline int lowestBit(int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline int highestBit(int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return (int)index;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+void blitRowSSE2(uint8* dst, const uint8* src, int count)
+{
+    const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), zero);
+        if (_mm_movemask_epi8(transparent) == 0xFFFF)
+            continue;
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i * 4));
+        d = _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), d);
+    }
+    blitRowScalar(dst + i * 4, src + i * 4, count - i);
+}
+
+// bit n of returned mask is set when pixel n of 4 is not transparent
+inline int opaqueMaskSSE2(const uint8* p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32((int)0xFF000000)), _mm_setzero_si128());
+    return ~_mm_movemask_ps(_mm_castsi128_ps(transparent)) & 0xF;
+}
+
+bool alphaRowBoundsSSE2(const uint8* row, int count, int& first, int& last)
+{
+    int blocks = count / 4;
+    int b = 0, mask = 0;
+    for (; b < blocks; ++b) {
+        if ((mask = opaqueMaskSSE2(row + b * 16)) != 0)
+            break;
+    }
+    if (b == blocks) { // no opaque pixels in full blocks, check the rest
+        int tailFirst, tailLast;
+        if (!alphaRowBoundsScalar(row + blocks * 16, count - blocks * 4, tailFirst, tailLast))
+            return false;
+        first = blocks * 4 + tailFirst;
+        last = blocks * 4 + tailLast;
+        return true;
+    }
+    first = b * 4 + lowestBit(mask);
+
+    int tailFirst, tailLast;
+    if (alphaRowBoundsScalar(row + blocks * 16, count - blocks * 4, tailFirst, tailLast)) {
+        last = blocks * 4 + tailLast;
+        return true;
+    }
+    for (int e = blocks - 1; e >= b; --e) {
+        if ((mask = opaqueMaskSSE2(row + e * 16)) != 0) {
+            last = e * 4 + highestBit(mask);
+            return true;
+        }
+    }
+    return true; // unreachable, block b has opaque pixel
+}
+
+IMAGE_TARGET_AVX2 void blitRowAVX2(uint8* dst, const uint8* src, int count)
+{
+    const __m256i alphaMask = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+        __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask), zero);
+        if (_mm256_movemask_epi8(transparent) == -1)
+            continue;
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i * 4));
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_blendv_epi8(s, d, transparent));
+    }
+    blitRowSSE2(dst + i * 4, src + i * 4, count - i);
+}
+
+IMAGE_TARGET_AVX2 inline int opaqueMaskAVX2(const uint8* p)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(v, _mm256_set1_epi32((int)0xFF000000)), _mm256_setzero_si256());
+    return ~_mm256_movemask_ps(_mm256_castsi256_ps(transparent)) & 0xFF;
+}
+
+IMAGE_TARGET_AVX2 bool alphaRowBoundsAVX2(const uint8* row, int count, int& first, int& last)
+{
+    int blocks = count / 8;
+    int b = 0, mask = 0;
+    for (; b < blocks; ++b) {
+        if ((mask = opaqueMaskAVX2(row + b * 32)) != 0)
+            break;
+    }
+    if (b == blocks) {
+        int tailFirst, tailLast;
+        if (!alphaRowBoundsSSE2(row + blocks * 32, count - blocks * 8, tailFirst, tailLast))
+            return false;
+        first = blocks * 8 + tailFirst;
+        last = blocks * 8 + tailLast;
+        return true;
+    }
+    first = b * 8 + lowestBit(mask);
+
+    int tailFirst, tailLast;
+    if (alphaRowBoundsSSE2(row + blocks * 32, count - blocks * 8, tailFirst, tailLast)) {
+        last = blocks * 8 + tailLast;
+        return true;
+    }
+    for (int e = blocks - 1; e >= b; --e) {
+        if ((mask = opaqueMaskAVX2(row + e * 32)) != 0) {
+            last = e * 8 + highestBit(mask);
+            return true;
+        }
+    }
+    return true;
+}
+
+bool hasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0; // osxsave and avx
+    if (!osxsave || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+enum KernelLevel {
+    KERNELS_SCALAR,
+    KERNELS_SSE2,
+    KERNELS_AVX2
+};
+
+const char* kernelLevelNames[] = { "scalar", "sse2", "avx2" };
+
+// best kernel level supported by cpu
+int kernelLevel()
+{
+#ifdef IMAGE_SIMD
+    // sse2 is part of x86_64 and every cpu able to run the client
+    static const int level = hasAVX2() ? KERNELS_AVX2 : KERNELS_SSE2;
+    return level;
+#else
+    return KERNELS_SCALAR;
+#endif
+}
+
+struct ImageKernels {
+    void (*blitRow)(uint8* dst, const uint8* src, int count);
+    bool (*alphaRowBounds)(const uint8* row, int count, int& first, int& last);
+    const char* name;
+
+    ImageKernels(int level)
+    {
+        name = kernelLevelNames[level];
+        switch (level) {
+#ifdef IMAGE_SIMD
+        case KERNELS_AVX2:
+            blitRow = &blitRowAVX2;
+            alphaRowBounds = &alphaRowBoundsAVX2;
+            break;
+        case KERNELS_SSE2:
+            blitRow = &blitRowSSE2;
+            alphaRowBounds = &alphaRowBoundsSSE2;
+            break;
+#endif
+        default:
+            blitRow = &blitRowScalar;
+            alphaRowBounds = &alphaRowBoundsScalar;
+            name = kernelLevelNames[KERNELS_SCALAR];
+            break;
+        }
+    }
+};
+
+const ImageKernels& kernels()
+{
+    static const ImageKernels instance(kernelLevel());
+    return instance;
+}
+
+}
 
 Image::Image(const Size& size, int bpp, uint8 *pixels)
 {
@@ -99,16 +349,128 @@ void Image::blit(const Point& dest, const ImagePtr& other)
 
     int width = other->getWidth(), height = other->getHeight();
     uint8* otherPixels = other->getPixelData();
-    for (int y = 0, p = 0; y < height; ++y) {
+    auto blitRow = kernels().blitRow;
+    for (int y = 0; y < height; ++y) {
         int pos = ((dest.y + y) * m_size.width() + dest.x) * 4;
-        for (int x = 0; x < width; ++x) {
-            if (otherPixels[p + 3] != 0) {
-                *(uint32_t*)&m_pixels[pos] = *(uint32_t*)&otherPixels[p];
+        blitRow(&m_pixels[pos], otherPixels + y * width * 4, width);
+    }
+}
+
+Rect Image::getAlphaBounds(const Rect& area)
+{
+    VALIDATE(m_bpp == 4);
+
+    Rect bounds(area.bottomRight(), area.topLeft()); // invalid until first opaque pixel
+    auto alphaRowBounds = kernels().alphaRowBounds;
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        int first, last;
+        if (!alphaRowBounds(getPixel(area.left(), y), area.width(), first, last))
+            continue;
+        bounds.setTop(std::min<int>(y, bounds.top()));
+        bounds.setBottom(y);
+        bounds.setLeft(std::min<int>(area.left() + first, bounds.left()));
+        bounds.setRight(std::max<int>(area.left() + last, bounds.right()));
+    }
+    return bounds;
+}
+
+std::string Image::getKernelsName()
+{
+    return kernels().name;
+}
+
+namespace {
+
+// blits every row onto random background and scans its alpha with all available kernels, scalar ones are the reference
+std::string benchmarkRows(const std::vector<std::vector<uint32_t>>& rows, int iterations)
+{
+    iterations = std::max<int>(1, iterations);
+    std::mt19937 eng(std::random_device{}());
+
+    size_t pixels = 0;
+    std::vector<std::vector<uint32_t>> backgrounds(rows.size());
+    for (size_t r = 0; r < rows.size(); ++r) {
+        pixels += rows[r].size();
+        backgrounds[r].resize(rows[r].size());
+        for (auto& pixel : backgrounds[r])
+            pixel = eng();
+    }
+
+    // results of scalar kernels, blitted rows and first/last opaque pixel (-1 for transparent row)
+    const ImageKernels scalar(KERNELS_SCALAR);
+    std::vector<std::vector<uint32_t>> reference(backgrounds), buffer(rows.size());
+    std::vector<std::pair<int, int>> referenceBounds(rows.size(), { -1, -1 }), bounds(rows.size());
+    for (size_t r = 0; r < rows.size(); ++r) {
+        scalar.blitRow((uint8*)reference[r].data(), (const uint8*)rows[r].data(), rows[r].size());
+        scalar.alphaRowBounds((const uint8*)rows[r].data(), rows[r].size(), referenceBounds[r].first, referenceBounds[r].second);
+    }
+
+    std::string result = stdext::format("rows: %d, pixels: %d", (int)rows.size(), (int)pixels);
+    for (int level = KERNELS_SCALAR; level <= kernelLevel(); ++level) {
+        const ImageKernels tested(level);
+        bool valid = true;
+        ticks_t time = 0;
+        for (int i = 0; i < iterations; ++i) {
+            buffer = backgrounds;
+            std::fill(bounds.begin(), bounds.end(), std::make_pair(-1, -1));
+            stdext::timer timer;
+            for (size_t r = 0; r < rows.size(); ++r) {
+                tested.blitRow((uint8*)buffer[r].data(), (const uint8*)rows[r].data(), rows[r].size());
+                tested.alphaRowBounds((const uint8*)rows[r].data(), rows[r].size(), bounds[r].first, bounds[r].second);
             }
-            pos += 4;
-            p += 4;
+            time += timer.elapsed_micros();
+            valid = valid && buffer == reference && bounds == referenceBounds;
         }
+        double megapixels = (double)pixels * iterations / 1000000;
+        result += stdext::format(" | %s: %d Mpx/s%s", tested.name, (int)(megapixels * 1000000 / std::max<ticks_t>(1, time)),
+                                 valid ? "" : " (INVALID)");
+    }
+    return result;
+}
+
+}
+
+std::string Image::benchmarkKernels(int width, int iterations)
+{
+    width = std::max<int>(1, width);
+    std::mt19937 eng(std::random_device{}());
+
+    // sprite like rows, runs of transparent and opaque pixels, some rows fully transparent or with single opaque pixel
+    std::vector<std::vector<uint32_t>> rows(64, std::vector<uint32_t>(width));
+    for (size_t r = 0; r < rows.size(); ++r) {
+        auto& row = rows[r];
+        for (auto& pixel : row)
+            pixel = eng() & 0x00FFFFFF;
+        if (r % 8 == 1)
+            continue;
+        if (r % 8 == 2) {
+            row[eng() % width] |= 0xFF000000;
+            continue;
+        }
+        bool opaque = eng() % 2 == 0;
+        for (int x = 0; x < width; ++x) {
+            if (eng() % 6 == 0)
+                opaque = !opaque;
+            if (opaque)
+                row[x] |= (eng() % 255 + 1) << 24;
+        }
+    }
+    return benchmarkRows(rows, iterations);
+}
+
+std::string Image::benchmarkKernelsOnImages(const std::vector<ImagePtr>& images, int iterations)
+{
+    std::vector<std::vector<uint32_t>> rows;
+    for (auto& image : images) {
+        if (!image || image->getBpp() != 4)
+            continue;
+        const uint32_t* pixels = (const uint32_t*)image->getPixelData();
+        for (int y = 0; y < image->getHeight(); ++y)
+            rows.emplace_back(pixels + y * image->getWidth(), pixels + (y + 1) * image->getWidth());
     }
+    if (rows.empty())
+        return "no images";
+    return benchmarkRows(rows, iterations);
 }
 
 void Image::paste(const ImagePtr& other)
@@ -38,6 +38,8 @@ public:
     void savePNG(const std::string& fileName);
 
     void blit(const Point& dest, const ImagePtr& other);
+    // smallest rect inside area containing all non transparent pixels, invalid rect when there are none
+    Rect getAlphaBounds(const Rect& area);
     void paste(const ImagePtr& other);
     ImagePtr upscale();
     void resize(const Size& size) { m_size = size; m_pixels.resize(size.area() * m_bpp, 0); }
@@ -62,6 +64,11 @@ public:
     uint8* getPixel(int x, int y) { return &m_pixels[(y * m_size.width() + x) * m_bpp]; }
 
     static ImagePtr fromQRCode(const std::string& code, int border);
+    static std::string getKernelsName(); // simd instruction set selected for pixel kernels
+    // compares available pixel kernels with scalar ones on random rows and returns their speed
+    static std::string benchmarkKernels(int width, int iterations);
+    // same on rows of given images, to measure real data like loaded sprites
+    static std::string benchmarkKernelsOnImages(const std::vector<ImagePtr>& images, int iterations);
 
 private:
     std::vector<uint8> m_pixels;
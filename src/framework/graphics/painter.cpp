@@ -62,9 +62,11 @@ Painter::Painter()
     m_drawNewProgram = PainterShaderProgram::create("drawNewProgram", newVertexShader, newFragmentShader);
     m_drawTextProgram = PainterShaderProgram::create("drawTextProgram", textVertexShader, textFragmentShader);
     m_drawLineProgram = PainterShaderProgram::create("drawLineProgram", lineVertexShader, lineFragmentShader);
+    m_drawLightProgram = PainterShaderProgram::create("drawLightProgram", glslMainWithTexCoordsVertexShader + glslPositionOnlyVertexShader,
+                                                      glslMainFragmentShader + glslLightFragmentShader);
 
     if (!m_drawTexturedProgram || !m_drawSolidColorProgram || !m_drawSolidColorOnTextureProgram || !m_drawOutfitLayersProgram ||
-        !m_drawNewProgram || !m_drawTextProgram || !m_drawLineProgram) {
+        !m_drawNewProgram || !m_drawTextProgram || !m_drawLineProgram || !m_drawLightProgram) {
         g_logger.fatal("Can't setup default shaders, check log file for details");
     }
 
@@ -344,12 +346,14 @@ void Painter::popTransformMatrix()
 
 void Painter::updateGlTexture()
 {
+    m_stateSwitches += 1;
     if (m_glTextureId != 0)
         glBindTexture(GL_TEXTURE_2D, m_glTextureId);
 }
 
 void Painter::updateGlCompositionMode()
 {
+    m_stateSwitches += 1;
     switch (m_compositionMode) {
     case CompositionMode_Normal:
         glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE);
@@ -383,6 +387,7 @@ void Painter::updateGlCompositionMode()
 
 void Painter::updateGlBlendEquation()
 {
+    m_stateSwitches += 1;
     if (m_blendEquation == BlendEquation_Add)
         glBlendEquation(GL_FUNC_ADD); // GL_FUNC_ADD
     else if (m_blendEquation == BlendEquation_Max)
@@ -436,6 +441,7 @@ void Painter::updateDepthFunc()
 
 void Painter::updateGlClipRect()
 {
+    m_stateSwitches += 1;
     if (m_clipRect.isValid()) {
         glEnable(GL_SCISSOR_TEST);
         glScissor(m_clipRect.left(), m_resolution.height() - m_clipRect.bottom() - 1, m_clipRect.width(), m_clipRect.height());
@@ -747,9 +753,10 @@ void Painter::setOffset(const Point& offset)
     m_shaderProgram->setOffset(offset);
 }
 
-void Painter::drawCache(const std::vector<float>& vertex, const std::vector<float>& texture, const std::vector<float>& color, int size)
+void Painter::drawCache(const std::vector<float>& vertex, const std::vector<float>& texture, const std::vector<float>& color, int size, const TexturePtr& atlas)
 {
-    setTexture(g_atlas.get(0)); // todo: remove it
+    setTexture(atlas); // todo: remove it
+    setAtlasTextures(atlas);
     // update shader with the current painter state
     m_drawNewProgram->bind();
     m_drawNewProgram->setTransformMatrix(m_transformMatrix);
@@ -155,7 +155,7 @@ public:
     void setOffset(const Point& offset);
 
     void setAtlasTextures(const TexturePtr& atlas);
-    void drawCache(const std::vector<float>& vertex, const std::vector<float>& texture, const std::vector<float>& color, int size);
+    void drawCache(const std::vector<float>& vertex, const std::vector<float>& texture, const std::vector<float>& color, int size, const TexturePtr& atlas);
 
     void setColor(const Color& color) { m_color = color; }
     void setShaderProgram(const PainterShaderProgramPtr& shaderProgram) { setShaderProgram(shaderProgram.get()); }
@@ -184,7 +184,8 @@ public:
 
     int draws() { return m_draws; }
     int calls() { return m_calls; }
-    void resetDraws() { m_draws = m_calls = 0; }
+    int stateSwitches() { return m_stateSwitches + ShaderProgram::getProgramSwitches(); }
+    void resetDraws() { m_draws = m_calls = m_stateSwitches = 0; ShaderProgram::resetProgramSwitches(); }
 
     void setDrawColorOnTextureShaderProgram()
     {
@@ -199,6 +200,11 @@ public:
     {
         setShaderProgram(m_drawOutfitLayersProgram);
     }
+    // radial light, texture coords are offset from center in tiles, color alpha is intensity
+    void setDrawLightProgram()
+    {
+        setShaderProgram(m_drawLightProgram);
+    }
 
 protected:
     void updateGlTexture();
@@ -240,6 +246,7 @@ protected:
 #endif
     int m_draws = 0;
     int m_calls = 0;
+    int m_stateSwitches = 0;
 
 private:
     PainterShaderProgram* m_drawProgram;
@@ -252,6 +259,7 @@ private:
 
     PainterShaderProgramPtr m_drawTextProgram;
     PainterShaderProgramPtr m_drawLineProgram;
+    PainterShaderProgramPtr m_drawLightProgram;
 };
 
 extern Painter* g_painter;
@@ -26,6 +26,7 @@
 #include <framework/core/application.h>
 
 uint ShaderProgram::m_currentProgram = 0;
+int ShaderProgram::m_programSwitches = 0;
 
 ShaderProgram::ShaderProgram(const std::string& name) : m_name(name)
 {
@@ -141,6 +142,7 @@ bool ShaderProgram::bind()
         }
         glUseProgram(m_programId);
         m_currentProgram = m_programId;
+        m_programSwitches += 1;
     }
     return true;
 }
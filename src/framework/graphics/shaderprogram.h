@@ -47,6 +47,8 @@ public:
     virtual bool link();
     bool bind();
     static void release();
+    static int getProgramSwitches() { return m_programSwitches; }
+    static void resetProgramSwitches() { m_programSwitches = 0; }
     std::string log();
 
     static void disableAttributeArray(int location) { glDisableVertexAttribArray(location); }
@@ -99,6 +101,7 @@ private:
     bool m_linked;
     uint m_programId;
     static uint m_currentProgram;
+    static int m_programSwitches;
     ShaderList m_shaders;
     std::array<int, MAX_UNIFORM_LOCATIONS> m_uniformLocations;
 };
@@ -68,6 +68,15 @@ static const std::string glslTextureSrcFragmentShader = "\n\
     }\n";
 
 
+// texture coords are offset from light center in tiles, alpha of color is light intensity
+static const std::string glslLightFragmentShader = "\n\
+    varying vec2 v_TexCoord;\n\
+    uniform vec4 u_Color;\n\
+    vec4 calculatePixel() {\n\
+        float intensity = clamp((u_Color.a * 255.0 - length(v_TexCoord)) * 0.2, 0.0, 1.0);\n\
+        return vec4(u_Color.rgb * intensity * step(0.01, intensity), 1.0);\n\
+    }\n";
+
 static const std::string glslSolidColorFragmentShader = "\n\
     uniform vec4 u_Color;\n\
     vec4 calculatePixel() {\n\
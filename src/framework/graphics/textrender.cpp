@@ -2,6 +2,7 @@
 #include "textrender.h"
 #include <framework/core/logger.h>
 #include <framework/core/eventdispatcher.h>
+#include <sstream>
 
 TextRender g_text;
 
@@ -12,35 +13,78 @@ void TextRender::init()
 
 void TextRender::terminate()
 {
-    for (auto& cache : m_cache) {
-        cache.clear();
+    for (int i = 0; i < INDEXES; ++i) {
+        std::lock_guard<std::mutex> lock(m_mutex[i]);
+        m_cache[i].clear();
+        m_bytes[i] = 0;
     }
+    m_totalBytes = 0;
 }
 
 void TextRender::poll()
 {
-    static int iteration = 0;
-    int index = (iteration++) % INDEXES;
+    int index = (m_pollIndex++) % INDEXES;
     std::lock_guard<std::mutex> lock(m_mutex[index]);
     auto& cache = m_cache[index];
-    if (cache.size() < 100)
+    if (cache.empty())
         return;
 
-    ticks_t dropPoint = g_clock.millis();
-    if (cache.size() > 500)
-        dropPoint -= 10;
-    else if (cache.size() > 250)
-        dropPoint -= 100;
-    else
-        dropPoint -= 1000;
+    ticks_t now = g_clock.millis();
+    auto evict = [&](std::map<uint64_t, std::shared_ptr<TextRenderCache>>::iterator it) {
+        m_bytes[index] -= it->second->bytes;
+        m_totalBytes -= it->second->bytes;
+        return cache.erase(it);
+    };
 
     for (auto it = cache.begin(); it != cache.end(); ) {
-        if (it->second->lastUse < dropPoint) {
-            it = cache.erase(it);
+        if (now - it->second->lastUse > (ticks_t)IDLE_TIME * (1 + it->second->uses)) {
+            it = evict(it);
+            m_expired += 1;
             continue;
         }
         ++it;
     }
+
+    // over budget, every shard should fit in its part of it
+    size_t shardBytes = m_maxBytes / INDEXES;
+    if (m_totalBytes <= (int64_t)m_maxBytes || m_bytes[index] <= shardBytes)
+        return;
+
+    // frequently used texts (names, labels) are kept much longer than short lived ones (damage, messages)
+    std::vector<std::pair<float, uint64_t>> candidates;
+    for (auto& it : cache) {
+        ticks_t age = now - it.second->lastUse;
+        if (age >= MIN_EVICTION_AGE)
+            candidates.emplace_back((float)age / (1 + it.second->uses), it.first);
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<float, uint64_t>>());
+    for (auto& candidate : candidates) {
+        if (m_bytes[index] <= shardBytes)
+            break;
+        evict(cache.find(candidate.second));
+        m_evictions += 1;
+    }
+}
+
+std::string TextRender::getStats()
+{
+    size_t entries = 0;
+    for (int i = 0; i < INDEXES; ++i) {
+        std::lock_guard<std::mutex> lock(m_mutex[i]);
+        entries += m_cache[i].size();
+    }
+    uint64_t hits = m_hits, misses = m_misses;
+    std::stringstream ss;
+    ss << "entries: " << entries << " | memory: " << m_totalBytes / 1024 << "/" << m_maxBytes / 1024 << " KB"
+        << " | hit ratio: " << (hits * 100) / std::max<uint64_t>(1, hits + misses) << "%"
+        << " | expired: " << m_expired << " | evicted: " << m_evictions;
+    return ss.str();
+}
+
+size_t TextRender::calculateBytes(TextRenderCache& cache)
+{
+    // map node, shared_ptr control block, text and client side vertex and texture coords
+    return sizeof(TextRenderCache) + 64 + cache.text.capacity() + (size_t)cache.coords.getVertexCount() * 4 * sizeof(float);
 }
 
 uint64_t TextRender::addText(BitmapFontPtr font, const std::string& text, const Size& size, Fw::AlignmentFlag align)
@@ -60,7 +104,14 @@ uint64_t TextRender::addText(BitmapFontPtr font, const std::string& text, const
     m_mutex[index].lock();
     auto it = m_cache[index].find(hash);
     if (it == m_cache[index].end()) {
-        m_cache[index][hash] = std::shared_ptr<TextRenderCache>(new TextRenderCache{ font, text, size, align, font->getTexture(), CoordsBuffer(), g_clock.millis() });
+        auto cache = std::shared_ptr<TextRenderCache>(new TextRenderCache{ font, text, size, align, font->getTexture(), CoordsBuffer(), g_clock.millis() });
+        cache->bytes = calculateBytes(*cache);
+        m_bytes[index] += cache->bytes;
+        m_totalBytes += cache->bytes;
+        m_cache[index][hash] = cache;
+        m_misses += 1;
+    } else {
+        m_hits += 1;
     }
     m_mutex[index].unlock();
     return hash;
@@ -73,25 +124,46 @@ void TextRender::drawText(const Rect& rect, const std::string& text, BitmapFontP
     drawText(rect.topLeft(), hash, color, shadow);
 }
 
-void TextRender::drawText(const Point& pos, uint64_t hash, const Color& color, bool shadow)
+std::shared_ptr<TextRenderCache> TextRender::getCache(uint64_t hash)
 {
-    VALIDATE_GRAPHICS_THREAD();
     int index = hash % INDEXES;
     m_mutex[index].lock();
     auto _it = m_cache[index].find(hash);
     if (_it == m_cache[index].end()) {
         m_mutex[index].unlock();
-        return;
+        return nullptr;
     }
     auto it = _it->second;
     it->lastUse = g_clock.millis();
+    if (it->lastUse - it->lastCountedUse >= USE_INTERVAL) {
+        it->lastCountedUse = it->lastUse;
+        it->uses = std::min<uint32_t>(it->uses + 1, MAX_USES);
+    }
     m_mutex[index].unlock();
     if (it->font) { // calculate text coords
         it->font->calculateDrawTextCoords(it->coords, it->text, Rect(0, 0, it->size), it->align);
         it->coords.cache();
-        it->text.clear();
+        std::string().swap(it->text);
         it->font.reset();
+
+        std::lock_guard<std::mutex> lock(m_mutex[index]);
+        auto cached = m_cache[index].find(hash);
+        if (cached != m_cache[index].end() && cached->second == it) {
+            size_t bytes = calculateBytes(*it);
+            m_bytes[index] += bytes - it->bytes;
+            m_totalBytes += (int64_t)bytes - (int64_t)it->bytes;
+            it->bytes = bytes;
+        }
     }
+    return it;
+}
+
+void TextRender::drawText(const Point& pos, uint64_t hash, const Color& color, bool shadow)
+{
+    VALIDATE_GRAPHICS_THREAD();
+    auto it = getCache(hash);
+    if (!it)
+        return;
 
     if (shadow) {
         auto shadowPos = Point(pos);
@@ -108,22 +180,100 @@ void TextRender::drawColoredText(const Point& pos, uint64_t hash, const std::vec
     VALIDATE_GRAPHICS_THREAD();
     if (colors.empty())
         return drawText(pos, hash, Color::white);
-    int index = hash % INDEXES;
-    m_mutex[index].lock();
-    auto _it = m_cache[index].find(hash);
-    if (_it == m_cache[index].end()) {
-        m_mutex[index].unlock();
+    auto it = getCache(hash);
+    if (!it)
+        return;
+    g_painter->drawText(pos, it->coords, colors, it->texture);
+}
+
+void TextRender::addTextToBatch(const Point& pos, uint64_t hash, const Color& color, bool shadow)
+{
+    VALIDATE_GRAPHICS_THREAD();
+    auto it = getCache(hash);
+    if (!it)
         return;
+
+    int vertices = it->coords.getVertexCount();
+    if (shadow) {
+        m_shadowBatch.add(it->coords, pos + Point(1, 1), Color::black, 0, vertices);
+        m_batchCalls += 1;
     }
-    auto it = _it->second;
-    it->lastUse = g_clock.millis();
-    m_mutex[index].unlock();
-    if (it->font) { // calculate text coords
-        it->font->calculateDrawTextCoords(it->coords, it->text, Rect(0, 0, it->size), it->align);
-        it->coords.cache();
-        it->text.clear();
-        it->font.reset();
+    m_batch.add(it->coords, pos, color, 0, vertices);
+    m_batchCalls += 1;
+}
+
+void TextRender::addColoredTextToBatch(const Point& pos, uint64_t hash, const std::vector<std::pair<int, Color>>& colors)
+{
+    VALIDATE_GRAPHICS_THREAD();
+    if (colors.empty())
+        return addTextToBatch(pos, hash, Color::white);
+    auto it = getCache(hash);
+    if (!it)
+        return;
+
+    // colors are given for ranges of glyphs, 6 vertices each
+    int vertices = it->coords.getVertexCount();
+    int first = 0;
+    for (auto& cp : colors) {
+        int last = std::min(vertices, cp.first * 6);
+        if (last > first)
+            m_batch.add(it->coords, pos, cp.second, first, last);
+        first = std::max(first, last);
+        m_batchCalls += 1;
     }
-    g_painter->drawText(pos, it->coords, colors, it->texture);
 }
 
+int TextRender::drawBatch(const TexturePtr& texture)
+{
+    VALIDATE_GRAPHICS_THREAD();
+    int calls = 0;
+    if (m_shadowBatch.size > 0) {
+        m_shadowBatch.draw(texture);
+        calls += 1;
+    }
+    if (m_batch.size > 0) {
+        m_batch.draw(texture);
+        calls += 1;
+    }
+    int saved = m_batchCalls - calls;
+    m_batchCalls = 0;
+    return saved;
+}
+
+void TextRender::Batch::add(CoordsBuffer& coords, const Point& offset, const Color& color, int firstVertex, int lastVertex)
+{
+    int count = lastVertex - firstVertex;
+    if (count <= 0)
+        return;
+    if ((int)colors.size() < (size + count) * 4) {
+        size_t capacity = std::max<size_t>(1024, (size + count) * 2);
+        dest.resize(capacity * 2);
+        src.resize(capacity * 2);
+        colors.resize(capacity * 4);
+    }
+
+    const float* vertices = coords.getVertexArray() + firstVertex * 2;
+    const float* texCoords = coords.getTextureCoordArray() + firstVertex * 2;
+    float* destData = dest.data() + size * 2;
+    float* srcData = src.data() + size * 2;
+    for (int i = 0; i < count * 2; i += 2) {
+        destData[i] = vertices[i] + offset.x;
+        destData[i + 1] = vertices[i + 1] + offset.y;
+        srcData[i] = texCoords[i];
+        srcData[i + 1] = texCoords[i + 1];
+    }
+    float* colorData = colors.data() + size * 4;
+    for (int i = 0; i < count * 4; i += 4) {
+        colorData[i] = color.rF();
+        colorData[i + 1] = color.gF();
+        colorData[i + 2] = color.bF();
+        colorData[i + 3] = color.aF();
+    }
+    size += count;
+}
+
+void TextRender::Batch::draw(const TexturePtr& texture)
+{
+    g_painter->drawCache(dest, src, colors, size, texture);
+    size = 0;
+}
@@ -1,6 +1,7 @@
 #ifndef TEXTRENDER_H
 #define TEXTRENDER_H
 
+#include <atomic>
 #include <map>
 #include <mutex>
 #include "bitmapfont.h"
@@ -15,23 +16,73 @@ struct TextRenderCache {
     TexturePtr texture;
     CoordsBuffer coords;
     ticks_t lastUse;
+    ticks_t lastCountedUse = 0;
+    uint32_t uses = 0; // number of USE_INTERVAL periods in which text was drawn, up to MAX_USES
+    size_t bytes = 0; // estimated memory usage, updated with shard mutex locked
 };
 
 class TextRender
 {
     static const int INDEXES = 10;
 public:
+    enum {
+        DEFAULT_MAX_BYTES = 8 * 1024 * 1024,
+        IDLE_TIME = 1000, // unused text is dropped after IDLE_TIME * (1 + uses) ms
+        USE_INTERVAL = 500,
+        MAX_USES = 30,
+        MIN_EVICTION_AGE = 100 // texts used in last MIN_EVICTION_AGE ms are never evicted
+    };
+
     void init();
     void terminate();
+    // checks one shard per call, drops expired texts and the least valuable ones when over memory budget
     void poll();
+
+    void setMaxBytes(uint64_t bytes) { m_maxBytes = std::max<uint64_t>(bytes, 64 * 1024); }
+    uint64_t getMaxBytes() { return m_maxBytes; }
+    std::string getStats();
+
     uint64_t addText(BitmapFontPtr font, const std::string& text, const Size& size, Fw::AlignmentFlag align = Fw::AlignTopLeft);
     void drawText(const Rect& rect, const std::string& text, BitmapFontPtr font, const Color& color = Color::white, Fw::AlignmentFlag align = Fw::AlignTopLeft, bool shadow = false);
     void drawText(const Point& pos, uint64_t hash, const Color& color, bool shadow = false);
     void drawColoredText(const Point& pos, uint64_t hash, const std::vector<std::pair<int, Color>>& colors, bool shadow = false);
 
+    // texts are appended to one vertex batch and drawn by drawBatch in single call, shadows in one more call before them
+    void addTextToBatch(const Point& pos, uint64_t hash, const Color& color, bool shadow = false);
+    void addColoredTextToBatch(const Point& pos, uint64_t hash, const std::vector<std::pair<int, Color>>& colors);
+    // returns draw calls saved by batching
+    int drawBatch(const TexturePtr& texture);
+
 private:
+    struct Batch {
+        void add(CoordsBuffer& coords, const Point& offset, const Color& color, int firstVertex, int lastVertex);
+        void draw(const TexturePtr& texture);
+
+        std::vector<float> dest;
+        std::vector<float> src;
+        std::vector<float> colors;
+        int size = 0;
+    };
+
+    std::shared_ptr<TextRenderCache> getCache(uint64_t hash);
+    static size_t calculateBytes(TextRenderCache& cache);
+
     std::map<uint64_t, std::shared_ptr<TextRenderCache>> m_cache[INDEXES];
     std::mutex m_mutex[INDEXES];
+    size_t m_bytes[INDEXES] = {}; // guarded by m_mutex
+    int m_pollIndex = 0;
+
+    std::atomic<uint64_t> m_maxBytes{ DEFAULT_MAX_BYTES };
+    std::atomic<int64_t> m_totalBytes{ 0 };
+    std::atomic<uint64_t> m_hits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+    std::atomic<uint64_t> m_expired{ 0 };
+    std::atomic<uint64_t> m_evictions{ 0 };
+
+    // render thread only
+    Batch m_batch;
+    Batch m_shadowBatch;
+    int m_batchCalls = 0; // calls needed without batching
 };
 
 extern TextRender g_text;
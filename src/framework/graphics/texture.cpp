@@ -84,6 +84,7 @@ void Texture::replace(const ImagePtr& image)
         g_logger.fatal("Texture can't be replaced with null image!");
     }
     m_id = 0;
+    m_uploaded = false;
     m_image = image;
     setupSize(m_image->getSize());
     m_needsUpdate = true;
@@ -118,6 +119,7 @@ void Texture::update()
         }
         m_image = nullptr; // free image
         m_needsUpdate = true;
+        m_uploaded = true;
         g_graphics.checkForError(__FUNCTION__, __FILE__, __LINE__);
     }
     
@@ -59,6 +59,8 @@ public:
     bool hasRepeat() { return m_repeat; }
     bool hasMipmaps() { return m_hasMipmaps; }
     bool canCache() { return m_canCache; }
+    // set by render thread once pixels are in gl memory, can be checked from any thread
+    bool isUploaded() { return m_uploaded; }
     virtual bool isAnimatedTexture() { return false; }
 
 protected:
@@ -83,6 +85,7 @@ protected:
     bool m_buildHardwareMipmaps = false;
     bool m_needsUpdate = false;
     bool m_canCache = true;
+    std::atomic_bool m_uploaded = { false };
     ImagePtr m_image;
 };
 
@@ -41,6 +41,38 @@ void TextureManager::terminate()
 {
     m_textures.clear();
     m_animatedTextures.clear();
+    std::lock_guard<std::mutex> lock(m_uploadMutex);
+    m_uploadQueue.clear();
+}
+
+void TextureManager::scheduleUpload(const TexturePtr& texture)
+{
+    std::lock_guard<std::mutex> lock(m_uploadMutex);
+    m_uploadQueue.push_back(texture);
+}
+
+void TextureManager::uploadScheduledTextures()
+{
+    std::unique_lock<std::mutex> lock(m_uploadMutex);
+    if (m_uploadQueue.empty())
+        return;
+
+    AutoStat s(STATS_RENDER, "UploadTextures");
+    size_t used = 0;
+    while (!m_uploadQueue.empty()) {
+        TexturePtr texture = m_uploadQueue.front();
+        if (texture->ref_count() > 2) { // not released by owner
+            // first upload in frame is always allowed, otherwise big textures would never be uploaded
+            size_t bytes = texture->getSize().area() * 4;
+            if (m_uploadBudget > 0 && used > 0 && used + bytes > (size_t)m_uploadBudget)
+                break;
+            used += bytes;
+            lock.unlock();
+            texture->update();
+            lock.lock();
+        }
+        m_uploadQueue.pop_front();
+    }
 }
 
 void TextureManager::clearCache()
@@ -39,11 +39,21 @@ public:
     TexturePtr getTexture(const std::string& fileName);
     TexturePtr loadTexture(std::stringstream& file, const std::string& source);
 
+    // limits amount of pixel data of scheduled textures uploaded in single frame, 0 means no limit
+    void setUploadBudget(int bytes) { m_uploadBudget = std::max<int>(0, bytes); }
+    int getUploadBudget() { return m_uploadBudget; }
+    // texture is uploaded by render thread in uploadScheduledTextures, check it with Texture::isUploaded
+    void scheduleUpload(const TexturePtr& texture);
+    void uploadScheduledTextures();
+
 private:
     std::unordered_map<std::string, TexturePtr> m_textures;
     std::vector<AnimatedTexturePtr> m_animatedTextures;
     ScheduledEventPtr m_liveReloadEvent;
     std::list<uint> m_texturesToRelease;
+    std::atomic_int m_uploadBudget = { 4 * 1024 * 1024 };
+    std::mutex m_uploadMutex;
+    std::deque<TexturePtr> m_uploadQueue;
 };
 
 extern TextureManager g_textures;
@@ -24,6 +24,7 @@
 #include <framework/core/adaptiverenderer.h>
 #include <framework/luaengine/luainterface.h>
 #include <framework/core/eventdispatcher.h>
+#include <framework/core/asyncdispatcher.h>
 #include <framework/core/configmanager.h>
 #include <framework/core/config.h>
 #include <framework/otml/otml.h>
@@ -48,6 +49,8 @@
 #ifdef FW_GRAPHICS
 #include <framework/graphics/graphics.h>
 #include <framework/graphics/atlas.h>
+#include <framework/graphics/textrender.h>
+#include <framework/graphics/image.h>
 #include <framework/platform/platformwindow.h>
 #include <framework/graphics/fontmanager.h>
 #include <framework/graphics/shadermanager.h>
@@ -165,6 +168,8 @@ void Application::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_crypt", "rsaSetPrivateKey", &Crypt::rsaSetPrivateKey, &g_crypt);
     g_lua.bindSingletonFunction("g_crypt", "rsaCheckKey", &Crypt::rsaCheckKey, &g_crypt);
     g_lua.bindSingletonFunction("g_crypt", "rsaGetSize", &Crypt::rsaGetSize, &g_crypt);
+    g_lua.bindSingletonFunction("g_crypt", "getXteaImplementation", &Crypt::getXteaImplementation, &g_crypt);
+    g_lua.bindSingletonFunction("g_crypt", "benchmarkXtea", &Crypt::benchmarkXtea, &g_crypt);
 
     // Clock
     g_lua.registerSingletonClass("g_clock");
@@ -207,6 +212,12 @@ void Application::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_stats", "getSleepTime", &Stats::getSleepTime, &g_stats);
     g_lua.bindSingletonFunction("g_stats", "resetSleepTime", &Stats::resetSleepTime, &g_stats);
     g_lua.bindSingletonFunction("g_stats", "getWidgetsInfo", &Stats::getWidgetsInfo, &g_stats);
+    g_lua.bindSingletonFunction("g_stats", "getDrawInfo", &Stats::getDrawInfo, &g_stats);
+    g_lua.bindSingletonFunction("g_stats", "startTrace", &Stats::startTrace, &g_stats);
+    g_lua.bindSingletonFunction("g_stats", "stopTrace", &Stats::stopTrace, &g_stats);
+    g_lua.bindSingletonFunction("g_stats", "isTracing", &Stats::isTracing, &g_stats);
+    g_lua.bindSingletonFunction("g_stats", "exportTrace", &Stats::exportTrace, &g_stats);
+    g_lua.bindSingletonFunction("g_stats", "getTraceInfo", &Stats::getTraceInfo, &g_stats);
     
     g_lua.registerSingletonClass("g_extras");
     g_lua.bindSingletonFunction("g_extras", "set", &Extras::set, &g_extras);
@@ -214,8 +225,18 @@ void Application::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_extras", "getDescription", &Extras::getDescription, &g_extras);
     g_lua.bindSingletonFunction("g_extras", "getAll", &Extras::getAll, &g_extras);
 
+    g_lua.registerSingletonClass("g_asyncDispatcher");
+    g_lua.bindSingletonFunction("g_asyncDispatcher", "getStats", &AsyncDispatcher::getStats, &g_asyncDispatcher);
+
     g_lua.registerSingletonClass("g_atlas");
     g_lua.bindSingletonFunction("g_atlas", "getStats", &Atlas::getStats, &g_atlas);
+    g_lua.bindSingletonFunction("g_atlas", "setMaxPages", &Atlas::setMaxPages, &g_atlas);
+    g_lua.bindSingletonFunction("g_atlas", "getMaxPages", &Atlas::getMaxPages, &g_atlas);
+
+    g_lua.registerSingletonClass("g_text");
+    g_lua.bindSingletonFunction("g_text", "getStats", &TextRender::getStats, &g_text);
+    g_lua.bindSingletonFunction("g_text", "setMaxBytes", &TextRender::setMaxBytes, &g_text);
+    g_lua.bindSingletonFunction("g_text", "getMaxBytes", &TextRender::getMaxBytes, &g_text);
 
     // ModuleManager
     g_lua.registerSingletonClass("g_modules");
@@ -233,6 +254,8 @@ void Application::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_dispatcher", "addEvent", &EventDispatcher::addEventEx, &g_dispatcher);
     g_lua.bindSingletonFunction("g_dispatcher", "scheduleEvent", &EventDispatcher::scheduleEventEx, &g_dispatcher);
     g_lua.bindSingletonFunction("g_dispatcher", "cycleEvent", &EventDispatcher::cycleEventEx, &g_dispatcher);
+    g_lua.bindSingletonFunction("g_dispatcher", "getScheduledEventsCount", &EventDispatcher::getScheduledEventsCount, &g_dispatcher);
+    g_lua.bindSingletonFunction("g_dispatcher", "benchmark", &EventDispatcher::benchmark);
 
     // ResourceManager
     g_lua.registerSingletonClass("g_resources");
@@ -329,6 +352,8 @@ void Application::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_app", "scale", &GraphicalApplication::scale, &g_app);
     g_lua.bindSingletonFunction("g_app", "setSmooth", &GraphicalApplication::setSmooth, &g_app);
     g_lua.bindSingletonFunction("g_app", "doMapScreenshot", &GraphicalApplication::doMapScreenshot, &g_app);
+    g_lua.bindSingletonFunction("g_app", "setDrawBatching", &GraphicalApplication::setDrawBatching, &g_app);
+    g_lua.bindSingletonFunction("g_app", "isDrawBatching", &GraphicalApplication::isDrawBatching, &g_app);
 
     // AdaptiveRenderer
     g_lua.registerSingletonClass("g_adaptiveRenderer");
@@ -394,12 +419,16 @@ void Application::registerLuaFunctions()
     g_lua.bindSingletonFunction("g_graphics", "getRenderer", &Graphics::getRenderer, &g_graphics);
     g_lua.bindSingletonFunction("g_graphics", "getVersion", &Graphics::getVersion, &g_graphics);
     g_lua.bindSingletonFunction("g_graphics", "getExtensions", &Graphics::getExtensions, &g_graphics);
+    g_lua.bindSingletonFunction("g_graphics", "canUseFBO", &Graphics::canUseFBO, &g_graphics);
+    g_lua.bindSingletonFunction("g_graphics", "canUseBlendMax", &Graphics::canUseBlendMax, &g_graphics);
 
     // Textures
     g_lua.registerSingletonClass("g_textures");
     g_lua.bindSingletonFunction("g_textures", "preload", &TextureManager::preload, &g_textures);
     g_lua.bindSingletonFunction("g_textures", "clearCache", &TextureManager::clearCache, &g_textures);
     g_lua.bindSingletonFunction("g_textures", "reload", &TextureManager::reload, &g_textures);
+    g_lua.bindSingletonFunction("g_textures", "setUploadBudget", &TextureManager::setUploadBudget, &g_textures);
+    g_lua.bindSingletonFunction("g_textures", "getUploadBudget", &TextureManager::getUploadBudget, &g_textures);
 
     // Shaders
     g_lua.registerSingletonClass("g_shaders");
@@ -832,6 +861,10 @@ void Application::registerLuaFunctions()
     g_lua.bindClassMemberFunction<UITextEdit>("setPlaceholderAlign", &UITextEdit::setPlaceholderAlign);
     g_lua.bindClassMemberFunction<UITextEdit>("setPlaceholderFont", &UITextEdit::setPlaceholderFont);
 
+    g_lua.registerClass<Image>();
+    g_lua.bindClassStaticFunction<Image>("getKernelsName", &Image::getKernelsName);
+    g_lua.bindClassStaticFunction<Image>("benchmarkKernels", &Image::benchmarkKernels);
+
     g_lua.registerClass<ShaderProgram>();
     g_lua.registerClass<PainterShaderProgram>();
     g_lua.bindClassMemberFunction<PainterShaderProgram>("addMultiTexture", &PainterShaderProgram::addMultiTexture);
@@ -847,6 +880,7 @@ void Application::registerLuaFunctions()
     // Connection
     g_lua.registerClass<Connection>();
     g_lua.bindClassMemberFunction<Connection>("getIp", &Connection::getIp);
+    g_lua.bindClassStaticFunction<Connection>("getSendStats", &Connection::getSendStats);
 
     // Protocol
     g_lua.registerClass<Protocol>();
@@ -865,6 +899,8 @@ void Application::registerLuaFunctions()
     g_lua.bindClassMemberFunction<Protocol>("enableXteaEncryption", &Protocol::enableXteaEncryption);
     g_lua.bindClassMemberFunction<Protocol>("enableChecksum", &Protocol::enableChecksum);
     g_lua.bindClassMemberFunction<Protocol>("enableBigPackets", &Protocol::enableBigPackets);
+    g_lua.bindClassMemberFunction<Protocol>("enableCoalescedRecv", &Protocol::enableCoalescedRecv);
+    g_lua.bindClassMemberFunction<Protocol>("getPacketsPerRead", &Protocol::getPacketsPerRead);
 
     // InputMessage
     g_lua.registerClass<InputMessage>();
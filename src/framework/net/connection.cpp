@@ -28,9 +28,13 @@
 #include <framework/util/stats.h>
 #include <framework/util/extras.h>
 #include <chrono>
+#include <sstream>
 
 asio::io_service g_ioService;
-std::list<std::shared_ptr<asio::streambuf>> Connection::m_outputStreams;
+std::vector<Connection::SendChunkPtr> Connection::m_sendChunkPool;
+uint64 Connection::m_sentBytes = 0;
+uint64 Connection::m_sentPackets = 0;
+uint64 Connection::m_writeCalls = 0;
 
 Connection::Connection() :
         m_readTimer(g_ioService),
@@ -46,7 +50,11 @@ Connection::Connection() :
 Connection::~Connection()
 {
     VALIDATE(!g_app.isTerminated());
+    // pending handlers keep connection alive, so destroyed one has nothing left to flush
+    m_pendingChunks.clear();
+    m_writing = false;
     close();
+    closeSocket();
 }
 
 void Connection::poll()
@@ -60,7 +68,16 @@ void Connection::poll()
 void Connection::terminate()
 {
     g_ioService.stop();
-    m_outputStreams.clear();
+    m_sendChunkPool.clear();
+}
+
+std::string Connection::getSendStats()
+{
+    uint64 writes = std::max<uint64>(1, m_writeCalls);
+    std::stringstream ss;
+    ss << "writes: " << m_writeCalls << " | packets: " << m_sentPackets << " | bytes: " << m_sentBytes
+        << " | packets per write: " << (double)m_sentPackets / writes << " | bytes per write: " << m_sentBytes / writes;
+    return ss.str();
 }
 
 void Connection::close()
@@ -68,8 +85,10 @@ void Connection::close()
     if(!m_connected && !m_connecting)
         return;
 
-    // flush send data before disconnecting on clean connections
-    if(m_connected && !m_error && m_outputStream)
+    // flush send data before disconnecting on clean connections,
+    // socket stays open until written chunks and chunks queued during current write are sent
+    bool flush = m_connected && !m_error && (m_writing || !m_pendingChunks.empty());
+    if(flush)
         internal_write();
 
     m_connecting = false;
@@ -80,9 +99,33 @@ void Connection::close()
 
     m_resolver.cancel();
     m_readTimer.cancel();
+    m_delayedWriteTimer.cancel();
+
+    if(flush) {
+        m_closing = true; // write timer still limits the flush
+        return;
+    }
+    closeSocket();
+}
+
+void Connection::closeSocket()
+{
+    m_closing = false;
     m_writeTimer.cancel();
     m_delayedWriteTimer.cancel();
 
+    // nothing from this socket can be sent to the next one
+    releaseChunks(m_pendingChunks);
+    m_pendingPackets = 0;
+    m_writeScheduled = false;
+    if(m_writing) {
+        for(auto& chunk : m_writingChunks)
+            m_abandonedChunks.push_back(std::move(chunk));
+        m_writingChunks.clear();
+        m_writing = false;
+    }
+    m_writeId += 1;
+
     if(m_socket.is_open()) {
         boost::system::error_code ec;
         m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
@@ -90,8 +133,21 @@ void Connection::close()
     }
 }
 
+void Connection::releaseChunks(std::vector<SendChunkPtr>& chunks)
+{
+    for(auto& chunk : chunks) {
+        if(m_sendChunkPool.size() >= MAX_POOLED_SEND_CHUNKS)
+            break;
+        chunk->size = 0;
+        m_sendChunkPool.push_back(std::move(chunk));
+    }
+    chunks.clear();
+}
+
 void Connection::connect(const std::string& host, uint16 port, const std::function<void()>& connectCallback)
 {
+    // drops flush of previous connection and all its write state
+    closeSocket();
     m_connected = false;
     m_connecting = true;
     m_error.clear();
@@ -119,35 +175,54 @@ void Connection::write(uint8* buffer, size_t size)
     if(!m_connected)
         return;
 
-    // we can't send the data right away, otherwise we could create tcp congestion
-    if(!m_outputStream) {
-        if(!m_outputStreams.empty()) {
-            m_outputStream = m_outputStreams.front();
-            m_outputStreams.pop_front();
-        } else
-            m_outputStream = std::shared_ptr<asio::streambuf>(new asio::streambuf);
+    // copy data to the last pending chunk, taking new chunks from the pool when it's full
+    while(size > 0) {
+        if(m_pendingChunks.empty() || m_pendingChunks.back()->size == SEND_CHUNK_SIZE) {
+            if(!m_sendChunkPool.empty()) {
+                m_pendingChunks.push_back(std::move(m_sendChunkPool.back()));
+                m_sendChunkPool.pop_back();
+            } else
+                m_pendingChunks.push_back(SendChunkPtr(new SendChunk));
+        }
+        SendChunk* chunk = m_pendingChunks.back().get();
+        size_t len = std::min<size_t>(size, SEND_CHUNK_SIZE - chunk->size);
+        memcpy(chunk->data + chunk->size, buffer, len);
+        chunk->size += len;
+        buffer += len;
+        size -= len;
+    }
+    m_pendingPackets += 1;
 
+    // we can't send the data right away, otherwise we could create tcp congestion
+    // all writes from current dispatcher tick are sent together in the next io poll
+    if(!m_writing && !m_writeScheduled) {
+        m_writeScheduled = true;
         m_delayedWriteTimer.cancel();
         m_delayedWriteTimer.expires_from_now(std::chrono::milliseconds(0));
         m_delayedWriteTimer.async_wait(std::bind(&Connection::onCanWrite, asConnection(), std::placeholders::_1));
     }
-
-    std::ostream os(m_outputStream.get());
-    os.write((const char*)buffer, size);
-    os.flush();
 }
 
 void Connection::internal_write()
 {
-    if(!m_connected)
+    m_writeScheduled = false;
+    if((!m_connected && !m_closing) || m_writing || m_pendingChunks.empty())
         return;
 
-    std::shared_ptr<asio::streambuf> outputStream = m_outputStream;
-    m_outputStream = nullptr;
+    // only one write can be in progress, chunks are sent with single scatter/gather write
+    m_writing = true;
+    m_writingChunks.swap(m_pendingChunks);
+    m_writeBuffers.clear();
+    for(auto& chunk : m_writingChunks)
+        m_writeBuffers.push_back(asio::buffer(chunk->data, chunk->size));
+
+    m_writeCalls += 1;
+    m_sentPackets += m_pendingPackets;
+    m_pendingPackets = 0;
 
     asio::async_write(m_socket,
-                      *outputStream,
-                      std::bind(&Connection::onWrite, asConnection(), std::placeholders::_1, std::placeholders::_2, outputStream));
+                      m_writeBuffers,
+                      std::bind(&Connection::onWrite, asConnection(), std::placeholders::_1, std::placeholders::_2, m_writeId));
 
     m_writeTimer.cancel();
     m_writeTimer.expires_from_now(std::chrono::seconds(WRITE_TIMEOUT));
@@ -245,26 +320,43 @@ void Connection::onCanWrite(const boost::system::error_code& error)
 {
     m_delayedWriteTimer.cancel();
 
-    if(error == asio::error::operation_aborted)
+    if(error == asio::error::operation_aborted) {
+        m_writeScheduled = false;
         return;
+    }
 
     if(m_connected)
         internal_write();
 }
 
-void Connection::onWrite(const boost::system::error_code& error, size_t writeSize, std::shared_ptr<asio::streambuf> outputStream)
+void Connection::onWrite(const boost::system::error_code& error, size_t writeSize, uint32 writeId)
 {
-    m_writeTimer.cancel();
-
-    if(error == asio::error::operation_aborted)
+    m_sentBytes += writeSize;
+    if(writeId != m_writeId) {
+        // socket was closed during this write, its state was already reset
+        releaseChunks(m_abandonedChunks);
         return;
+    }
 
-    // free output stream and store for using it again later
-    outputStream->consume(outputStream->size());
-    m_outputStreams.push_back(outputStream);
+    m_writeTimer.cancel();
+    m_writing = false;
+    releaseChunks(m_writingChunks);
+
+    if(error == asio::error::operation_aborted) {
+        // write was cancelled but socket is still open, chunks written meanwhile must not be stranded
+        if(m_connected && !m_pendingChunks.empty())
+            internal_write();
+        else if(m_closing)
+            closeSocket();
+        return;
+    }
 
-    if(m_connected && error)
+    if((m_connected || m_closing) && error)
         handleError(error);
+    else if(!m_pendingChunks.empty()) // written while previous write was in progress
+        internal_write();
+    else if(m_closing) // everything was sent, finish close
+        closeSocket();
 }
 
 void Connection::onRecv(const boost::system::error_code& error, size_t recvSize)
@@ -307,6 +399,8 @@ void Connection::handleError(const boost::system::error_code& error)
         m_errorCallback(error);
     if(m_connected || m_connecting)
         close();
+    else if(m_closing) // flush after close failed or timed out
+        closeSocket();
 }
 
 int Connection::getIp()
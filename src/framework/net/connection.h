@@ -38,15 +38,25 @@ class Connection : public LuaObject
 
     enum {
         SEND_BUFFER_SIZE = 327680,
-        RECV_BUFFER_SIZE = 327680
+        RECV_BUFFER_SIZE = 327680,
+        SEND_CHUNK_SIZE = 16384,
+        MAX_POOLED_SEND_CHUNKS = 64
     };
 
+    // fixed capacity piece of outgoing data, chunks are reused by all connections
+    struct SendChunk {
+        size_t size = 0;
+        uint8 data[SEND_CHUNK_SIZE];
+    };
+    using SendChunkPtr = std::unique_ptr<SendChunk>;
+
 public:
     Connection();
     ~Connection();
 
     static void poll();
     static void terminate();
+    static std::string getSendStats();
 
     void connect(const std::string& host, uint16 port, const std::function<void()>& connectCallback);
     void close();
@@ -69,10 +79,12 @@ public:
 protected:
     void internal_connect(asio::ip::basic_resolver<asio::ip::tcp>::iterator endpointIterator);
     void internal_write();
+    void closeSocket();
+    void releaseChunks(std::vector<SendChunkPtr>& chunks);
     void onResolve(const boost::system::error_code& error, asio::ip::tcp::resolver::iterator endpointIterator);
     void onConnect(const boost::system::error_code& error);
     void onCanWrite(const boost::system::error_code& error);
-    void onWrite(const boost::system::error_code& error, size_t writeSize, std::shared_ptr<asio::streambuf> outputStream);
+    void onWrite(const boost::system::error_code& error, size_t writeSize, uint32 writeId);
     void onRecv(const boost::system::error_code& error, size_t recvSize);
     void onTimeout(const boost::system::error_code& error);
     void handleError(const boost::system::error_code& error);
@@ -87,8 +99,20 @@ protected:
     asio::ip::tcp::resolver m_resolver;
     asio::ip::tcp::socket m_socket;
 
-    static std::list<std::shared_ptr<asio::streambuf>> m_outputStreams;
-    std::shared_ptr<asio::streambuf> m_outputStream;
+    static std::vector<SendChunkPtr> m_sendChunkPool;
+    static uint64 m_sentBytes;
+    static uint64 m_sentPackets;
+    static uint64 m_writeCalls;
+    // data written in current dispatcher tick, sent together when previous write finishes
+    std::vector<SendChunkPtr> m_pendingChunks;
+    std::vector<SendChunkPtr> m_writingChunks;
+    std::vector<SendChunkPtr> m_abandonedChunks; // write to closed socket, kept until its handler is called
+    std::vector<asio::const_buffer> m_writeBuffers;
+    uint32 m_writeId = 0; // changed when socket is closed, handlers of older writes are ignored
+    uint32 m_pendingPackets = 0;
+    bool m_writing = false;
+    bool m_writeScheduled = false;
+    bool m_closing = false; // closed, but socket is open until pending chunks are sent
     asio::streambuf m_inputStream;
     bool m_connected;
     bool m_connecting;
@@ -1,8 +1,34 @@
 #include <framework/global.h>
 #include <framework/core/clock.h>
+#include <zlib.h>
 
 #include "packet_player.h"
 
+namespace {
+    template<typename T>
+    T readLE(const uint8* buffer)
+    {
+        uint64 value = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+            value |= (uint64)buffer[i] << (i * 8);
+        return (T)value;
+    }
+
+    bool readVarint(const uint8*& pos, const uint8* end, uint64& value)
+    {
+        value = 0;
+        for (int shift = 0; pos < end && shift < 64; shift += 7) {
+            uint8 byte = *pos++;
+            value |= (uint64)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    const size_t TEXT_PACKETS_PER_LOAD = 1000;
+}
+
 PacketPlayer::~PacketPlayer()
 {
     if (m_event)
@@ -11,27 +37,67 @@ PacketPlayer::~PacketPlayer()
 
 PacketPlayer::PacketPlayer(const std::string& file)
 {
-    static uint32_t sessionId = 1;
 #ifdef ANDROID
-    std::ifstream f(std::string("records/") + file);
+    m_file = std::ifstream(std::string("records/") + file, std::ios::binary);
 #else
-    std::ifstream f(std::filesystem::path("records") / file);
+    m_file = std::ifstream(std::filesystem::path("records") / file, std::ios::binary);
 #endif
-    if (!f.is_open())
+    if (!m_file.is_open())
         return;
-    std::string type, packetHex;
-    ticks_t time;
-    while (f >> type >> time >> packetHex) {
-        std::string packetStr = boost::algorithm::unhex(packetHex);
-        auto packet = std::make_shared<std::vector<uint8_t>>(packetStr.begin(), packetStr.end());
-        if (type == "<") {
-            m_input.push_back(std::make_pair(time, packet));
-        } else if (type == ">") {
-            m_output.push_back(std::make_pair(time, packet));
+
+    uint8 header[PacketRecord::HEADER_SIZE] = {};
+    m_file.read((char*)header, PacketRecord::HEADER_SIZE);
+    m_binary = m_file.gcount() == PacketRecord::HEADER_SIZE && memcmp(header, PacketRecord::MAGIC, 4) == 0 &&
+        readLE<uint16>(header + 4) == PacketRecord::VERSION;
+    if (!m_binary) { // old text record
+        m_file.clear();
+        m_file.seekg(0);
+        return;
+    }
+
+    if (!readIndex()) {
+        // record wasn't closed properly, find blocks by their headers
+        m_index.clear();
+        m_file.clear();
+        m_file.seekg(0, std::ios::end);
+        int64 fileSize = m_file.tellg();
+        int64 offset = PacketRecord::HEADER_SIZE;
+        uint8 blockHeader[PacketRecord::BLOCK_HEADER_SIZE];
+        while (m_file.seekg(offset) && m_file.read((char*)blockHeader, PacketRecord::BLOCK_HEADER_SIZE)) {
+            uint32 compressedSize = readLE<uint32>(blockHeader);
+            if (offset + PacketRecord::BLOCK_HEADER_SIZE + compressedSize > fileSize)
+                break; // incomplete block
+            m_index.push_back(PacketRecord::BlockInfo{ offset, readLE<int64>(blockHeader + 12), readLE<int64>(blockHeader + 20), readLE<uint32>(blockHeader + 8) });
+            offset += PacketRecord::BLOCK_HEADER_SIZE + compressedSize;
         }
+        m_file.clear();
     }
 }
 
+bool PacketPlayer::readIndex()
+{
+    uint8 trailer[PacketRecord::TRAILER_SIZE];
+    if (!m_file.seekg(-PacketRecord::TRAILER_SIZE, std::ios::end))
+        return false;
+    int64 trailerOffset = m_file.tellg();
+    if (!m_file.read((char*)trailer, PacketRecord::TRAILER_SIZE) || memcmp(trailer + 12, PacketRecord::INDEX_MAGIC, 4) != 0)
+        return false;
+
+    uint32 blocks = readLE<uint32>(trailer);
+    int64 indexOffset = readLE<int64>(trailer + 4);
+    if (indexOffset + (int64)blocks * PacketRecord::INDEX_ENTRY_SIZE != trailerOffset)
+        return false;
+
+    std::vector<uint8> index((size_t)blocks * PacketRecord::INDEX_ENTRY_SIZE);
+    if (!m_file.seekg(indexOffset) || !m_file.read((char*)index.data(), index.size()))
+        return false;
+    for (uint32 i = 0; i < blocks; ++i) {
+        const uint8* entry = index.data() + i * PacketRecord::INDEX_ENTRY_SIZE;
+        m_index.push_back(PacketRecord::BlockInfo{ readLE<int64>(entry), readLE<int64>(entry + 8), readLE<int64>(entry + 16), readLE<uint32>(entry + 24) });
+    }
+    return true;
+}
+
 void PacketPlayer::start(std::function<void(std::shared_ptr<std::vector<uint8_t>>)> recvCallback,
                          std::function<void(boost::system::error_code)> disconnectCallback)
 {
@@ -48,6 +114,30 @@ void PacketPlayer::stop()
     m_event = nullptr;
 }
 
+bool PacketPlayer::seek(ticks_t time)
+{
+    if (!m_recvCallback || time < g_clock.millis() - m_start)
+        return false;
+
+    // skipped packets are still parsed, record has no snapshots of game state to start from
+    while (!m_input.empty() || load()) {
+        auto& packet = m_input.front();
+        if (packet.first >= time)
+            break;
+        m_packetTime = packet.first;
+        m_recvCallback(packet.second);
+        m_input.pop_front();
+    }
+    m_start = g_clock.millis() - time;
+
+    // scheduled event still waits for next packet by playback time from before seek
+    if (m_event) {
+        m_event->cancel();
+        m_event = g_dispatcher.scheduleEvent(std::bind(&PacketPlayer::process, this), 1);
+    }
+    return true;
+}
+
 void PacketPlayer::onOutputPacket(const OutputMessagePtr& packet)
 {
     if (packet->getDataBuffer()[0] == 0x14) { // logout
@@ -56,15 +146,95 @@ void PacketPlayer::onOutputPacket(const OutputMessagePtr& packet)
     }
 }
 
+bool PacketPlayer::nextPacket(ticks_t& time, std::shared_ptr<std::vector<uint8_t>>& packet)
+{
+    if (m_input.empty() && !load())
+        return false;
+    time = m_input.front().first;
+    packet = m_input.front().second;
+    m_packetTime = time;
+    m_input.pop_front();
+    return true;
+}
+
+bool PacketPlayer::load()
+{
+    if (!m_file.is_open())
+        return false;
+    return m_binary ? loadBlock() : loadText();
+}
+
+bool PacketPlayer::loadBlock()
+{
+    while (m_nextBlock < m_index.size()) {
+        const auto& block = m_index[m_nextBlock++];
+        uint8 header[PacketRecord::BLOCK_HEADER_SIZE];
+        m_file.clear();
+        if (!m_file.seekg(block.offset) || !m_file.read((char*)header, PacketRecord::BLOCK_HEADER_SIZE))
+            return false;
+
+        uint32 compressedSize = readLE<uint32>(header);
+        uLongf rawSize = readLE<uint32>(header + 4);
+        if (compressedSize > PacketRecord::MAX_BLOCK_SIZE || rawSize > PacketRecord::MAX_BLOCK_SIZE) {
+            g_logger.error(stdext::format("Invalid packet record block at %d", (int)block.offset));
+            return false;
+        }
+        m_compressed.resize(compressedSize);
+        m_block.resize(rawSize);
+        if (!m_file.read((char*)m_compressed.data(), compressedSize) ||
+            uncompress(m_block.data(), &rawSize, m_compressed.data(), compressedSize) != Z_OK) {
+            g_logger.error(stdext::format("Unable to read packet record block at %d", (int)block.offset));
+            return false;
+        }
+
+        const uint8* pos = m_block.data();
+        const uint8* end = pos + rawSize;
+        ticks_t time = block.firstTime;
+        size_t loaded = 0;
+        while (pos < end) {
+            uint8 type = *pos++;
+            uint64 delta, size;
+            if (!readVarint(pos, end, delta) || !readVarint(pos, end, size) || size > (uint64)(end - pos)) {
+                g_logger.error(stdext::format("Invalid packet in record block at %d", (int)block.offset));
+                return false;
+            }
+            time += delta;
+            if (type == '<') {
+                m_input.push_back(std::make_pair(time, std::make_shared<std::vector<uint8_t>>(pos, pos + size)));
+                loaded += 1;
+            }
+            pos += size;
+        }
+        if (loaded > 0)
+            return true;
+    }
+    return false;
+}
+
+bool PacketPlayer::loadText()
+{
+    std::string type, packetHex;
+    ticks_t time;
+    size_t loaded = 0;
+    while (loaded < TEXT_PACKETS_PER_LOAD && m_file >> type >> time >> packetHex) {
+        if (type != "<")
+            continue;
+        std::string packetStr = boost::algorithm::unhex(packetHex);
+        m_input.push_back(std::make_pair(time, std::make_shared<std::vector<uint8_t>>(packetStr.begin(), packetStr.end())));
+        loaded += 1;
+    }
+    return loaded > 0;
+}
 
 void PacketPlayer::process()
 {
     ticks_t nextPacket = 1;
-    while (!m_input.empty()) {
+    while (!m_input.empty() || load()) {
         auto& packet = m_input.front();
         nextPacket = (packet.first + m_start) - g_clock.millis();
         if (nextPacket > 1)
             break;
+        m_packetTime = packet.first;
         m_recvCallback(packet.second);
         m_input.pop_front();
     }
@@ -76,4 +246,3 @@ void PacketPlayer::process()
         stop();
     }
 }
-
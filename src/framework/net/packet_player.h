@@ -3,6 +3,7 @@
 #include <deque>
 #include <framework/core/eventdispatcher.h>
 #include <framework/net/outputmessage.h>
+#include <framework/net/packet_recorder.h>
 
 class PacketPlayer : public LuaObject {
 public:
@@ -11,16 +12,39 @@ public:
 
     void start(std::function<void(std::shared_ptr<std::vector<uint8_t>>)> recvCallback, std::function<void(boost::system::error_code)> disconnectCallback);
     void stop();
+    // passes all packets before given record time to the game at once and continues playback from it,
+    // seeking backwards isn't possible because game state can't be rewound
+    bool seek(ticks_t time);
+    // returns next input packet and its record time without playback, used by stopped player
+    bool nextPacket(ticks_t& time, std::shared_ptr<std::vector<uint8_t>>& packet);
 
     void onOutputPacket(const OutputMessagePtr& packet);
 
+    bool isBinary() { return m_binary; }
+    // known only for binary records
+    ticks_t getDuration() { return m_index.empty() ? 0 : m_index.back().lastTime; }
+    // record time of last packet passed to the game
+    ticks_t getPacketTime() { return m_packetTime; }
+
 private:
     void process();
+    // loads more packets from file, returns false at the end of it
+    bool load();
+    bool loadBlock();
+    bool loadText();
+    bool readIndex();
 
-    ticks_t m_start;
+    ticks_t m_start = 0;
+    ticks_t m_packetTime = 0;
     ScheduledEventPtr m_event;
     std::deque<std::pair<ticks_t, std::shared_ptr<std::vector<uint8_t>>>> m_input;
-    std::deque<std::pair<ticks_t, std::shared_ptr<std::vector<uint8_t>>>> m_output;
     std::function<void(std::shared_ptr<std::vector<uint8_t>>)> m_recvCallback;
     std::function<void(boost::system::error_code)> m_disconnectCallback;
+
+    std::ifstream m_file;
+    bool m_binary = false;
+    size_t m_nextBlock = 0;
+    std::vector<PacketRecord::BlockInfo> m_index;
+    std::vector<uint8> m_block;
+    std::vector<uint8> m_compressed;
 };
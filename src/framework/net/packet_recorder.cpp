@@ -1,34 +1,68 @@
 #include <framework/global.h>
 #include <framework/core/clock.h>
 #include <framework/core/resourcemanager.h>
+#include <zlib.h>
 
 #include "packet_recorder.h"
 
+namespace {
+    template<typename T>
+    void writeLE(std::vector<uint8>& buffer, T value)
+    {
+        for (size_t i = 0; i < sizeof(T); ++i)
+            buffer.push_back((uint8)((uint64)value >> (i * 8)));
+    }
+
+    void writeVarint(std::vector<uint8>& buffer, uint64 value)
+    {
+        while (value >= 0x80) {
+            buffer.push_back((uint8)(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back((uint8)value);
+    }
+}
+
 PacketRecorder::PacketRecorder(const std::string& file)
 {
     m_start = g_clock.millis();
 #ifdef ANDROID
     g_resources.makeDir("records");
-    m_stream = std::ofstream(std::string("records/") + file);
+    m_stream = std::ofstream(std::string("records/") + file, std::ios::binary);
 #else
     std::error_code ec;
     std::filesystem::create_directory("records", ec);
-    m_stream = std::ofstream(std::filesystem::path("records") / file);
+    m_stream = std::ofstream(std::filesystem::path("records") / file, std::ios::binary);
 #endif
+
+    std::vector<uint8> header;
+    header.insert(header.end(), PacketRecord::MAGIC, PacketRecord::MAGIC + 4);
+    writeLE<uint16>(header, PacketRecord::VERSION);
+    m_stream.write((const char*)header.data(), header.size());
+    m_blockInfo.packets = 0;
 }
 
 PacketRecorder::~PacketRecorder()
 {
+    writeBlock();
 
+    std::vector<uint8> index;
+    for (auto& block : m_index) {
+        writeLE<int64>(index, block.offset);
+        writeLE<int64>(index, block.firstTime);
+        writeLE<int64>(index, block.lastTime);
+        writeLE<uint32>(index, block.packets);
+    }
+    int64 indexOffset = m_stream.tellp();
+    writeLE<uint32>(index, m_index.size());
+    writeLE<int64>(index, indexOffset);
+    index.insert(index.end(), PacketRecord::INDEX_MAGIC, PacketRecord::INDEX_MAGIC + 4);
+    m_stream.write((const char*)index.data(), index.size());
 }
 
 void PacketRecorder::addInputPacket(const InputMessagePtr& packet)
 {
-    m_stream << "< " << (g_clock.millis() - m_start) << " ";
-    for (auto& buffer : packet->getBodyBuffer()) {
-        m_stream << std::setfill('0') << std::setw(2) << std::hex << (uint16_t)(uint8_t)buffer;
-    }
-    m_stream << std::dec << "\n";
+    addPacket('<', packet->getBodyBuffer());
 }
 
 void PacketRecorder::addOutputPacket(const OutputMessagePtr& packet)
@@ -39,9 +73,55 @@ void PacketRecorder::addOutputPacket(const OutputMessagePtr& packet)
         return;
     }
 
-    m_stream << "> " << (g_clock.millis() - m_start) << " ";
-    for (auto& buffer : packet->getBuffer()) {
-        m_stream << std::setfill('0') << std::setw(2) << std::hex << (uint16_t)(uint8_t)buffer;
+    addPacket('>', packet->getBuffer());
+}
+
+void PacketRecorder::addPacket(uint8 type, const std::string& data)
+{
+    ticks_t time = g_clock.millis() - m_start;
+    if (m_blockInfo.packets == 0) {
+        m_blockInfo.firstTime = time;
+        m_blockInfo.lastTime = time;
     }
-    m_stream << std::dec << "\n";
+
+    m_block.push_back(type);
+    writeVarint(m_block, time - m_blockInfo.lastTime);
+    writeVarint(m_block, data.size());
+    m_block.insert(m_block.end(), data.begin(), data.end());
+    m_blockInfo.lastTime = time;
+    m_blockInfo.packets += 1;
+
+    if (m_block.size() >= PacketRecord::BLOCK_SIZE || time - m_blockInfo.firstTime >= PacketRecord::BLOCK_TIME)
+        writeBlock();
+}
+
+void PacketRecorder::writeBlock()
+{
+    if (m_blockInfo.packets == 0)
+        return;
+
+    uLongf compressedSize = compressBound(m_block.size());
+    m_compressed.resize(PacketRecord::BLOCK_HEADER_SIZE + compressedSize);
+    if (compress2(m_compressed.data() + PacketRecord::BLOCK_HEADER_SIZE, &compressedSize, m_block.data(), m_block.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        g_logger.error("Unable to compress packet record block");
+        compressedSize = 0;
+    }
+
+    std::vector<uint8> header;
+    writeLE<uint32>(header, compressedSize);
+    writeLE<uint32>(header, m_block.size());
+    writeLE<uint32>(header, m_blockInfo.packets);
+    writeLE<int64>(header, m_blockInfo.firstTime);
+    writeLE<int64>(header, m_blockInfo.lastTime);
+    std::copy(header.begin(), header.end(), m_compressed.begin());
+
+    if (compressedSize > 0) {
+        m_blockInfo.offset = m_stream.tellp();
+        m_stream.write((const char*)m_compressed.data(), PacketRecord::BLOCK_HEADER_SIZE + compressedSize);
+        m_stream.flush();
+        m_index.push_back(m_blockInfo);
+    }
+
+    m_block.clear();
+    m_blockInfo.packets = 0;
 }
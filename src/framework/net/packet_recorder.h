@@ -3,6 +3,33 @@
 #include <framework/net/inputmessage.h>
 #include <framework/net/outputmessage.h>
 
+// binary record, all numbers are little endian:
+// header: "OTRB", u16 version
+// blocks: u32 compressed size, u32 raw size, u32 packets, i64 first packet time, i64 last packet time, zlib compressed packets
+//   packet: u8 type ('<' input, '>' output), varint time since previous packet in block (first one is 0), varint size, data
+// index: for every block i64 file offset, i64 first packet time, i64 last packet time, u32 packets
+// trailer: u32 blocks, i64 index offset, "OTRI"
+// every block can be read without previous ones, index is optional, without it blocks are found by reading their headers
+namespace PacketRecord {
+    constexpr char MAGIC[] = "OTRB";
+    constexpr char INDEX_MAGIC[] = "OTRI";
+    constexpr uint16 VERSION = 1;
+    constexpr int HEADER_SIZE = 6;
+    constexpr int BLOCK_HEADER_SIZE = 28;
+    constexpr int INDEX_ENTRY_SIZE = 28;
+    constexpr int TRAILER_SIZE = 16;
+    constexpr size_t BLOCK_SIZE = 256 * 1024; // raw size of block after which it's written
+    constexpr ticks_t BLOCK_TIME = 10000; // max time between first and last packet in block
+    constexpr uint32 MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    struct BlockInfo {
+        int64 offset;
+        ticks_t firstTime;
+        ticks_t lastTime;
+        uint32 packets;
+    };
+}
+
 class PacketRecorder : public LuaObject {
 public:
     PacketRecorder(const std::string& file);
@@ -12,7 +39,15 @@ public:
     void addOutputPacket(const OutputMessagePtr& packet);
 
 private:
+    void addPacket(uint8 type, const std::string& data);
+    void writeBlock();
+
     ticks_t m_start;
     std::ofstream m_stream;
     bool m_firstOutput = true;
+
+    std::vector<uint8> m_block;
+    std::vector<uint8> m_compressed;
+    PacketRecord::BlockInfo m_blockInfo;
+    std::vector<PacketRecord::BlockInfo> m_index;
 };
@@ -23,6 +23,7 @@
 #include "protocol.h"
 #include "connection.h"
 #include <framework/core/application.h>
+#include <framework/util/crypt.h>
 #include <random>
 
 #include <framework/net/packet_player.h>
@@ -30,6 +31,38 @@
 
 extern asio::io_service g_ioService;
 
+namespace {
+    // proxy packets are released on proxy thread, their vectors are reused to avoid allocation per sent packet
+    struct ProxyPacketPool {
+        enum { MAX_PACKETS = 64 };
+        std::mutex mutex;
+        std::vector<ProxyPacket*> packets;
+    };
+    ProxyPacketPool* proxyPacketPool = new ProxyPacketPool; // never deleted, packets may be released during shutdown
+
+    ProxyPacketPtr createProxyPacket(const uint8* begin, const uint8* end)
+    {
+        ProxyPacket* packet = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(proxyPacketPool->mutex);
+            if (!proxyPacketPool->packets.empty()) {
+                packet = proxyPacketPool->packets.back();
+                proxyPacketPool->packets.pop_back();
+            }
+        }
+        if (!packet)
+            packet = new ProxyPacket;
+        packet->assign(begin, end);
+        return ProxyPacketPtr(packet, [](ProxyPacket* packet) {
+            std::lock_guard<std::mutex> lock(proxyPacketPool->mutex);
+            if (proxyPacketPool->packets.size() < ProxyPacketPool::MAX_PACKETS)
+                proxyPacketPool->packets.push_back(packet);
+            else
+                delete packet;
+        });
+    }
+}
+
 Protocol::Protocol()
 {
     m_xteaEncryptionEnabled = false;
@@ -71,6 +104,9 @@ void Protocol::connect(const std::string& host, uint16 port)
                                      std::bind(&Protocol::onLocalDisconnected, asProtocol(), std::placeholders::_1));
         return onConnect();
     }
+    m_recvBuffer.clear();
+    m_recvBufferPos = 0;
+    m_recvRequested = m_recvReading = false;
     m_connection = ConnectionPtr(new Connection);
     m_connection->setErrorCallback(std::bind(&Protocol::onError, asProtocol(), std::placeholders::_1));
     m_connection->connect(host, port, std::bind(&Protocol::onConnect, asProtocol()));
@@ -157,7 +193,7 @@ void Protocol::send(const OutputMessagePtr& outputMessage, bool rawPacket)
     }
 
     if (m_proxy) {
-        auto packet = std::make_shared<ProxyPacket>(outputMessage->getHeaderBuffer(), outputMessage->getWriteBuffer());
+        auto packet = createProxyPacket(outputMessage->getHeaderBuffer(), outputMessage->getWriteBuffer());
         g_proxy.send(m_proxy, packet);
         outputMessage->reset();
         return;
@@ -180,6 +216,22 @@ void Protocol::recv()
         return;
     }
 
+    if (m_coalescedRecv) {
+        m_recvRequested = true;
+        if (!m_recvParsing && !m_recvReading) // otherwise next packet is passed when parsing or reading finishes
+            parseRecvBuffer();
+        return;
+    }
+
+    prepareInputMessage();
+
+    // read the first 2 bytes which contain the message size
+    if (m_connection)
+        m_connection->read(m_bigPackets ? 4 : 2, std::bind(&Protocol::internalRecvHeader, asProtocol(), std::placeholders::_1, std::placeholders::_2));
+}
+
+void Protocol::prepareInputMessage()
+{
     m_inputMessage->reset();
 
     // first update message header size
@@ -189,10 +241,58 @@ void Protocol::recv()
     if (m_xteaEncryptionEnabled)
         headerSize += m_bigPackets ? 4 : 2; // 2 or 4 bytes for XTEA encrypted message size
     m_inputMessage->setHeaderSize(headerSize);
+}
 
-    // read the first 2 bytes which contain the message size
-    if (m_connection)
-        m_connection->read(m_bigPackets ? 4 : 2, std::bind(&Protocol::internalRecvHeader, asProtocol(), std::placeholders::_1, std::placeholders::_2));
+void Protocol::internalRecvSome(uint8* buffer, uint32 size)
+{
+    m_recvReading = false;
+    m_recvReads += 1;
+
+    // drop already parsed data, only an incomplete packet is moved
+    if (m_recvBufferPos > 0) {
+        m_recvBuffer.erase(m_recvBuffer.begin(), m_recvBuffer.begin() + m_recvBufferPos);
+        m_recvBufferPos = 0;
+    }
+    m_recvBuffer.insert(m_recvBuffer.end(), buffer, buffer + size);
+
+    if (m_recvRequested)
+        parseRecvBuffer();
+}
+
+void Protocol::parseRecvBuffer()
+{
+    // onRecv may disconnect and release the last reference to this protocol
+    auto self(asProtocol());
+    uint32 sizeBytes = m_bigPackets ? 4 : 2;
+
+    m_recvParsing = true;
+    while (m_recvRequested && m_connection && m_recvBuffer.size() - m_recvBufferPos >= sizeBytes) {
+        uint8* data = m_recvBuffer.data() + m_recvBufferPos;
+        uint32 packetSize = m_bigPackets ? stdext::readULE32(data) : stdext::readULE16(data);
+        if (packetSize + InputMessage::MAX_HEADER_SIZE > InputMessage::BUFFER_MAXSIZE) {
+            m_recvParsing = false;
+            g_logger.traceError(stdext::format("received too big network message, size: %i", (int)packetSize));
+            onError(asio::error::make_error_code(asio::error::message_size));
+            return;
+        }
+        if (m_recvBuffer.size() - m_recvBufferPos < sizeBytes + packetSize)
+            break;
+
+        m_recvRequested = false;
+        m_recvBufferPos += sizeBytes + packetSize;
+        m_recvPackets += 1;
+
+        prepareInputMessage();
+        m_inputMessage->fillBuffer(data, sizeBytes);
+        m_inputMessage->readSize(m_bigPackets);
+        internalRecvData(data + sizeBytes, packetSize); // calls onRecv, which requests next packet with recv
+    }
+    m_recvParsing = false;
+
+    if (m_recvRequested && m_connection) {
+        m_recvReading = true;
+        m_connection->read_some(std::bind(&Protocol::internalRecvSome, asProtocol(), std::placeholders::_1, std::placeholders::_2));
+    }
 }
 
 void Protocol::internalRecvHeader(uint8* buffer, uint32 size)
@@ -298,22 +398,7 @@ bool Protocol::xteaDecrypt(const InputMessagePtr& inputMessage)
         return false;
     }
 
-    uint32* buffer = (uint32*)(inputMessage->getReadBuffer());
-    uint32_t readPos = 0;
-
-    while (readPos < encryptedSize / 4) {
-        uint32 v0 = buffer[readPos], v1 = buffer[readPos + 1];
-        uint32 delta = 0x61C88647;
-        uint32 sum = 0xC6EF3720;
-
-        for (int32 i = 0; i < 32; i++) {
-            v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + m_xteaKey[sum >> 11 & 3]);
-            sum += delta;
-            v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + m_xteaKey[sum & 3]);
-        }
-        buffer[readPos] = v0; buffer[readPos + 1] = v1;
-        readPos = readPos + 2;
-    }
+    g_crypt.xteaDecrypt((uint32*)(inputMessage->getReadBuffer()), encryptedSize / 8, m_xteaKey);
 
     uint32 decryptedSize = m_bigPackets ? (inputMessage->getU32() + 4) : (inputMessage->getU16() + 2);
     int sizeDelta = decryptedSize - encryptedSize;
@@ -338,21 +423,7 @@ void Protocol::xteaEncrypt(const OutputMessagePtr& outputMessage)
         encryptedSize += n;
     }
 
-    uint32_t readPos = 0;
-    uint32* buffer = (uint32*)(outputMessage->getDataBuffer() - (m_bigPackets ? 4 : 2));
-    while (readPos < encryptedSize / 4) {
-        uint32 v0 = buffer[readPos], v1 = buffer[readPos + 1];
-        uint32 delta = 0x61C88647;
-        uint32 sum = 0;
-
-        for (int32 i = 0; i < 32; i++) {
-            v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + m_xteaKey[sum & 3]);
-            sum -= delta;
-            v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + m_xteaKey[sum >> 11 & 3]);
-        }
-        buffer[readPos] = v0; buffer[readPos + 1] = v1;
-        readPos = readPos + 2;
-    }
+    g_crypt.xteaEncrypt((uint32*)(outputMessage->getDataBuffer() - (m_bigPackets ? 4 : 2)), encryptedSize / 8, m_xteaKey);
 }
 
 void Protocol::onConnect()
@@ -377,17 +448,24 @@ void Protocol::onPlayerPacket(const std::shared_ptr<std::vector<uint8_t>>& packe
         return;
     auto self(asProtocol());
     boost::asio::post(g_ioService, [&, self, packet] {
-        if (m_disconnected)
-            return;
-        m_inputMessage->reset();
-
-        m_inputMessage->setHeaderSize(0);
-        m_inputMessage->fillBuffer(packet->data(), packet->size());
-        m_inputMessage->setMessageSize(packet->size());
-        onRecv(m_inputMessage);
+        replayPacket(packet);
     });
 }
 
+void Protocol::replayPacket(const std::shared_ptr<std::vector<uint8_t>>& packet)
+{
+    if (m_disconnected)
+        return;
+    m_inputMessage->reset();
+
+    m_inputMessage->setHeaderSize(0);
+    m_inputMessage->fillBuffer(packet->data(), packet->size());
+    m_inputMessage->setMessageSize(packet->size());
+    if (m_recorder)
+        m_recorder->addInputPacket(m_inputMessage);
+    onRecv(m_inputMessage);
+}
+
 void Protocol::onProxyPacket(const std::shared_ptr<std::vector<uint8_t>>& packet)
 {
     if (m_disconnected)
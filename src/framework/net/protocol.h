@@ -46,6 +46,9 @@ public:
 
     void setRecorder(PacketRecorderPtr recorder);
     void playRecord(PacketPlayerPtr player);
+    PacketPlayerPtr getPacketPlayer() { return m_player; }
+    // passes recorded packet to onRecv right away
+    void replayPacket(const std::shared_ptr<std::vector<uint8_t>>& packet);
 
     bool isConnected();
     bool isConnecting();
@@ -63,6 +66,9 @@ public:
     void enabledSequencedPackets() { m_sequencedPackets = true; }
     void enableBigPackets() { m_bigPackets = true; }
     void enableCompression() { m_compression = true; }
+    // reads all available data at once and frames every complete packet from it, instead of 2 reads per packet
+    void enableCoalescedRecv() { m_coalescedRecv = true; }
+    double getPacketsPerRead() { return (double)m_recvPackets / std::max<uint64>(1, m_recvReads); }
 
     virtual void send(const OutputMessagePtr& outputMessage, bool rawPacket = false);
     virtual void recv();
@@ -87,8 +93,11 @@ protected:
     PacketRecorderPtr m_recorder;
 
 private:
+    void prepareInputMessage();
     void internalRecvHeader(uint8* buffer, uint32 size);
     void internalRecvData(uint8* buffer, uint32 size);
+    void internalRecvSome(uint8* buffer, uint32 size);
+    void parseRecvBuffer();
 
     bool xteaDecrypt(const InputMessagePtr& inputMessage);
     void xteaEncrypt(const OutputMessagePtr& outputMessage);
@@ -98,6 +107,14 @@ private:
     bool m_xteaEncryptionEnabled;
     bool m_bigPackets;
     bool m_compression;
+    bool m_coalescedRecv = false;
+    bool m_recvRequested = false; // recv was called and next packet wasn't passed to onRecv yet
+    bool m_recvReading = false;
+    bool m_recvParsing = false;
+    std::vector<uint8_t> m_recvBuffer;
+    size_t m_recvBufferPos = 0;
+    uint64 m_recvReads = 0;
+    uint64 m_recvPackets = 0;
     ConnectionPtr m_connection;
     InputMessagePtr m_inputMessage;
     z_stream m_zstream;
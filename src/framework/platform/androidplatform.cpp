@@ -90,6 +90,15 @@ bool Platform::removeFile(std::string file)
     return false;
 }
 
+const uint8* Platform::mapFile(std::string file, size_t& size)
+{
+    return nullptr; // data is packed in apk
+}
+
+void Platform::unmapFile(const uint8* data, size_t size)
+{
+}
+
 ticks_t Platform::getFileModificationTime(std::string file)
 {
     return 0;
@@ -41,6 +41,9 @@ public:
     bool fileExists(std::string file);
     bool removeFile(std::string file);
     ticks_t getFileModificationTime(std::string file);
+    // maps whole file read only into memory, returns nullptr when it's not possible
+    const uint8* mapFile(std::string file, size_t& size);
+    void unmapFile(const uint8* data, size_t size);
     bool openUrl(std::string url, bool now = false);
     bool openDir(std::string path, bool now = false);
     std::string getCPUName();
@@ -31,6 +31,8 @@
 #include <framework/core/eventdispatcher.h>
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <execinfo.h>
 
 void Platform::processArgs(std::vector<std::string>& args)
@@ -111,6 +113,33 @@ bool Platform::removeFile(std::string file)
     return false;
 }
 
+const uint8* Platform::mapFile(std::string file, size_t& size)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if(fd == -1)
+        return nullptr;
+
+    struct stat sts;
+    if(fstat(fd, &sts) == -1 || sts.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, sts.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // mapping keeps file referenced
+    if(data == MAP_FAILED)
+        return nullptr;
+
+    size = sts.st_size;
+    return (const uint8*)data;
+}
+
+void Platform::unmapFile(const uint8* data, size_t size)
+{
+    if(data)
+        munmap((void*)data, size);
+}
+
 ticks_t Platform::getFileModificationTime(std::string file)
 {
     struct stat attrib;
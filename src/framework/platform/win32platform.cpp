@@ -138,6 +138,39 @@ bool Platform::removeFile(std::string file)
     return true;
 }
 
+const uint8* Platform::mapFile(std::string file, size_t& size)
+{
+    boost::replace_all(file, "/", "\\");
+    HANDLE fileHandle = CreateFileW(stdext::utf8_to_utf16(file).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(fileHandle);
+        return nullptr;
+    }
+
+    HANDLE mapping = CreateFileMappingW(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fileHandle);
+    if (!mapping)
+        return nullptr;
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // view keeps mapping referenced
+    if (!data)
+        return nullptr;
+
+    size = (size_t)fileSize.QuadPart;
+    return (const uint8*)data;
+}
+
+void Platform::unmapFile(const uint8* data, size_t size)
+{
+    if (data)
+        UnmapViewOfFile(data);
+}
+
 ticks_t Platform::getFileModificationTime(std::string file)
 {
     boost::replace_all(file, "/", "\\");
@@ -249,7 +249,7 @@ SoundSourcePtr SoundManager::createSoundSource(const std::string& filename)
                     g_logger.error(e.what());
                     return nullptr;
                 }
-            });
+            }, AsyncDispatcher::Background);
 
             streamSource = StreamSoundSourcePtr(new StreamSoundSource);
             streamSource->downMix(StreamSoundSource::DownMixRight);
@@ -263,7 +263,7 @@ SoundSourcePtr SoundManager::createSoundSource(const std::string& filename)
                     g_logger.error(e.what());
                     return nullptr;
                 }
-            });
+            }, AsyncDispatcher::Background);
 
             source = combinedSource;
 #else
@@ -275,7 +275,7 @@ SoundSourcePtr SoundManager::createSoundSource(const std::string& filename)
                     g_logger.error(e.what());
                     return nullptr;
                 }
-            });
+            }, AsyncDispatcher::Background);
             source = streamSource;
 #endif
         }
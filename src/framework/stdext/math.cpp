@@ -47,17 +47,16 @@ uint32_t adler32(const uint8_t *buffer, size_t size) {
 
 long random_range(long min, long max)
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<long> dis(0, 2147483647);
+    // generator isn't thread safe, things are animated by parallel map drawing too
+    thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<long> dis(0, 2147483647);
     return min + (dis(gen) % (max - min + 1));
 }
 
 float random_range(float min, float max)
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_real_distribution<float> dis(0.0, 1.0);
+    thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_real_distribution<float> dis(0.0, 1.0);
     return min + (max - min)*dis(gen);
 }
 
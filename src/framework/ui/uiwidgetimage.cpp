@@ -177,8 +177,7 @@ void UIWidget::drawImage(const Rect& screenCoords)
 
     m_imageTexture->setSmooth(m_imageSmooth);
     if (!m_shader.empty()) {
-        DrawQueueItemTextureCoords* thing = new DrawQueueItemImageWithShader(m_imageCoordsBuffer, m_imageTexture, m_imageColor, m_shader);
-        g_drawQueue->add(thing);
+        g_drawQueue->emplace<DrawQueueItemImageWithShader>(m_imageCoordsBuffer, m_imageTexture, m_imageColor, m_shader);
     }
     else {
         g_drawQueue->addTextureCoords(m_imageCoordsBuffer, m_imageTexture, m_imageColor);
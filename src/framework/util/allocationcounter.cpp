@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2010-2017 OTClient <https://github.com/edubart/otclient>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "allocationcounter.h"
+
+#ifdef ALLOCATION_COUNTER
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+    // trivially initialized thread locals, operator new can't allocate
+    thread_local bool counting = false;
+    thread_local uint64_t countedAllocations = 0;
+    thread_local uint64_t countedBytes = 0;
+}
+
+bool allocation_counter::isAvailable()
+{
+    return true;
+}
+
+void allocation_counter::start()
+{
+    countedAllocations = 0;
+    countedBytes = 0;
+    counting = true;
+}
+
+void allocation_counter::stop(uint64_t& allocations, uint64_t& bytes)
+{
+    counting = false;
+    allocations = countedAllocations;
+    bytes = countedBytes;
+}
+
+// every non-aligned variant is replaced so allocation and deallocation always pair with malloc/free
+void* operator new(std::size_t size)
+{
+    if (counting) {
+        countedAllocations += 1;
+        countedBytes += size;
+    }
+    if (size == 0)
+        size = 1;
+    while (true) {
+        if (void* ptr = std::malloc(size))
+            return ptr;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return operator new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+#else
+
+bool allocation_counter::isAvailable()
+{
+    return false;
+}
+
+void allocation_counter::start()
+{
+}
+
+void allocation_counter::stop(uint64_t& allocations, uint64_t& bytes)
+{
+    allocations = 0;
+    bytes = 0;
+}
+
+#endif
@@ -39,6 +39,9 @@
 #include <openssl/err.h>
 #endif
 #include <zlib.h>
+#include <random>
+#include <sstream>
+#include <framework/stdext/time.h>
 
 static const std::string base64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static inline bool is_base64(unsigned char c) { return (isalnum(c) || (c == '+') || (c == '/')); }
@@ -529,3 +532,258 @@ void Crypt::bdecrypt(uint8_t* buffer, int len, uint64_t k) {
         sum -= DELTA;
     } while (--rounds);
 }
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define XTEA_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define XTEA_TARGET(arch)
+#else
+#define XTEA_TARGET(arch) __attribute__((target(arch)))
+#endif
+#endif
+
+namespace {
+    enum XteaLevel {
+        XTEA_SCALAR = 0,
+        XTEA_SSE2,
+        XTEA_AVX2,
+        XTEA_LEVELS
+    };
+    const char* xteaLevelNames[XTEA_LEVELS] = { "scalar", "sse2", "avx2" };
+
+    const uint32 XTEA_DELTA = 0x61C88647;
+    const uint32 XTEA_DECRYPT_SUM = 0xC6EF3720;
+    const int XTEA_ROUNDS = 32;
+
+    // sum + key part for both halves of every round, the same for all blocks
+    struct XteaRoundKeys {
+        uint32 first[XTEA_ROUNDS];
+        uint32 second[XTEA_ROUNDS];
+    };
+
+    void xteaEncryptKeys(const uint32* key, XteaRoundKeys& keys)
+    {
+        uint32 sum = 0;
+        for (int i = 0; i < XTEA_ROUNDS; ++i) {
+            keys.first[i] = sum + key[sum & 3];
+            sum -= XTEA_DELTA;
+            keys.second[i] = sum + key[sum >> 11 & 3];
+        }
+    }
+
+    void xteaDecryptKeys(const uint32* key, XteaRoundKeys& keys)
+    {
+        uint32 sum = XTEA_DECRYPT_SUM;
+        for (int i = 0; i < XTEA_ROUNDS; ++i) {
+            keys.first[i] = sum + key[sum >> 11 & 3];
+            sum += XTEA_DELTA;
+            keys.second[i] = sum + key[sum & 3];
+        }
+    }
+
+    void xteaEncryptScalar(uint32* buffer, size_t blocks, const XteaRoundKeys& keys)
+    {
+        for (size_t b = 0; b < blocks; ++b) {
+            uint32 v0 = buffer[b * 2], v1 = buffer[b * 2 + 1];
+            for (int i = 0; i < XTEA_ROUNDS; ++i) {
+                v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ keys.first[i];
+                v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ keys.second[i];
+            }
+            buffer[b * 2] = v0; buffer[b * 2 + 1] = v1;
+        }
+    }
+
+    void xteaDecryptScalar(uint32* buffer, size_t blocks, const XteaRoundKeys& keys)
+    {
+        for (size_t b = 0; b < blocks; ++b) {
+            uint32 v0 = buffer[b * 2], v1 = buffer[b * 2 + 1];
+            for (int i = 0; i < XTEA_ROUNDS; ++i) {
+                v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ keys.first[i];
+                v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ keys.second[i];
+            }
+            buffer[b * 2] = v0; buffer[b * 2 + 1] = v1;
+        }
+    }
+
+#ifdef XTEA_SIMD
+    // blocks are split to vectors of first and second halves, lane order doesn't matter as long as it's restored
+#define XTEA_F(v, shl, shr, add, x) add(x(shl(v, 4), shr(v, 5)), v)
+
+    XTEA_TARGET("sse2") size_t xteaSSE2(uint32* buffer, size_t blocks, const XteaRoundKeys& keys, bool decrypt)
+    {
+        size_t b = 0;
+        for (; b + 4 <= blocks; b += 4) {
+            __m128i* data = (__m128i*)(buffer + b * 2);
+            __m128i a = _mm_shuffle_epi32(_mm_loadu_si128(data), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i c = _mm_shuffle_epi32(_mm_loadu_si128(data + 1), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i v0 = _mm_unpacklo_epi64(a, c);
+            __m128i v1 = _mm_unpackhi_epi64(a, c);
+            if (!decrypt) {
+                for (int i = 0; i < XTEA_ROUNDS; ++i) {
+                    v0 = _mm_add_epi32(v0, _mm_xor_si128(XTEA_F(v1, _mm_slli_epi32, _mm_srli_epi32, _mm_add_epi32, _mm_xor_si128), _mm_set1_epi32(keys.first[i])));
+                    v1 = _mm_add_epi32(v1, _mm_xor_si128(XTEA_F(v0, _mm_slli_epi32, _mm_srli_epi32, _mm_add_epi32, _mm_xor_si128), _mm_set1_epi32(keys.second[i])));
+                }
+            } else {
+                for (int i = 0; i < XTEA_ROUNDS; ++i) {
+                    v1 = _mm_sub_epi32(v1, _mm_xor_si128(XTEA_F(v0, _mm_slli_epi32, _mm_srli_epi32, _mm_add_epi32, _mm_xor_si128), _mm_set1_epi32(keys.first[i])));
+                    v0 = _mm_sub_epi32(v0, _mm_xor_si128(XTEA_F(v1, _mm_slli_epi32, _mm_srli_epi32, _mm_add_epi32, _mm_xor_si128), _mm_set1_epi32(keys.second[i])));
+                }
+            }
+            _mm_storeu_si128(data, _mm_shuffle_epi32(_mm_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm_storeu_si128(data + 1, _mm_shuffle_epi32(_mm_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        return b;
+    }
+
+    XTEA_TARGET("avx2") size_t xteaAVX2(uint32* buffer, size_t blocks, const XteaRoundKeys& keys, bool decrypt)
+    {
+        size_t b = 0;
+        for (; b + 8 <= blocks; b += 8) {
+            __m256i* data = (__m256i*)(buffer + b * 2);
+            __m256i a = _mm256_shuffle_epi32(_mm256_loadu_si256(data), _MM_SHUFFLE(3, 1, 2, 0));
+            __m256i c = _mm256_shuffle_epi32(_mm256_loadu_si256(data + 1), _MM_SHUFFLE(3, 1, 2, 0));
+            __m256i v0 = _mm256_unpacklo_epi64(a, c);
+            __m256i v1 = _mm256_unpackhi_epi64(a, c);
+            if (!decrypt) {
+                for (int i = 0; i < XTEA_ROUNDS; ++i) {
+                    v0 = _mm256_add_epi32(v0, _mm256_xor_si256(XTEA_F(v1, _mm256_slli_epi32, _mm256_srli_epi32, _mm256_add_epi32, _mm256_xor_si256), _mm256_set1_epi32(keys.first[i])));
+                    v1 = _mm256_add_epi32(v1, _mm256_xor_si256(XTEA_F(v0, _mm256_slli_epi32, _mm256_srli_epi32, _mm256_add_epi32, _mm256_xor_si256), _mm256_set1_epi32(keys.second[i])));
+                }
+            } else {
+                for (int i = 0; i < XTEA_ROUNDS; ++i) {
+                    v1 = _mm256_sub_epi32(v1, _mm256_xor_si256(XTEA_F(v0, _mm256_slli_epi32, _mm256_srli_epi32, _mm256_add_epi32, _mm256_xor_si256), _mm256_set1_epi32(keys.first[i])));
+                    v0 = _mm256_sub_epi32(v0, _mm256_xor_si256(XTEA_F(v1, _mm256_slli_epi32, _mm256_srli_epi32, _mm256_add_epi32, _mm256_xor_si256), _mm256_set1_epi32(keys.second[i])));
+                }
+            }
+            _mm256_storeu_si256(data, _mm256_shuffle_epi32(_mm256_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_si256(data + 1, _mm256_shuffle_epi32(_mm256_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        return b;
+    }
+
+#undef XTEA_F
+#endif
+
+    int detectXteaLevel()
+    {
+#ifdef XTEA_SIMD
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        int maxId = info[0];
+        __cpuid(info, 1);
+        bool sse2 = (info[3] & (1 << 26)) != 0;
+        bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6; // osxsave, avx, ymm state enabled
+        bool avx2 = false;
+        if (avx && maxId >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool sse2 = __builtin_cpu_supports("sse2");
+        bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (avx2)
+            return XTEA_AVX2;
+        if (sse2)
+            return XTEA_SSE2;
+#endif
+        return XTEA_SCALAR;
+    }
+
+    int xteaLevel()
+    {
+        static int level = detectXteaLevel();
+        return level;
+    }
+
+    void xtea(uint32* buffer, size_t blocks, const uint32* key, bool decrypt, int level)
+    {
+        XteaRoundKeys keys;
+        if (decrypt)
+            xteaDecryptKeys(key, keys);
+        else
+            xteaEncryptKeys(key, keys);
+
+        size_t done = 0;
+#ifdef XTEA_SIMD
+        if (level >= XTEA_AVX2)
+            done += xteaAVX2(buffer, blocks, keys, decrypt);
+        if (level >= XTEA_SSE2)
+            done += xteaSSE2(buffer + done * 2, blocks - done, keys, decrypt);
+#endif
+        if (decrypt)
+            xteaDecryptScalar(buffer + done * 2, blocks - done, keys);
+        else
+            xteaEncryptScalar(buffer + done * 2, blocks - done, keys);
+    }
+}
+
+void Crypt::xteaEncrypt(uint32* buffer, size_t blocks, const uint32* key)
+{
+    xtea(buffer, blocks, key, false, xteaLevel());
+}
+
+void Crypt::xteaDecrypt(uint32* buffer, size_t blocks, const uint32* key)
+{
+    xtea(buffer, blocks, key, true, xteaLevel());
+}
+
+std::string Crypt::getXteaImplementation()
+{
+    return xteaLevelNames[xteaLevel()];
+}
+
+std::string Crypt::benchmarkXtea(int size, int iterations)
+{
+    // original one block at a time implementation
+    auto referenceEncrypt = [](uint32* buffer, size_t blocks, const uint32* key) {
+        for (size_t b = 0; b < blocks; ++b) {
+            uint32 v0 = buffer[b * 2], v1 = buffer[b * 2 + 1];
+            uint32 delta = 0x61C88647;
+            uint32 sum = 0;
+            for (int32 i = 0; i < 32; i++) {
+                v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + key[sum & 3]);
+                sum -= delta;
+                v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + key[sum >> 11 & 3]);
+            }
+            buffer[b * 2] = v0; buffer[b * 2 + 1] = v1;
+        }
+    };
+
+    size_t blocks = std::max<int>(1, size / 8);
+    iterations = std::max<int>(1, iterations);
+    std::mt19937 eng(std::random_device{}());
+    std::vector<uint32> plain(blocks * 2), reference(blocks * 2), buffer(blocks * 2);
+    uint32 key[4];
+
+    std::stringstream ss;
+    ss << "blocks: " << blocks;
+    for (int level = XTEA_SCALAR; level <= xteaLevel(); ++level) {
+        bool valid = true;
+        ticks_t time = 0;
+        for (int i = 0; i < iterations; ++i) {
+            for (auto& k : key)
+                k = eng();
+            for (auto& v : plain)
+                v = eng();
+            reference = plain;
+            referenceEncrypt(reference.data(), blocks, key);
+
+            buffer = plain;
+            stdext::timer timer;
+            xtea(buffer.data(), blocks, key, false, level);
+            valid = valid && buffer == reference;
+            xtea(buffer.data(), blocks, key, true, level);
+            time += timer.elapsed_micros();
+            valid = valid && buffer == plain;
+        }
+        double megabytes = (double)blocks * 8 * 2 * iterations / (1024 * 1024);
+        ss << " | " << xteaLevelNames[level] << ": " << (int)(megabytes * 1000000 / std::max<ticks_t>(1, time)) << " MB/s"
+            << (valid ? "" : " (INVALID)");
+    }
+    return ss.str();
+}
@@ -64,6 +64,13 @@ public:
 #endif
     void bdecrypt(uint8_t * buffer, int len, uint64_t k);
 
+    // XTEA with 32 rounds on 8 byte blocks in place, processes 4 or 8 blocks at once with SSE2/AVX2 when cpu supports it
+    void xteaEncrypt(uint32* buffer, size_t blocks, const uint32* key);
+    void xteaDecrypt(uint32* buffer, size_t blocks, const uint32* key);
+    std::string getXteaImplementation();
+    // verifies every supported implementation against reference one with random keys and data, returns speed of each
+    std::string benchmarkXtea(int size, int iterations);
+
 private:
     std::string _encrypt(const std::string& decrypted_string, bool useMachineUUID);
     std::string _decrypt(const std::string& encrypted_string, bool useMachineUUID);
@@ -1,4 +1,5 @@
 #include "stats.h"
+#include "allocationcounter.h"
 #include <fstream>
 #include <sstream>
 #include <iomanip>
@@ -6,26 +7,257 @@
 #include <framework/stdext/time.h>
 #include <framework/ui/uiwidget.h>
 #include <framework/ui/ui.h>
+#include <framework/core/eventdispatcher.h>
+#include <framework/core/resourcemanager.h>
+#include <array>
 
 Stats g_stats;
 
-void Stats::add(int type, Stat* stat) {
+class StatsRing {
+public:
+    enum {
+        SIZE = 4096,
+        DRAIN_THRESHOLD = SIZE * 3 / 4
+    };
+
+    StatsRing(int tid) : m_tid(tid) {}
+
+    // producer, only owning thread
+    bool push(const StatRecord& record)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= SIZE)
+            return false;
+        m_records[head % SIZE] = record;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+
+    // consumer, only with g_stats.m_mutex locked
+    template<typename F>
+    void drain(F f)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail)
+            f(m_records[tail % SIZE]);
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    int getTid() { return m_tid; }
+    bool isAlive() { return m_alive; }
+    void kill() { m_alive = false; }
+
+private:
+    std::array<StatRecord, SIZE> m_records;
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    int m_tid;
+    std::atomic<bool> m_alive{ true };
+};
+
+namespace {
+    struct ThreadRing {
+        std::shared_ptr<StatsRing> ring;
+        ~ThreadRing() {
+            if (ring)
+                ring->kill();
+        }
+    };
+
+    thread_local ThreadRing threadRing;
+    thread_local std::unordered_map<const char*, uint32_t> threadLiteralLabels;
+    thread_local std::unordered_map<std::string, uint32_t> threadLabels;
+}
+
+uint32_t AutoStat::internLiteral(const char* label)
+{
+    auto it = threadLiteralLabels.find(label);
+    if (it != threadLiteralLabels.end())
+        return it->second;
+    uint32_t id = g_stats.intern(label);
+    threadLiteralLabels.emplace(label, id);
+    return id;
+}
+
+uint32_t AutoStat::internString(const std::string& label)
+{
+    auto it = threadLabels.find(label);
+    if (it != threadLabels.end())
+        return it->second;
+    uint32_t id = g_stats.intern(label);
+    threadLabels.emplace(label, id);
+    return id;
+}
+
+uint32_t Stats::intern(const std::string& label)
+{
+    std::lock_guard<std::mutex> lock(m_labelsMutex);
+    auto it = m_labelIds.find(label);
+    if (it != m_labelIds.end())
+        return it->second;
+    uint32_t id = m_labels.size();
+    m_labels.emplace_back(new std::string(label));
+    m_labelIds.emplace(label, id);
+    return id;
+}
+
+const std::string& Stats::getLabel(uint32_t label)
+{
+    // labels are never removed and strings don't move, so reference stays valid
+    std::lock_guard<std::mutex> lock(m_labelsMutex);
+    return *m_labels[label];
+}
+
+StatsRing* Stats::getRing()
+{
+    if (!threadRing.ring) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        threadRing.ring = std::make_shared<StatsRing>((int)m_threads.size());
+        m_threads.push_back(std::this_thread::get_id());
+        m_rings.push_back(threadRing.ring);
+    }
+    return threadRing.ring.get();
+}
+
+void Stats::record(int type, uint32_t label, int64_t begin, int64_t end, uint16_t flags)
+{
     if (type < 0 || type > STATS_LAST)
         return;
+
+    StatsRing* ring = getRing();
+    if (ring->size() >= StatsRing::DRAIN_THRESHOLD && m_mutex.try_lock()) {
+        // nobody reads stats, measured thread aggregates them itself
+        collect();
+        m_mutex.unlock();
+    }
+    if (!ring->push(StatRecord{ label, (uint16_t)type, flags, begin, end }))
+        m_droppedRecords += 1;
+}
+
+void Stats::addSlow(int type, Stat* stat)
+{
+    if (type < 0 || type > STATS_LAST) {
+        delete stat;
+        return;
+    }
+
     std::lock_guard<std::mutex> lock(m_mutex);
+    if (stats[type].slow.size() > 10000) {
+        delete stats[type].slow.front();
+        stats[type].slow.pop_front();
+    }
+    stats[type].slow.push_back(stat);
+}
+
+void Stats::collect()
+{
+    for (auto it = m_rings.begin(); it != m_rings.end();) {
+        StatsRing* ring = it->get();
+        bool alive = ring->isAlive(); // checked before draining, so no record can be pushed after it
+        ring->drain([&](const StatRecord& record) { aggregate(ring->getTid(), record); });
+        if (!alive)
+            it = m_rings.erase(it);
+        else
+            ++it;
+    }
+}
 
-    auto it = stats[type].data.emplace(stat->description, StatsData(0, 0, stat->extraDescription)).first;
+void Stats::aggregate(int tid, const StatRecord& record)
+{
+    auto& type = stats[record.type];
+    const std::string& label = getLabel(record.label);
+    uint64_t executionTime = std::max<int64_t>(0, record.end - record.begin);
+
+    auto it = type.data.find(label);
+    if (it == type.data.end())
+        it = type.data.emplace(label, StatsData(0, 0, "")).first;
     it->second.calls += 1;
-    it->second.executionTime += stat->executionTime;
+    it->second.executionTime += executionTime;
 
-    if (stat->executionTime > 1000) {
-        if (stats[type].slow.size() > 10000) {
-            delete stats[type].slow.front();
-            stats[type].slow.pop_front();
+    if (executionTime > SLOW_TIME && !(record.flags & RECORD_SLOW_ADDED)) {
+        if (type.slow.size() > 10000) {
+            delete type.slow.front();
+            type.slow.pop_front();
         }
-        stats[type].slow.push_back(stat);
-    } else
-        delete stat;
+        type.slow.push_back(new Stat(executionTime, label, ""));
+    }
+
+    if (m_tracing && m_trace.size() < MAX_TRACE_EVENTS)
+        m_trace.push_back(TraceEvent{ record, tid });
+}
+
+void Stats::startTrace()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    collect(); // older records shouldn't be in trace
+    m_trace.clear();
+    m_tracing = true;
+}
+
+void Stats::stopTrace()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    collect();
+    m_tracing = false;
+}
+
+bool Stats::exportTrace(const std::string& fileName)
+{
+    std::stringstream ret;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        collect();
+
+        int64_t start = m_trace.empty() ? 0 : m_trace.front().record.begin;
+        for (auto& event : m_trace)
+            start = std::min(start, event.record.begin);
+
+        auto escape = [](const std::string& str) {
+            std::string ret;
+            for (char c : str) {
+                if (c == '"' || c == '\\')
+                    ret += '\\';
+                if ((unsigned char)c < 0x20)
+                    continue;
+                ret += c;
+            }
+            return ret;
+        };
+
+        ret << "{\"traceEvents\":[\n";
+        for (size_t tid = 0; tid < m_threads.size(); ++tid) {
+            std::string name = "thread " + std::to_string(tid);
+            if (m_threads[tid] == g_dispatcherThreadId)
+                name = "dispatcher";
+            else if (m_threads[tid] == g_graphicsThreadId)
+                name = "render";
+            ret << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                << ",\"args\":{\"name\":\"" << name << "\"}},\n";
+        }
+        const char* typeNames[] = { "general", "main", "render", "dispatcher", "lua", "luacallback", "packets" };
+        static_assert(sizeof(typeNames) / sizeof(typeNames[0]) == STATS_LAST + 1, "missing stats type name");
+        for (size_t i = 0; i < m_trace.size(); ++i) {
+            const StatRecord& record = m_trace[i].record;
+            ret << "{\"name\":\"" << escape(getLabel(record.label)) << "\",\"cat\":\"" << typeNames[record.type]
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << m_trace[i].tid << ",\"ts\":" << (record.begin - start)
+                << ",\"dur\":" << std::max<int64_t>(0, record.end - record.begin) << "}" << (i + 1 < m_trace.size() ? ",\n" : "\n");
+        }
+        ret << "]}\n";
+    }
+    return g_resources.writeFileContents(fileName, ret.str());
+}
+
+std::string Stats::getTraceInfo()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    collect();
+    std::stringstream ret;
+    ret << "tracing: " << (m_tracing ? "yes" : "no") << ", events: " << m_trace.size() << ", threads: " << m_threads.size()
+        << ", dropped records: " << m_droppedRecords;
+    return ret.str();
 }
 
 std::string Stats::get(int type, int limit, bool pretty) {
@@ -33,6 +265,7 @@ std::string Stats::get(int type, int limit, bool pretty) {
         return "";
 
     std::lock_guard<std::mutex> lock(m_mutex);
+    collect();
     std::multimap<uint64_t, StatsMap::const_iterator> sorted_stats;
     
     uint64_t total_time = 0;
@@ -73,23 +306,27 @@ void Stats::clear(int type) {
     if (type < 0 || type > STATS_LAST)
         return;
     std::lock_guard<std::mutex> lock(m_mutex);
+    collect();
     stats[type].start = stdext::micros();
     stats[type].data.clear();
 }
 
 void Stats::clearAll() {
     std::lock_guard<std::mutex> lock(m_mutex);
+    collect();
     for (int i = 0; i <= STATS_LAST; ++i) {
         stats[i].data.clear();
         stats[i].slow.clear();
     }
     resetSleepTime();
+    drawFrames = drawCalls = stateSwitches = mergedDraws = batchedItems = textDraws = savedTextDraws = 0;
 }
 
 std::string Stats::getSlow(int type, int limit, unsigned int minTime, bool pretty) {
     if (type < 0 || type > STATS_LAST)
         return "";
     std::lock_guard<std::mutex> lock(m_mutex);
+    collect();
 
     std::stringstream ret;
 
@@ -121,11 +358,47 @@ void Stats::clearSlow(int type) {
     if (type < 0 || type > STATS_LAST)
         return;
     std::lock_guard<std::mutex> lock(m_mutex);
+    collect();
     for (auto& stat : stats[type].slow)
         delete stat;
     stats[type].slow.clear();
 }
 
+void Stats::startAllocationCounting()
+{
+    allocation_counter::start();
+}
+
+bool Stats::stopAllocationCounting(uint64_t& allocations, uint64_t& bytes)
+{
+    allocation_counter::stop(allocations, bytes);
+    return allocation_counter::isAvailable();
+}
+
+void Stats::addDrawFrame(int calls, int switches)
+{
+    lastDrawCalls = calls;
+    lastStateSwitches = switches;
+    drawFrames += 1;
+    drawCalls += calls;
+    stateSwitches += switches;
+}
+
+std::string Stats::getDrawInfo(bool pretty)
+{
+    int64_t frames = std::max<int64_t>(1, drawFrames);
+    std::stringstream ret;
+    if (pretty) {
+        ret << "Draw calls: " << lastDrawCalls << " (avg " << drawCalls / frames << ")"
+            << " State switches: " << lastStateSwitches << " (avg " << stateSwitches / frames << ")"
+            << " Merged: " << mergedDraws / frames << " Reordered: " << batchedItems / frames
+            << " Texts: " << textDraws / frames << " (saved " << savedTextDraws / frames << " calls)";
+    } else {
+        ret << lastDrawCalls << "|" << lastStateSwitches << "|" << drawCalls / frames << "|" << stateSwitches / frames
+            << "|" << mergedDraws / frames << "|" << batchedItems / frames << "|" << textDraws / frames << "|" << savedTextDraws / frames;
+    }
+    return ret.str();
+}
 
 void Stats::addWidget(UIWidget* widget)
 {
@@ -9,8 +9,14 @@
 #include <chrono>
 #include <unordered_map>
 #include <set>
+#include <memory>
+#include <vector>
+#include <thread>
 
-// NOT THREAD SAFE
+// record, intern, addSlow, draw, texture, thing and creature counters can be called from any thread,
+// record writes to per thread StatsRing
+// get, clear and trace functions collect all rings under lock and are meant for main thread (lua)
+// widget counters and sleep time are NOT THREAD SAFE, main thread only
 
 enum StatsTypes{
     STATS_FIRST = 0,
@@ -43,11 +49,42 @@ struct StatsData {
 using StatsMap = std::unordered_map<std::string, StatsData>;
 using StatsList = std::list<Stat*>;
 
+// single measurement, written by measured thread to its own ring buffer
+struct StatRecord {
+    uint32_t label;
+    uint16_t type;
+    uint16_t flags;
+    int64_t begin;
+    int64_t end;
+};
+
+class StatsRing;
 class UIWidget;
 
 class Stats {
 public:
-    void add(int type, Stat* stats);
+    enum {
+        SLOW_TIME = 1000, // us
+        MAX_TRACE_EVENTS = 1000000
+    };
+    enum RecordFlags : uint16_t {
+        RECORD_SLOW_ADDED = 1 // slow stat with extra description was added by AutoStat
+    };
+
+    // labels are interned once, records keep only their id
+    uint32_t intern(const std::string& label);
+    const std::string& getLabel(uint32_t label);
+
+    // lock-free for calling thread, records are aggregated when stats are read
+    void record(int type, uint32_t label, int64_t begin, int64_t end, uint16_t flags = 0);
+    void addSlow(int type, Stat* stat);
+
+    // records collected while tracing can be exported to chrome://tracing json
+    void startTrace();
+    void stopTrace();
+    bool isTracing() { return m_tracing; }
+    bool exportTrace(const std::string& fileName);
+    std::string getTraceInfo();
 
     std::string get(int type, int limit, bool pretty);
     void clear(int type);
@@ -81,6 +118,22 @@ public:
     inline void addCreature() { createdCreatures += 1; }
     inline void removeCreature() { destroyedCreatures += 1; }
 
+    // counts allocations (global operator new) of calling thread until stop, used by benchmarks,
+    // stop returns false when client was built without ALLOCATION_COUNTER option
+    void startAllocationCounting();
+    bool stopAllocationCounting(uint64_t& allocations, uint64_t& bytes);
+
+    int getCreatedThings() { return createdThings; }
+    int getDestroyedThings() { return destroyedThings; }
+    int getCreatedCreatures() { return createdCreatures; }
+    int getDestroyedCreatures() { return destroyedCreatures; }
+
+    void addDrawFrame(int calls, int stateSwitches);
+    inline void addMergedDraws(int draws) { mergedDraws += draws; }
+    inline void addBatchedItems(int items) { batchedItems += items; }
+    inline void addTextDraws(int texts, int saved) { textDraws += texts; savedTextDraws += saved; }
+    std::string getDrawInfo(bool pretty);
+
 private:
     struct {
         StatsMap data;
@@ -91,38 +144,86 @@ private:
     std::set<UIWidget*> widgets;
     int createdWidgets = 0;
     int destroyedWidgets = 0;
-    int createdTextures = 0;
-    int destroyedTextures = 0;
-    int createdThings = 0;
-    int destroyedThings = 0;
-    int createdCreatures = 0;
-    int destroyedCreatures = 0;
+    // textures and things can be released outside main thread, by render thread or parallel floor drawing
+    std::atomic<int> createdTextures{ 0 };
+    std::atomic<int> destroyedTextures{ 0 };
+    std::atomic<int> createdThings{ 0 };
+    std::atomic<int> destroyedThings{ 0 };
+    std::atomic<int> createdCreatures{ 0 };
+    std::atomic<int> destroyedCreatures{ 0 };
+    std::atomic<int> lastDrawCalls{ 0 };
+    std::atomic<int> lastStateSwitches{ 0 };
+    std::atomic<int64_t> drawFrames{ 0 };
+    std::atomic<int64_t> drawCalls{ 0 };
+    std::atomic<int64_t> stateSwitches{ 0 };
+    std::atomic<int64_t> mergedDraws{ 0 };
+    std::atomic<int64_t> batchedItems{ 0 };
+    std::atomic<int64_t> textDraws{ 0 };
+    std::atomic<int64_t> savedTextDraws{ 0 };
     std::mutex m_mutex;
+
+    // must be called with m_mutex locked
+    void collect();
+    void aggregate(int tid, const StatRecord& record);
+    StatsRing* getRing();
+    friend class StatsRing;
+
+    struct TraceEvent {
+        StatRecord record;
+        int tid;
+    };
+
+    std::vector<std::shared_ptr<StatsRing>> m_rings;
+    std::vector<std::thread::id> m_threads; // by ring tid
+    std::vector<TraceEvent> m_trace;
+    std::atomic<bool> m_tracing{ false };
+    std::atomic<uint64_t> m_droppedRecords{ 0 };
+
+    std::mutex m_labelsMutex;
+    std::vector<std::unique_ptr<std::string>> m_labels;
+    std::unordered_map<std::string, uint32_t> m_labelIds;
 };
 
 extern Stats g_stats;
 
 class AutoStat {
 public:
+    // label must be a string literal, it's interned once per thread by its address
+    AutoStat(int type, const char* label) :
+            m_type(type), m_label(internLiteral(label)), m_begin(now()) {}
     AutoStat(int type, const std::string& description, const std::string& extraDescription = "") :
-            m_type(type), m_stat(new Stat(0, description, extraDescription)), m_timePoint(std::chrono::high_resolution_clock::now()) {}
+            m_type(type), m_label(internString(description)), m_begin(now()) {
+        if (!extraDescription.empty())
+            m_extraDescription.reset(new std::string(extraDescription));
+    }
 
     ~AutoStat() {
-        m_stat->executionTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - m_timePoint).count();
-        m_stat->executionTime -= m_minusTime;
-        g_stats.add(m_type, m_stat);
+        int64_t end = now() - m_minusTime;
+        uint16_t flags = 0;
+        if (m_extraDescription && end - m_begin > Stats::SLOW_TIME) {
+            g_stats.addSlow(m_type, new Stat(end - m_begin, g_stats.getLabel(m_label), *m_extraDescription));
+            flags |= Stats::RECORD_SLOW_ADDED;
+        }
+        g_stats.record(m_type, m_label, m_begin, end, flags);
     }
 
     AutoStat(const AutoStat&) = delete;
     AutoStat & operator=(const AutoStat&) = delete;
 
 private:
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+    static uint32_t internLiteral(const char* label);
+    static uint32_t internString(const std::string& label);
+
     int m_type;
-    Stat* m_stat;
+    uint32_t m_label;
+    std::unique_ptr<std::string> m_extraDescription;
 
 protected:
-    uint64_t m_minusTime = 0;
-    std::chrono::high_resolution_clock::time_point m_timePoint;
+    int64_t m_minusTime = 0;
+    int64_t m_begin;
 };
 
 #endif
\ No newline at end of file
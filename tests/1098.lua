@@ -9,6 +9,20 @@ Test.Test("Test 1098 and bot", function(test, wait, ss, fail)
     
     wait(2500)
     ss()
+
+    local maxFps
+    test(function()
+        -- uncapped frame rate, frame times of the recorded session can be compared between builds
+        maxFps = g_app.getMaxFps()
+        g_app.setMaxFps(0)
+    end)
+    wait(2000)
+    test(function()
+        local processingFps, graphicsFps = g_app.getProcessingFps(), g_app.getGraphicsFps()
+        g_logger.info("[TEST] frame time: processing " .. string.format("%.2f", 1000 / math.max(1, processingFps)) .. " ms (" .. processingFps .. " fps)"
+            .. ", graphics " .. string.format("%.2f", 1000 / math.max(1, graphicsFps)) .. " ms (" .. graphicsFps .. " fps)")
+        g_app.setMaxFps(maxFps)
+    end)
     wait(500)
     ss()
     wait(500)
@@ -28,6 +42,44 @@ Test.Test("Test 1098 and bot", function(test, wait, ss, fail)
     end)
     ss()
 
+    local drawLights, cpuLightMaps, gpuLightMaps
+    test(function()
+        local gameMapPanel = modules.game_interface.gameMapPanel
+        drawLights = gameMapPanel:isDrawingLights()
+        gameMapPanel:setDrawLights(true)
+    end)
+    wait(1000)
+    test(function()
+        local gameMapPanel = modules.game_interface.gameMapPanel
+        g_logger.info("[TEST] " .. gameMapPanel:getLightStats())
+        if gameMapPanel:getLightMapCount(false) == 0 then
+            fail("No cpu light maps were drawn")
+        end
+        gpuLightMaps = gameMapPanel:getLightMapCount(true)
+        gameMapPanel:setGpuLights(true)
+    end)
+    wait(1000)
+    ss()
+    test(function()
+        local gameMapPanel = modules.game_interface.gameMapPanel
+        g_logger.info("[TEST] " .. gameMapPanel:getLightStats())
+        local gpuUsed = gameMapPanel:getLightMapCount(true) > gpuLightMaps
+        if gpuUsed ~= (g_graphics.canUseFBO() and g_graphics.canUseBlendMax()) then
+            fail("Gpu lights should be used only when framebuffers and max blending are available")
+        end
+        gameMapPanel:setGpuLights(false)
+        gameMapPanel:setDrawLights(drawLights)
+    end)
+
+    test(function()
+        -- same game time for both passes, floors drawn in parallel must produce the same draw queue
+        local result = modules.game_interface.gameMapPanel:compareParallelFloors()
+        g_logger.info("[TEST] parallel floors: " .. result)
+        if not result:find("identical") then
+            fail("Map drawn with parallel floors is different than serial one")
+        end
+    end)
+
     local configId = 0
     for i=1,3 do
         test(function()
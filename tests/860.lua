@@ -10,6 +10,20 @@ Test.Test("Test 860 and bot", function(test, wait, ss, fail)
     wait(3000)
     ss()
 
+    local maxFps
+    test(function()
+        -- uncapped frame rate, frame times of the recorded session can be compared between builds
+        maxFps = g_app.getMaxFps()
+        g_app.setMaxFps(0)
+    end)
+    wait(2000)
+    test(function()
+        local processingFps, graphicsFps = g_app.getProcessingFps(), g_app.getGraphicsFps()
+        g_logger.info("[TEST] frame time: processing " .. string.format("%.2f", 1000 / math.max(1, processingFps)) .. " ms (" .. processingFps .. " fps)"
+            .. ", graphics " .. string.format("%.2f", 1000 / math.max(1, graphicsFps)) .. " ms (" .. graphicsFps .. " fps)")
+        g_app.setMaxFps(maxFps)
+    end)
+
     local configId = 0
     for i=1,3 do
         test(function()
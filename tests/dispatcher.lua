@@ -0,0 +1,20 @@
+Test.Test("Test dispatcher timing wheel", function(test, wait, ss, fail)
+    local executed = 0
+    local canceled = 0
+    test(function()
+        for i=1,1000 do
+            local event = scheduleEvent(function() executed = executed + 1 end, i % 500)
+            if i % 2 == 0 then
+                removeEvent(event)
+                canceled = canceled + 1
+            end
+        end
+    end)
+    wait(1000)
+    test(function()
+        if executed ~= 1000 - canceled then
+            fail("Executed " .. executed .. " events, expected " .. (1000 - canceled))
+        end
+        g_logger.info("[TEST] " .. g_dispatcher.benchmark(100000))
+    end)
+end)
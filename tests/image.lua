@@ -0,0 +1,29 @@
+Test.Test("Test image pixel kernels", function(test, wait, ss, fail)
+    test(function()
+        g_logger.info("[TEST] image kernels: " .. Image.getKernelsName())
+        for _, width in ipairs({1, 3, 7, 8, 13, 32, 64, 67, 128}) do
+            local result = Image.benchmarkKernels(width, 200)
+            g_logger.info("[TEST] " .. result)
+            if result:find("INVALID") then
+                fail("Image kernels don't match scalar ones for " .. width .. " pixels")
+            end
+        end
+    end)
+
+    test(function()
+        g_settings.setNode("things", {})
+        g_game.setClientVersion(1098)
+    end)
+    wait(1000)
+    test(function()
+        -- speed on real sprites, most of their rows are short and partially transparent
+        if not g_sprites.isLoaded() then
+            fail("Sprites of 1098 are not loaded")
+        end
+        local result = g_sprites.benchmarkKernels(5000, 5)
+        g_logger.info("[TEST] " .. result)
+        if result:find("INVALID") then
+            fail("Image kernels don't match scalar ones on loaded sprites")
+        end
+    end)
+end)
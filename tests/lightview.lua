@@ -0,0 +1,13 @@
+Test.Test("Test light view", function(test, wait, ss, fail)
+    -- synthetic scenes, from default view to big optimizeForSize views
+    local scenes = { {19, 15, 50}, {35, 27, 200}, {67, 51, 1000} }
+    for _, scene in ipairs(scenes) do
+        test(function()
+            local result = g_map.benchmarkLightView(scene[1], scene[2], scene[3], 10)
+            g_logger.info("[TEST] " .. result)
+            if not result:find("identical") then
+                fail("Light map is different than reference")
+            end
+        end)
+    end
+end)
@@ -0,0 +1,35 @@
+Test.Test("Test map tile lookups", function(test, wait, ss, fail)
+    test(function()
+        EnterGame.hide()
+        g_settings.setNode("things", {})
+        g_game.setClientVersion(1098)
+        g_game.setProtocolVersion(g_game.getClientProtocolVersion(1098))
+        g_game.playRecord("1098.record")
+    end)
+
+    -- map description and map moves from record are parsed while waiting
+    for i=1,5 do
+        wait(2000)
+        test(function()
+            if not g_game.isOnline() then
+                fail("Should be online")
+            end
+            local result = g_map.benchmarkTileLookups(100)
+            g_logger.info("[TEST] " .. result)
+            if result:find("INVALID") then
+                fail("TileBlockMap and std::map found different tiles")
+            end
+        end)
+    end
+
+    test(function()
+        g_game.forceLogout()
+    end)
+    wait(1000)
+    test(function()
+        if g_game.isOnline() then
+            fail("Shouldn't be online")
+        end
+        EnterGame.show()
+    end)
+end)
@@ -0,0 +1,33 @@
+Test.Test("Test path finding", function(test, wait, ss, fail)
+    test(function()
+        EnterGame.hide()
+        g_settings.setNode("things", {})
+        g_game.setClientVersion(1098)
+        g_game.setProtocolVersion(g_game.getClientProtocolVersion(1098))
+        g_game.playRecord("1098.record")
+    end)
+
+    -- searches run against the map known at each point of the record
+    for i=1,5 do
+        wait(2000)
+        test(function()
+            if not g_game.isOnline() then
+                fail("Should be online")
+            end
+            local player = g_game.getLocalPlayer()
+            g_logger.info("[TEST] " .. g_map.benchmarkPathFinding(player:getPosition(), 5))
+            g_logger.info("[TEST] " .. g_asyncDispatcher.getStats())
+        end)
+    end
+
+    test(function()
+        g_game.forceLogout()
+    end)
+    wait(1000)
+    test(function()
+        if g_game.isOnline() then
+            fail("Shouldn't be online")
+        end
+        EnterGame.show()
+    end)
+end)
@@ -0,0 +1,113 @@
+Test.Test("Test binary records", function(test, wait, ss, fail)
+    local duration = 0
+    local blocks = 0
+    test(function()
+        EnterGame.hide()
+        g_settings.setNode("things", {})
+        g_game.setClientVersion(1098)
+        g_game.setProtocolVersion(g_game.getClientProtocolVersion(1098))
+        -- packets of old text record are recorded again into binary one
+        local result = g_game.benchmarkRecord("1098.record", "test_binary.record")
+        g_game.forceLogout()
+        if result.packets == 0 then
+            fail("No packets were recorded")
+        end
+    end)
+    wait(1000) -- index is written when protocol with recorder is released
+
+    test(function()
+        if g_game.isOnline() then
+            fail("Shouldn't be online")
+        end
+        g_game.playRecord("test_binary.record")
+        if not g_game.isBinaryRecord() then
+            fail("Recorded file should be binary")
+        end
+        duration = g_game.getRecordDuration()
+        g_logger.info("[TEST] binary record duration: " .. duration)
+        if duration <= 0 then
+            fail("Binary record should have duration")
+        end
+    end)
+    wait(2000)
+    test(function()
+        if not g_game.isOnline() then
+            fail("Should be online")
+        end
+        local time = g_game.getRecordTime()
+        if time <= 0 then
+            fail("Packets should be played")
+        end
+        local seekTime = math.max(time, math.floor(duration / 2))
+        if not g_game.seekRecord(seekTime) then
+            fail("Record should be seekable forward")
+        end
+        local seekedTime = g_game.getRecordTime()
+        g_logger.info("[TEST] record time before seek: " .. time .. ", after seek to " .. seekTime .. ": " .. seekedTime)
+        if seekedTime < time or seekedTime > seekTime then
+            fail("Last parsed packet should be the last one before seek time")
+        end
+        if g_game.seekRecord(time - 1) then
+            fail("Record shouldn't be seekable backward")
+        end
+        if g_game.getRecordTime() ~= seekedTime then
+            fail("Failed seek shouldn't parse packets")
+        end
+    end)
+    wait(1000)
+    test(function()
+        if not g_game.isOnline() then
+            fail("Should be online after seek")
+        end
+        g_logger.info("[TEST] record time 1s after seek: " .. g_game.getRecordTime())
+        g_game.forceLogout()
+    end)
+    wait(1000)
+
+    test(function()
+        -- record cut in its last block like after crash, without index and trailer blocks are found by their headers
+        local function readLE(data, pos, size)
+            local value = 0
+            for i = size, 1, -1 do
+                value = value * 256 + data:byte(pos + i - 1)
+            end
+            return value
+        end
+        local file = io.open("records/test_binary.record", "rb")
+        local data = file:read("*a")
+        file:close()
+        -- trailer: u32 blocks, i64 index offset, "OTRI", index entry starts with i64 block offset
+        blocks = readLE(data, #data - 15, 4)
+        local indexOffset = readLE(data, #data - 11, 8)
+        local lastBlockOffset = readLE(data, indexOffset + (blocks - 1) * 28 + 1, 8)
+        file = io.open("records/test_truncated.record", "wb")
+        file:write(data:sub(1, lastBlockOffset + 10))
+        file:close()
+
+        g_game.playRecord("test_truncated.record")
+        if not g_game.isBinaryRecord() then
+            fail("Truncated record should be binary")
+        end
+        local truncatedDuration = g_game.getRecordDuration()
+        g_logger.info("[TEST] blocks: " .. blocks .. ", truncated record duration: " .. truncatedDuration)
+        if (blocks > 1 and (truncatedDuration <= 0 or truncatedDuration >= duration)) or (blocks == 1 and truncatedDuration ~= 0) then
+            fail("Truncated record should contain only its complete blocks")
+        end
+    end)
+    wait(2000)
+    test(function()
+        if blocks > 1 and not g_game.isOnline() then
+            fail("Should be online")
+        end
+        g_game.forceLogout()
+    end)
+    wait(1000)
+    test(function()
+        if g_game.isOnline() then
+            fail("Shouldn't be online")
+        end
+        os.remove("records/test_binary.record")
+        os.remove("records/test_truncated.record")
+        EnterGame.show()
+    end)
+end)
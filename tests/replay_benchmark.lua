@@ -0,0 +1,41 @@
+Test.Test("Benchmark record replay", function(test, wait, ss, fail)
+    test(function()
+        EnterGame.hide()
+        g_settings.setNode("things", {})
+        g_game.setClientVersion(1098)
+        g_game.setProtocolVersion(g_game.getClientProtocolVersion(1098))
+        -- whole record is parsed at once, game time is moved forward with packets
+        local result = g_game.benchmarkRecord("1098.record")
+        if result.packets == 0 then
+            fail("No packets were replayed")
+        end
+        g_logger.info("[TEST] packets: " .. result.packets .. " (" .. math.floor(result.bytes / 1024) .. " KB)"
+            .. " in " .. math.floor(result.realTime / 1000) .. " ms | packets/s: " .. result.packetsPerSecond
+            .. " | record time: " .. math.floor(result.recordTime / 1000) .. " s (x" .. result.speedup .. ")"
+            .. " | clock advanced: " .. math.floor(result.clockAdvance / 1000) .. " s")
+        -- allocations are counted only by client built with ALLOCATION_COUNTER option
+        local allocations = "not counted"
+        if result.allocations >= 0 then
+            allocations = result.allocations .. " (" .. math.floor(result.allocatedBytes / 1024) .. " KB)"
+                .. " | allocations/packet: " .. math.floor(result.allocations / result.packets)
+        end
+        g_logger.info("[TEST] allocations: " .. allocations
+            .. " | things: +" .. result.createdThings .. " -" .. result.destroyedThings
+            .. " | creatures: +" .. result.createdCreatures .. " -" .. result.destroyedCreatures)
+        g_logger.info("[TEST] " .. g_stats.get(6, 20, true)) -- STATS_PACKETS
+        if not g_game.isOnline() then
+            fail("Should be online")
+        end
+    end)
+
+    test(function()
+        g_game.forceLogout()
+    end)
+    wait(1000)
+    test(function()
+        if g_game.isOnline() then
+            fail("Shouldn't be online")
+        end
+        EnterGame.show()
+    end)
+end)
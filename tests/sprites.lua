@@ -0,0 +1,70 @@
+Test.Test("Test malformed sprites", function(test, wait, ss, fail)
+    local function u16(value)
+        return string.char(value % 256, math.floor(value / 256) % 256)
+    end
+    local function u32(value)
+        return u16(value % 65536) .. u16(math.floor(value / 65536))
+    end
+    local function sprite(transparent, colored, dataSize)
+        return string.char(255, 0, 255) .. u16(4 + dataSize) .. u16(transparent) .. u16(colored) .. string.rep(string.char(200), dataSize)
+    end
+
+    local features = {}
+    local spritesLoaded = false
+    test(function()
+        spritesLoaded = g_sprites.isLoaded()
+        for _, feature in ipairs({GameSpritesU32, GameSpritesAlphaChannel}) do
+            features[feature] = g_game.getFeature(feature)
+            g_game.disableFeature(feature)
+        end
+
+        local sprites = {
+            sprite(0, 2, 6), -- valid
+            sprite(1020, 100, 300), -- more colored pixels than space left in 32x32 image
+            sprite(0, 50, 10), -- less data than colored pixels
+        }
+        local headerSize = 4 + 2 + 4 * (#sprites + 1)
+        local data = u32(0x12345678) .. u16(#sprites + 1)
+        local offset = headerSize
+        for _, s in ipairs(sprites) do
+            data = data .. u32(offset)
+            offset = offset + #s
+        end
+        data = data .. u32(offset + 1000) -- address outside of file
+        data = data .. table.concat(sprites)
+        g_resources.writeFileContents("/malformed_sprites.spr", data)
+
+        if not g_sprites.loadSpr("/malformed_sprites") then
+            fail("Can't load malformed_sprites.spr")
+        end
+        if g_sprites.getSpritesCount() ~= #sprites + 1 then
+            fail("Invalid sprites count: " .. g_sprites.getSpritesCount())
+        end
+
+        local widget = UISprite.create()
+        for id, expected in ipairs({true, true, true, false}) do
+            widget:setSpriteId(id)
+            if widget:hasSprite() ~= expected then
+                fail("Invalid result for sprite " .. id)
+            end
+        end
+        widget:destroy()
+    end)
+
+    test(function()
+        g_sprites.unload()
+        g_resources.deleteFile("/malformed_sprites.spr")
+        for feature, enabled in pairs(features) do
+            if enabled then
+                g_game.enableFeature(feature)
+            end
+        end
+        -- sprites of current client version are loaded again for following tests
+        if spritesLoaded then
+            modules.game_things.load()
+            if not g_sprites.isLoaded() then
+                fail("Can't load sprites again")
+            end
+        end
+    end)
+end)
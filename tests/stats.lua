@@ -0,0 +1,38 @@
+Test.Test("Test stats trace export", function(test, wait, ss, fail)
+    test(function()
+        EnterGame.hide()
+        g_settings.setNode("things", {})
+        g_game.setClientVersion(1098)
+        g_game.setProtocolVersion(g_game.getClientProtocolVersion(1098))
+        g_game.playRecord("1098.record")
+        g_stats.startTrace()
+    end)
+
+    wait(3000)
+    test(function()
+        if not g_game.isOnline() then
+            fail("Should be online")
+        end
+        g_stats.stopTrace()
+        g_logger.info("[TEST] " .. g_stats.getTraceInfo())
+        g_logger.info("[TEST] " .. g_stats.getDrawInfo(true))
+        g_logger.info("[TEST] " .. g_text.getStats())
+        if g_stats.get(2, 10, true) == "" then
+            fail("Render stats should be aggregated")
+        end
+        if not g_stats.exportTrace("/trace.json") then
+            fail("Can't export trace")
+        end
+    end)
+
+    test(function()
+        g_game.forceLogout()
+    end)
+    wait(1000)
+    test(function()
+        if g_game.isOnline() then
+            fail("Shouldn't be online")
+        end
+        EnterGame.show()
+    end)
+end)
@@ -0,0 +1,12 @@
+Test.Test("Test xtea implementations", function(test, wait, ss, fail)
+    test(function()
+        g_logger.info("[TEST] xtea implementation: " .. g_crypt.getXteaImplementation())
+        for _, size in ipairs({8, 24, 64, 72, 4096, 327680}) do
+            local result = g_crypt.benchmarkXtea(size, 20)
+            g_logger.info("[TEST] " .. result)
+            if result:find("INVALID") then
+                fail("Xtea implementation doesn't match reference one for " .. size .. " bytes")
+            end
+        end
+    end)
+end)